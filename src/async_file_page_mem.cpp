@@ -0,0 +1,271 @@
+#include "async_file_page_mem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+async_file_page_mem::async_file_page_mem(
+  const std::string& a_eeprom_filename,
+  size_t a_page_count,
+  size_t a_page_size,
+  bool a_sync_writes,
+  const page_mem_timing_t& a_timing
+) :
+  m_eeprom_filename(a_eeprom_filename),
+  m_page_count(a_page_count),
+  m_page_size(a_page_size),
+  m_sync_writes(a_sync_writes),
+  m_timing(a_timing),
+  m_fd(-1),
+  m_status(status_t::ready),
+  m_error(0),
+  m_busy_ticks(0),
+  m_mutex(),
+  m_cv(),
+  m_request(),
+  m_request_pending(false),
+  m_stop(false),
+  m_worker()
+{
+  m_fd = open(m_eeprom_filename.c_str(), O_RDWR | O_CREAT, 0644);
+  if (m_fd < 0) {
+    m_error = errno;
+    m_status = status_t::error;
+    return;
+  }
+  // Файл меньше образа дополняется нулями, как и при загрузке в raw_file_page_mem
+  struct stat file_stat {};
+  if (fstat(m_fd, &file_stat) != 0 ||
+      (static_cast<size_t>(file_stat.st_size) < m_page_count * m_page_size &&
+       ftruncate(m_fd, static_cast<off_t>(m_page_count * m_page_size)) != 0)) {
+    m_error = errno;
+    m_status = status_t::error;
+    return;
+  }
+  m_worker = std::thread(&async_file_page_mem::worker, this);
+}
+
+async_file_page_mem::~async_file_page_mem()
+{
+  if (m_worker.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cv.notify_one();
+    m_worker.join();
+  }
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+}
+
+void async_file_page_mem::read_page(uint8_t* ap_buf, uint32_t a_index)
+{
+  start_io_operation(op_t::read, ap_buf, a_index, 0, m_page_size);
+}
+
+void async_file_page_mem::write_page(const uint8_t* ap_buf, uint32_t a_index)
+{
+  start_io_operation(op_t::write, const_cast<uint8_t*>(ap_buf), a_index, 0, m_page_size);
+}
+
+size_t async_file_page_mem::page_size() const
+{
+  return m_page_size;
+}
+
+uint32_t async_file_page_mem::page_count() const
+{
+  return m_page_count;
+}
+
+irs_status_t async_file_page_mem::status() const
+{
+  switch (m_status.load(std::memory_order_acquire)) {
+    case status_t::ready: {
+      return irs_st_ready;
+    }
+    case status_t::busy: {
+      return irs_st_busy;
+    }
+    case status_t::error: {
+      return irs_st_error;
+    }
+  }
+  return irs_st_error;
+}
+
+void async_file_page_mem::tick()
+{
+  if (m_status.load(std::memory_order_relaxed) == status_t::busy) {
+    m_busy_ticks++;
+  }
+}
+
+bool async_file_page_mem::supports_partial_write() const
+{
+  return true;
+}
+
+void async_file_page_mem::write_bytes(
+  const uint8_t* ap_buf, uint32_t a_index, size_type a_offset, size_type a_size
+)
+{
+  assert(a_offset + a_size <= m_page_size);
+  // Запрос адресует байты буфера с теми же смещениями, что и в странице
+  start_io_operation(
+    op_t::write, const_cast<uint8_t*>(ap_buf) + a_offset, a_index, a_offset, a_size
+  );
+}
+
+bool async_file_page_mem::supports_burst() const
+{
+  return true;
+}
+
+void async_file_page_mem::read_pages(uint8_t* ap_buf, uint32_t a_index, uint32_t a_count)
+{
+  assert(a_count > 0 && a_index + a_count <= m_page_count);
+  start_io_operation(op_t::read, ap_buf, a_index, 0, a_count * m_page_size);
+}
+
+void async_file_page_mem::write_pages(const uint8_t* ap_buf, uint32_t a_index, uint32_t a_count)
+{
+  assert(a_count > 0 && a_index + a_count <= m_page_count);
+  start_io_operation(
+    op_t::write, const_cast<uint8_t*>(ap_buf), a_index, 0, a_count * m_page_size
+  );
+}
+
+int async_file_page_mem::error() const
+{
+  return m_error.load();
+}
+
+uint64_t async_file_page_mem::busy_ticks() const
+{
+  return m_busy_ticks;
+}
+
+const page_mem_timing_t& async_file_page_mem::timing() const
+{
+  return m_timing;
+}
+
+void async_file_page_mem::set_timing(const page_mem_timing_t& a_timing)
+{
+  assert(a_timing.bytes_per_tick > 0);
+  m_timing = a_timing;
+}
+
+void async_file_page_mem::start_io_operation(
+  op_t a_op,
+  uint8_t* ap_data,
+  uint32_t a_index,
+  size_t a_offset,
+  size_t a_size
+)
+{
+  assert(a_index < m_page_count);
+  assert(m_status.load() != status_t::busy);
+  if (m_fd < 0) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_request = {
+      a_op,
+      ap_data,
+      static_cast<off_t>(a_index * m_page_size + a_offset),
+      a_size,
+      duration(a_op, a_offset, a_size)
+    };
+    m_request_pending = true;
+    m_status.store(status_t::busy, std::memory_order_release);
+  }
+  m_cv.notify_one();
+}
+
+std::chrono::microseconds async_file_page_mem::duration(
+  op_t a_op, size_t a_offset, size_t a_size
+) const
+{
+  if (m_timing.full_page_per_tick) {
+    return std::chrono::microseconds(0);
+  }
+  const size_t bytes_per_tick = m_timing.bytes_per_tick;
+  uint64_t ticks = 0;
+  if (a_op == op_t::read) {
+    ticks = m_timing.read_latency_ticks + (a_size + bytes_per_tick - 1) / bytes_per_tick;
+  } else {
+    // Цикл записи выполняется после каждой страницы
+    size_t current_byte = a_offset;
+    const size_t end_byte = a_offset + a_size;
+    while (current_byte < end_byte) {
+      const size_t page_end_byte =
+        std::min(end_byte, (current_byte / m_page_size + 1) * m_page_size);
+      ticks += (page_end_byte - current_byte + bytes_per_tick - 1) / bytes_per_tick +
+        m_timing.write_cycle_ticks;
+      current_byte = page_end_byte;
+    }
+  }
+  return std::chrono::microseconds(
+    static_cast<int64_t>(static_cast<double>(ticks) * m_timing.tick_duration_us)
+  );
+}
+
+void async_file_page_mem::worker()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_cv.wait(lock, [this] {
+      return m_request_pending || m_stop;
+    });
+    // Начатая операция выполняется и при остановке потока
+    if (!m_request_pending) {
+      break;
+    }
+    const request_t request = m_request;
+    m_request_pending = false;
+    lock.unlock();
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const int error = execute(request);
+    std::this_thread::sleep_until(start + request.duration);
+    lock.lock();
+    if (error != 0) {
+      m_error = error;
+    }
+    m_status.store(error == 0 ? status_t::ready : status_t::error, std::memory_order_release);
+  }
+}
+
+int async_file_page_mem::execute(const request_t& a_request)
+{
+  size_t done = 0;
+  while (done < a_request.size) {
+    const off_t offset = a_request.offset + static_cast<off_t>(done);
+    const ssize_t result =
+      a_request.op == op_t::read
+        ? pread(m_fd, a_request.p_buffer + done, a_request.size - done, offset)
+        : pwrite(m_fd, a_request.p_buffer + done, a_request.size - done, offset);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    // Файл не бывает короче образа, поэтому конец файла при чтении - ошибка
+    if (result == 0) {
+      return EIO;
+    }
+    done += static_cast<size_t>(result);
+  }
+  if (a_request.op == op_t::write && m_sync_writes && fdatasync(m_fd) != 0) {
+    return errno;
+  }
+  return 0;
+}
@@ -0,0 +1,112 @@
+#ifndef ASYNC_FILE_PAGE_MEM_H
+#define ASYNC_FILE_PAGE_MEM_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "raw_file_page_mem.h"
+
+/// \brief Эмуляция eeprom с помощью файла, чтение и запись которого выполняет отдельный поток
+/// \details read_page и write_page только передают запрос потоку ввода-вывода, который выполняет
+/// pread или pwrite. Пока запрос не выполнен, status возвращает irs_st_busy, после ошибки -
+/// irs_st_error, а error - errno ошибки. tick ничего не делает, поэтому время операции определяется
+/// файловой системой, а не кол-вом вызовов tick. С профилем времени, в котором задержки
+/// учитываются, поток ввода-вывода не завершает операцию раньше, чем через моделируемое время
+/// операции в реальных микросекундах. Так несколько таких памятей ждут eeprom параллельно, как
+/// микросхемы на разных шинах. Буфер операции должен существовать до ее завершения
+class async_file_page_mem final : public irs::page_mem_t
+{
+public:
+  /// \param a_sync_writes Вызывать fdatasync после каждой записи
+  /// \param a_timing Профиль времени. fast - без задержек
+  explicit async_file_page_mem(
+    const std::string& a_eeprom_filename,
+    size_t a_page_count,
+    size_t a_page_size,
+    bool a_sync_writes = false,
+    const page_mem_timing_t& a_timing = page_mem_timing_t::fast()
+  );
+  /// \details Дожидается завершения начатой операции
+  ~async_file_page_mem() override;
+  async_file_page_mem(const async_file_page_mem&) = delete;
+  async_file_page_mem& operator=(const async_file_page_mem&) = delete;
+
+  typedef size_t size_type;
+  void read_page(uint8_t* ap_buf, uint32_t a_index) override;
+  void write_page(const uint8_t* ap_buf, uint32_t a_index) override;
+  [[nodiscard]] size_type page_size() const override;
+  [[nodiscard]] uint32_t page_count() const override;
+  [[nodiscard]] irs_status_t status() const override;
+  void tick() override;
+  [[nodiscard]] bool supports_partial_write() const override;
+  void write_bytes(
+    const uint8_t* ap_buf, uint32_t a_index, size_type a_offset, size_type a_size
+  ) override;
+  [[nodiscard]] bool supports_burst() const override;
+  void read_pages(uint8_t* ap_buf, uint32_t a_index, uint32_t a_count) override;
+  void write_pages(const uint8_t* ap_buf, uint32_t a_index, uint32_t a_count) override;
+  /// \return errno последней неудачной операции или 0
+  [[nodiscard]] int error() const;
+  /// \brief Кол-во вызовов tick, пришедшихся на выполнение операций
+  [[nodiscard]] uint64_t busy_ticks() const;
+  [[nodiscard]] const page_mem_timing_t& timing() const;
+  /// \brief Меняет профиль времени. Действует со следующей операции
+  void set_timing(const page_mem_timing_t& a_timing);
+
+private:
+  enum class status_t {
+    ready,
+    busy,
+    error
+  };
+  enum class op_t {
+    read,
+    write
+  };
+  struct request_t
+  {
+    op_t op;
+    uint8_t* p_buffer;
+    off_t offset;
+    size_t size;
+    std::chrono::microseconds duration;
+  };
+
+  const std::string m_eeprom_filename;
+  const size_t m_page_count;
+  const size_t m_page_size;
+  const bool m_sync_writes;
+  page_mem_timing_t m_timing;
+
+  int m_fd;
+  std::atomic<status_t> m_status;
+  std::atomic<int> m_error;
+  uint64_t m_busy_ticks;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  request_t m_request;
+  bool m_request_pending;
+  bool m_stop;
+  std::thread m_worker;
+
+  void start_io_operation(
+    op_t a_op,
+    uint8_t* ap_data,
+    uint32_t a_index,
+    size_t a_offset,
+    size_t a_size
+  );
+  /// \brief Моделируемое время операции по профилю m_timing, как в raw_file_page_mem
+  [[nodiscard]] std::chrono::microseconds duration(op_t a_op, size_t a_offset, size_t a_size) const;
+  void worker();
+  /// \return 0 или errno
+  int execute(const request_t& a_request);
+};
+
+#endif // ASYNC_FILE_PAGE_MEM_H
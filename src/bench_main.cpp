@@ -0,0 +1,107 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "page_mem_bench.h"
+#include "page_mem_timing.h"
+#include "power_loss_bench.h"
+#include "safe_map_bench.h"
+#include "sharded_safe_map_bench.h"
+#include "threaded_safe_map_bench.h"
+#include "value_search_bench.h"
+
+/// \details Первый аргумент - имя теста: safe_map (по умолчанию), page_mem, value_search,
+/// threaded, sharded, power_loss, dispatch, layout, partial_write, burst, lazy_format, run_loop,
+/// pipeline, io_error, wear_balance, profile, export или all. Профиль времени эмулятора задается
+/// переменной окружения EEPROM_TIMING, по умолчанию fast. Результаты safe_map выводятся в stdout в
+/// формате CSV
+int main(int argc, char* argv[])
+{
+  const std::string eeprom_path = std::string(EEPROM_FILE);
+  constexpr uint32_t page_size_bytes = 32;
+  const std::string bench_name = argc > 1 ? argv[1] : "safe_map";
+
+  page_mem_timing_t timing = page_mem_timing_t::fast();
+  const char* p_timing_name = std::getenv("EEPROM_TIMING");
+  if (p_timing_name != nullptr && !page_mem_timing_t::by_name(p_timing_name, timing)) {
+    std::cerr << "Ошибка: неизвестный профиль времени " << p_timing_name << std::endl;
+    return 1;
+  }
+
+  const bool all = bench_name == "all";
+  bool known = all;
+  if (all || bench_name == "safe_map") {
+    safe_map_bench(eeprom_path, timing, std::cout);
+    known = true;
+  }
+  if (all || bench_name == "dispatch") {
+    safe_map_dispatch_bench(std::cout);
+    known = true;
+  }
+  if (all || bench_name == "layout") {
+    safe_map_layout_bench(std::cout);
+    known = true;
+  }
+  if (all || bench_name == "partial_write") {
+    safe_map_partial_write_bench(eeprom_path, std::cout);
+    known = true;
+  }
+  if (all || bench_name == "burst") {
+    safe_map_burst_bench(eeprom_path, timing, std::cout);
+    known = true;
+  }
+  if (all || bench_name == "lazy_format") {
+    safe_map_lazy_format_bench(eeprom_path, timing, std::cout);
+    known = true;
+  }
+  if (all || bench_name == "run_loop") {
+    safe_map_run_loop_bench(std::cout);
+    known = true;
+  }
+  if (all || bench_name == "pipeline") {
+    safe_map_pipeline_bench(std::cout);
+    known = true;
+  }
+  if (all || bench_name == "io_error") {
+    safe_map_io_error_bench(eeprom_path, std::cout);
+    known = true;
+  }
+  if (all || bench_name == "wear_balance") {
+    safe_map_wear_balance_bench(std::cout);
+    known = true;
+  }
+  if (all || bench_name == "profile") {
+    safe_map_profile_bench(eeprom_path, timing, std::cout);
+    known = true;
+  }
+  if (all || bench_name == "export") {
+    safe_map_export_bench(eeprom_path, timing, std::cout);
+    known = true;
+  }
+  if (all || bench_name == "page_mem") {
+    page_mem_bench(eeprom_path, page_size_bytes, 64, 4);
+    known = true;
+  }
+  if (all || bench_name == "value_search") {
+    value_search_bench(eeprom_path, page_size_bytes);
+    known = true;
+  }
+  if (all || bench_name == "threaded") {
+    threaded_safe_map_bench(eeprom_path, page_size_bytes, 1024, 16, 2000);
+    known = true;
+  }
+  if (all || bench_name == "sharded") {
+    sharded_safe_map_bench(eeprom_path, timing, std::cout);
+    known = true;
+  }
+  if (all || bench_name == "power_loss") {
+    // Второй аргумент - кол-во случайных точек прерывания на геометрию, по умолчанию все тики
+    power_loss_bench(argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) : 0);
+    known = true;
+  }
+  if (!known) {
+    std::cerr << "Ошибка: неизвестный тест " << bench_name << std::endl;
+    return 1;
+  }
+  return 0;
+}
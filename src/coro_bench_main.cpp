@@ -0,0 +1,10 @@
+#include <iostream>
+
+#include "coro_safe_map_bench.h"
+
+/// \brief Точка входа цели eeprom_coro_bench, которая собирается только компилятором с C++20
+int main()
+{
+  coro_safe_map_bench(std::cout);
+  return 0;
+}
@@ -0,0 +1,516 @@
+#ifndef CORO_SAFE_MAP_H
+#define CORO_SAFE_MAP_H
+
+#if __cplusplus < 202002L || !__has_include(<coroutine>)
+#error "coro_safe_map.h требует C++20 с поддержкой сопрограмм"
+#endif
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <utility>
+#include <vector>
+
+/// \brief Сопрограмма, которую выполняет coro_safe_map_t
+/// \details Создается приостановленной. Задачу верхнего уровня запускает coro_safe_map_t::spawn,
+/// задачу внутри другой задачи - co_await: вызывающая задача продолжится после ее завершения.
+/// Исключения не поддерживаются: необработанное исключение вызывает std::terminate
+class safe_map_task_t
+{
+public:
+  struct promise_type;
+
+  /// \brief Завершение задачи: управление передается задаче, которая ее ожидает
+  struct final_awaiter_t
+  {
+    bool await_ready() noexcept;
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> a_handle) noexcept;
+    void await_resume() noexcept;
+  };
+
+  struct promise_type
+  {
+    std::coroutine_handle<> continuation;
+
+    safe_map_task_t get_return_object();
+    std::suspend_always initial_suspend() noexcept;
+    final_awaiter_t final_suspend() noexcept;
+    void return_void();
+    void unhandled_exception();
+  };
+
+  safe_map_task_t(safe_map_task_t&& a_task) noexcept;
+  safe_map_task_t& operator=(safe_map_task_t&& a_task) noexcept;
+  safe_map_task_t(const safe_map_task_t&) = delete;
+  safe_map_task_t& operator=(const safe_map_task_t&) = delete;
+  ~safe_map_task_t();
+
+  bool await_ready() const noexcept;
+  /// \brief Запускает задачу, a_continuation продолжится после ее завершения
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> a_continuation) noexcept;
+  void await_resume() const noexcept;
+  /// \brief Передает владение сопрограммой вызывающему
+  std::coroutine_handle<> release() noexcept;
+
+private:
+  std::coroutine_handle<promise_type> m_handle;
+
+  explicit safe_map_task_t(std::coroutine_handle<promise_type> a_handle);
+};
+
+/// \brief Однопоточный планировщик сопрограмм над eeprom_safe_map_t
+/// \details get_value, set_value и replace_key возвращают объекты для co_await. Сопрограмма
+/// приостанавливается, пока мапа выполняет ее операцию, и возобновляется из tick после перехода
+/// мапы в состояние ready. Операции нескольких задач выполняются по одной в порядке co_await.
+/// Операция, которая не требует тиков (например, get_value с зеркалом значений), выполняется без
+/// приостановки. Пока есть задачи, мапу нельзя вызывать напрямую
+/// \param Map Тип мапы, например eeprom_safe_map_t<K, V>
+template<class Map>
+class coro_safe_map_t
+{
+public:
+  typedef typename Map::key_type key_type;
+  typedef typename Map::value_type value_type;
+
+  /// \brief Операция мапы, которую ожидает сопрограмма
+  class op_awaiter_t
+  {
+  public:
+    /// \details Операция начинается сразу, если мапа свободна и других операций в очереди нет
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> a_handle);
+
+  protected:
+    explicit op_awaiter_t(coro_safe_map_t& a_owner);
+    ~op_awaiter_t() = default;
+    virtual void start() = 0;
+
+    coro_safe_map_t& m_owner;
+
+  private:
+    friend class coro_safe_map_t;
+
+    std::coroutine_handle<> m_handle;
+    bool m_started;
+  };
+
+  class get_value_awaiter_t final : public op_awaiter_t
+  {
+  public:
+    get_value_awaiter_t(coro_safe_map_t& a_owner, const key_type& a_key, value_type& a_value);
+    /// \return false, если ключа нет
+    bool await_resume() const;
+
+  private:
+    key_type m_key;
+    value_type& m_value;
+    bool m_result;
+
+    void start() override;
+  };
+
+  class set_value_awaiter_t final : public op_awaiter_t
+  {
+  public:
+    set_value_awaiter_t(coro_safe_map_t& a_owner, const key_type& a_key, const value_type& a_value);
+    /// \return false, если закончилось место для ключей
+    bool await_resume() const;
+
+  private:
+    key_type m_key;
+    value_type m_value;
+    bool m_result;
+
+    void start() override;
+  };
+
+  class replace_key_awaiter_t final : public op_awaiter_t
+  {
+  public:
+    replace_key_awaiter_t(
+      coro_safe_map_t& a_owner,
+      const key_type& a_old_key,
+      const key_type& a_new_key,
+      const value_type& a_value
+    );
+    void await_resume() const;
+
+  private:
+    key_type m_old_key;
+    key_type m_new_key;
+    value_type m_value;
+
+    void start() override;
+  };
+
+  explicit coro_safe_map_t(Map& a_map);
+  /// \details Незавершенные задачи уничтожаются без возобновления
+  ~coro_safe_map_t();
+  coro_safe_map_t(const coro_safe_map_t&) = delete;
+  coro_safe_map_t& operator=(const coro_safe_map_t&) = delete;
+
+  /// \brief Добавляет задачу, она начнет выполняться в следующем tick
+  void spawn(safe_map_task_t a_task);
+  /// \brief Чтение значения в a_value, переменная должна существовать до завершения co_await
+  get_value_awaiter_t get_value(const key_type& a_key, value_type& a_value);
+  set_value_awaiter_t set_value(const key_type& a_key, const value_type& a_value);
+  replace_key_awaiter_t replace_key(
+    const key_type& a_old_key, const key_type& a_new_key, const value_type& a_value
+  );
+  /// \brief Один tick мапы, запуск операций из очереди и возобновление готовых сопрограмм
+  void tick();
+  /// \brief Вызывает tick, пока не завершатся все задачи
+  void run();
+  /// \brief Все задачи завершены
+  [[nodiscard]] bool idle() const;
+  [[nodiscard]] size_t get_tasks_count() const;
+  Map& get_map();
+
+private:
+  Map& m_map;
+  std::vector<std::coroutine_handle<>> m_tasks;
+  std::deque<std::coroutine_handle<>> m_ready;
+  std::deque<op_awaiter_t*> m_waiting_ops;
+  op_awaiter_t* mp_current_op;
+
+  /// \brief Запуск операций из очереди, пока мапа свободна
+  void start_waiting_ops();
+  /// \brief Возобновление сопрограмм, готовых к началу tick, и уничтожение завершенных задач
+  void resume_ready();
+};
+
+inline bool safe_map_task_t::final_awaiter_t::await_ready() noexcept
+{
+  return false;
+}
+
+inline std::coroutine_handle<> safe_map_task_t::final_awaiter_t::await_suspend(
+  std::coroutine_handle<promise_type> a_handle
+) noexcept
+{
+  const std::coroutine_handle<> continuation = a_handle.promise().continuation;
+  return continuation ? continuation : std::noop_coroutine();
+}
+
+inline void safe_map_task_t::final_awaiter_t::await_resume() noexcept
+{
+}
+
+inline safe_map_task_t safe_map_task_t::promise_type::get_return_object()
+{
+  return safe_map_task_t(std::coroutine_handle<promise_type>::from_promise(*this));
+}
+
+inline std::suspend_always safe_map_task_t::promise_type::initial_suspend() noexcept
+{
+  return {};
+}
+
+inline safe_map_task_t::final_awaiter_t safe_map_task_t::promise_type::final_suspend() noexcept
+{
+  return {};
+}
+
+inline void safe_map_task_t::promise_type::return_void()
+{
+}
+
+inline void safe_map_task_t::promise_type::unhandled_exception()
+{
+  std::terminate();
+}
+
+inline safe_map_task_t::safe_map_task_t(std::coroutine_handle<promise_type> a_handle) :
+  m_handle(a_handle)
+{
+}
+
+inline safe_map_task_t::safe_map_task_t(safe_map_task_t&& a_task) noexcept :
+  m_handle(std::exchange(a_task.m_handle, nullptr))
+{
+}
+
+inline safe_map_task_t& safe_map_task_t::operator=(safe_map_task_t&& a_task) noexcept
+{
+  if (this != &a_task) {
+    if (m_handle) {
+      m_handle.destroy();
+    }
+    m_handle = std::exchange(a_task.m_handle, nullptr);
+  }
+  return *this;
+}
+
+inline safe_map_task_t::~safe_map_task_t()
+{
+  if (m_handle) {
+    m_handle.destroy();
+  }
+}
+
+inline bool safe_map_task_t::await_ready() const noexcept
+{
+  return !m_handle || m_handle.done();
+}
+
+inline std::coroutine_handle<> safe_map_task_t::await_suspend(
+  std::coroutine_handle<> a_continuation
+) noexcept
+{
+  m_handle.promise().continuation = a_continuation;
+  return m_handle;
+}
+
+inline void safe_map_task_t::await_resume() const noexcept
+{
+}
+
+inline std::coroutine_handle<> safe_map_task_t::release() noexcept
+{
+  return std::exchange(m_handle, nullptr);
+}
+
+template<class Map>
+coro_safe_map_t<Map>::op_awaiter_t::op_awaiter_t(coro_safe_map_t& a_owner) :
+  m_owner(a_owner),
+  m_handle(),
+  m_started(false)
+{
+}
+
+template<class Map>
+bool coro_safe_map_t<Map>::op_awaiter_t::await_ready()
+{
+  if (m_owner.mp_current_op != nullptr || !m_owner.m_waiting_ops.empty() ||
+      !m_owner.m_map.ready()) {
+    return false;
+  }
+  start();
+  m_started = true;
+  return m_owner.m_map.ready();
+}
+
+template<class Map>
+void coro_safe_map_t<Map>::op_awaiter_t::await_suspend(std::coroutine_handle<> a_handle)
+{
+  m_handle = a_handle;
+  if (m_started) {
+    m_owner.mp_current_op = this;
+  } else {
+    m_owner.m_waiting_ops.push_back(this);
+  }
+}
+
+template<class Map>
+coro_safe_map_t<Map>::get_value_awaiter_t::get_value_awaiter_t(
+  coro_safe_map_t& a_owner, const key_type& a_key, value_type& a_value
+) :
+  op_awaiter_t(a_owner),
+  m_key(a_key),
+  m_value(a_value),
+  m_result(false)
+{
+}
+
+template<class Map>
+bool coro_safe_map_t<Map>::get_value_awaiter_t::await_resume() const
+{
+  return m_result;
+}
+
+template<class Map>
+void coro_safe_map_t<Map>::get_value_awaiter_t::start()
+{
+  m_result = this->m_owner.m_map.get_value(m_key, m_value);
+}
+
+template<class Map>
+coro_safe_map_t<Map>::set_value_awaiter_t::set_value_awaiter_t(
+  coro_safe_map_t& a_owner, const key_type& a_key, const value_type& a_value
+) :
+  op_awaiter_t(a_owner),
+  m_key(a_key),
+  m_value(a_value),
+  m_result(false)
+{
+}
+
+template<class Map>
+bool coro_safe_map_t<Map>::set_value_awaiter_t::await_resume() const
+{
+  return m_result;
+}
+
+template<class Map>
+void coro_safe_map_t<Map>::set_value_awaiter_t::start()
+{
+  m_result = this->m_owner.m_map.set_value(m_key, m_value);
+}
+
+template<class Map>
+coro_safe_map_t<Map>::replace_key_awaiter_t::replace_key_awaiter_t(
+  coro_safe_map_t& a_owner,
+  const key_type& a_old_key,
+  const key_type& a_new_key,
+  const value_type& a_value
+) :
+  op_awaiter_t(a_owner),
+  m_old_key(a_old_key),
+  m_new_key(a_new_key),
+  m_value(a_value)
+{
+}
+
+template<class Map>
+void coro_safe_map_t<Map>::replace_key_awaiter_t::await_resume() const
+{
+}
+
+template<class Map>
+void coro_safe_map_t<Map>::replace_key_awaiter_t::start()
+{
+  this->m_owner.m_map.replace_key(m_old_key, m_new_key, m_value);
+}
+
+template<class Map>
+coro_safe_map_t<Map>::coro_safe_map_t(Map& a_map) :
+  m_map(a_map),
+  m_tasks(),
+  m_ready(),
+  m_waiting_ops(),
+  mp_current_op(nullptr)
+{
+}
+
+template<class Map>
+coro_safe_map_t<Map>::~coro_safe_map_t()
+{
+  for (std::coroutine_handle<> task : m_tasks) {
+    task.destroy();
+  }
+}
+
+template<class Map>
+void coro_safe_map_t<Map>::spawn(safe_map_task_t a_task)
+{
+  const std::coroutine_handle<> task = a_task.release();
+  m_tasks.push_back(task);
+  m_ready.push_back(task);
+}
+
+template<class Map>
+typename coro_safe_map_t<Map>::get_value_awaiter_t coro_safe_map_t<Map>::get_value(
+  const key_type& a_key, value_type& a_value
+)
+{
+  return get_value_awaiter_t(*this, a_key, a_value);
+}
+
+template<class Map>
+typename coro_safe_map_t<Map>::set_value_awaiter_t coro_safe_map_t<Map>::set_value(
+  const key_type& a_key, const value_type& a_value
+)
+{
+  return set_value_awaiter_t(*this, a_key, a_value);
+}
+
+template<class Map>
+typename coro_safe_map_t<Map>::replace_key_awaiter_t coro_safe_map_t<Map>::replace_key(
+  const key_type& a_old_key, const key_type& a_new_key, const value_type& a_value
+)
+{
+  return replace_key_awaiter_t(*this, a_old_key, a_new_key, a_value);
+}
+
+template<class Map>
+void coro_safe_map_t<Map>::tick()
+{
+  if (!m_map.ready()) {
+    m_map.tick();
+  }
+  if (m_map.ready()) {
+    if (mp_current_op != nullptr) {
+      m_ready.push_back(mp_current_op->m_handle);
+      mp_current_op = nullptr;
+    }
+    // Следующая операция начинается до возобновления сопрограмм, чтобы мапа не простаивала, пока
+    // они выполняются
+    start_waiting_ops();
+  }
+  resume_ready();
+}
+
+template<class Map>
+void coro_safe_map_t<Map>::run()
+{
+  while (!idle()) {
+    tick();
+  }
+}
+
+template<class Map>
+bool coro_safe_map_t<Map>::idle() const
+{
+  return m_tasks.empty();
+}
+
+template<class Map>
+size_t coro_safe_map_t<Map>::get_tasks_count() const
+{
+  return m_tasks.size();
+}
+
+template<class Map>
+Map& coro_safe_map_t<Map>::get_map()
+{
+  return m_map;
+}
+
+template<class Map>
+void coro_safe_map_t<Map>::start_waiting_ops()
+{
+  while (mp_current_op == nullptr && !m_waiting_ops.empty() && m_map.ready()) {
+    op_awaiter_t* p_op = m_waiting_ops.front();
+    m_waiting_ops.pop_front();
+    p_op->start();
+    p_op->m_started = true;
+    if (m_map.ready()) {
+      m_ready.push_back(p_op->m_handle);
+    } else {
+      mp_current_op = p_op;
+    }
+  }
+}
+
+template<class Map>
+void coro_safe_map_t<Map>::resume_ready()
+{
+  // Сопрограммы, ставшие готовыми во время возобновления, ждут следующего tick
+  const size_t ready_count = m_ready.size();
+  if (ready_count == 0) {
+    return;
+  }
+  for (size_t i = 0; i < ready_count; ++i) {
+    const std::coroutine_handle<> handle = m_ready.front();
+    m_ready.pop_front();
+    handle.resume();
+  }
+  m_tasks.erase(
+    std::remove_if(
+      m_tasks.begin(),
+      m_tasks.end(),
+      [](std::coroutine_handle<> a_task) {
+        if (!a_task.done()) {
+          return false;
+        }
+        a_task.destroy();
+        return true;
+      }
+    ),
+    m_tasks.end()
+  );
+}
+
+#endif // CORO_SAFE_MAP_H
@@ -0,0 +1,159 @@
+#include "coro_safe_map_bench.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include "coro_safe_map.h"
+#include "eeprom_safe_map.h"
+#include "ram_page_mem.h"
+
+namespace {
+
+using bench_key_t = std::array<uint8_t, 8>;
+using bench_map_t = eeprom_safe_map_t<bench_key_t, uint32_t>;
+using bench_coro_map_t = coro_safe_map_t<bench_map_t>;
+
+const uint32_t page_size_bytes = 32;
+const uint32_t pages_count = 64;
+const uint32_t sector_size_pages = 8;
+const uint32_t keys_count = 8;
+const uint32_t ops_count = 100000;
+
+bench_key_t bench_key(uint32_t a_number)
+{
+  bench_key_t key{};
+  key[0] = static_cast<uint8_t>(a_number);
+  return key;
+}
+
+/// \brief Средние на одну операцию вызовы tick и время
+struct op_cost_t
+{
+  double ticks;
+  double ns;
+};
+
+/// \brief Мапа на ram_page_mem с добавленными ключами
+class bench_setup_t
+{
+public:
+  explicit bench_setup_t(bool a_value_mirror) :
+    m_page_mem(pages_count, page_size_bytes, page_size_bytes),
+    m_safe_map(
+      &m_page_mem,
+      0,
+      pages_count,
+      sector_size_pages,
+      bench_key(0),
+      bench_key(0xff),
+      make_config(a_value_mirror)
+    )
+  {
+    m_safe_map.reset();
+    wait();
+    for (uint32_t key = 1; key <= keys_count; ++key) {
+      m_safe_map.set_value(bench_key(key), 0);
+      wait();
+    }
+  }
+
+  bench_map_t& map()
+  {
+    return m_safe_map;
+  }
+
+  void wait()
+  {
+    while (!m_safe_map.ready()) {
+      m_safe_map.tick();
+    }
+  }
+
+private:
+  ram_page_mem m_page_mem;
+  bench_map_t m_safe_map;
+
+  static eeprom_safe_map_config_t make_config(bool a_value_mirror)
+  {
+    eeprom_safe_map_config_t config;
+    config.value_mirror = a_value_mirror;
+    return config;
+  }
+};
+
+/// \brief Операция номер a_op: четные записывают значение, нечетные читают, ключи чередуются
+bench_key_t op_key(uint32_t a_op)
+{
+  return bench_key(1 + a_op % keys_count);
+}
+
+op_cost_t measure_tick_loop(bool a_value_mirror)
+{
+  bench_setup_t setup(a_value_mirror);
+  bench_map_t& safe_map = setup.map();
+  uint64_t ticks = 0;
+  uint32_t value = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < ops_count; ++i) {
+    if (i % 2 == 0) {
+      safe_map.set_value(op_key(i), i);
+    } else {
+      safe_map.get_value(op_key(i), value);
+    }
+    while (!safe_map.ready()) {
+      safe_map.tick();
+      ticks++;
+    }
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return {static_cast<double>(ticks) / ops_count, elapsed.count() / ops_count};
+}
+
+safe_map_task_t bench_task(bench_coro_map_t& a_coro_map, uint32_t a_first_op, uint32_t a_step)
+{
+  uint32_t value = 0;
+  for (uint32_t i = a_first_op; i < ops_count; i += a_step) {
+    if (i % 2 == 0) {
+      co_await a_coro_map.set_value(op_key(i), i);
+    } else {
+      co_await a_coro_map.get_value(op_key(i), value);
+    }
+  }
+}
+
+op_cost_t measure_coro(bool a_value_mirror, uint32_t a_tasks_count)
+{
+  bench_setup_t setup(a_value_mirror);
+  bench_coro_map_t coro_map(setup.map());
+  // Операции делятся между задачами через одну: четность номера операции у задачи не меняется,
+  // поэтому при четном кол-ве задач часть задач только пишет, а часть только читает
+  for (uint32_t task = 0; task < a_tasks_count; ++task) {
+    coro_map.spawn(bench_task(coro_map, task, a_tasks_count));
+  }
+  uint64_t ticks = 0;
+  const auto start = std::chrono::steady_clock::now();
+  while (!coro_map.idle()) {
+    coro_map.tick();
+    ticks++;
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return {static_cast<double>(ticks) / ops_count, elapsed.count() / ops_count};
+}
+
+} // namespace
+
+void coro_safe_map_bench(std::ostream& a_out)
+{
+  a_out << "value_mirror,loop,tasks,ticks_per_op,ns_per_op,overhead_ns_per_op" << std::endl;
+  for (bool value_mirror : {false, true}) {
+    const op_cost_t tick_cost = measure_tick_loop(value_mirror);
+    a_out << value_mirror << ",tick,0," << tick_cost.ticks << "," << tick_cost.ns << ",0"
+          << std::endl;
+    for (uint32_t tasks_count : {1u, 8u}) {
+      const op_cost_t coro_cost = measure_coro(value_mirror, tasks_count);
+      a_out << value_mirror << ",coro," << tasks_count << "," << coro_cost.ticks << ","
+            << coro_cost.ns << "," << coro_cost.ns - tick_cost.ns << std::endl;
+    }
+  }
+}
@@ -0,0 +1,13 @@
+#ifndef CORO_SAFE_MAP_BENCH_H
+#define CORO_SAFE_MAP_BENCH_H
+
+#include <ostream>
+
+/// \brief Затраты coro_safe_map_t на одну ожидаемую операцию по сравнению с циклом tick
+/// \details Одна и та же последовательность set_value и get_value выполняется циклом tick мапы,
+/// одной сопрограммой и восемью сопрограммами, которые делят мапу. Используется ram_page_mem,
+/// чтобы время не зависело от диска. Строки с зеркалом значений показывают затраты планировщика
+/// без ожидания памяти при get_value. Результат выводится в a_out в формате CSV
+void coro_safe_map_bench(std::ostream& a_out);
+
+#endif // CORO_SAFE_MAP_BENCH_H
@@ -0,0 +1,350 @@
+#ifndef EEPROM_LAYOUT_H
+#define EEPROM_LAYOUT_H
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+/// \brief Целочисленные формулы разметки eeprom_safe_map_t
+/// \details vk = values_per_page / keys_per_page - кол-во страниц ключей для хранения ячеек
+/// значений одной страницы. Кол-во секторов данных k = floor(p / (vk + s)), где p - кол-во
+/// свободных страниц, s - размер сектора. Блок информации занимает ceil(k * vk) страниц.
+/// Промежуточные произведения вычисляются в 64 битах
+struct eeprom_layout_math_t
+{
+  static constexpr uint32_t keys_per_page(size_t a_page_size, size_t a_key_size)
+  {
+    return static_cast<uint32_t>(a_page_size / a_key_size);
+  }
+
+  /// \details Каждая ячейка значения занимает значение и a_index_size байт индекса
+  static constexpr uint32_t values_per_page(
+    size_t a_page_size, size_t a_value_size, size_t a_index_size = 1
+  )
+  {
+    return static_cast<uint32_t>(a_page_size / (a_value_size + a_index_size));
+  }
+
+  static constexpr uint32_t data_max_sectors_count(
+    uint64_t a_free_pages,
+    uint64_t a_sector_size_pages,
+    uint64_t a_keys_per_page,
+    uint64_t a_values_per_page
+  )
+  {
+    return static_cast<uint32_t>(
+      a_free_pages * a_keys_per_page / (a_values_per_page + a_sector_size_pages * a_keys_per_page)
+    );
+  }
+
+  static constexpr uint32_t info_sector_size_pages(
+    uint64_t a_sectors_count, uint64_t a_keys_per_page, uint64_t a_values_per_page
+  )
+  {
+    return static_cast<uint32_t>(
+      (a_sectors_count * a_values_per_page + a_keys_per_page - 1) / a_keys_per_page
+    );
+  }
+
+  /// \return Кол-во ключей или 0, если оно не помещается в 32 бита
+  static constexpr uint32_t max_keys_count(uint64_t a_sectors_count, uint64_t a_values_per_page)
+  {
+    return a_sectors_count * a_values_per_page <= std::numeric_limits<uint32_t>::max()
+             ? static_cast<uint32_t>(a_sectors_count * a_values_per_page)
+             : 0;
+  }
+
+  /// \brief Кол-во страниц блока информации и всех секторов данных
+  /// \details Вычисляется в 64 битах: произведение кол-ва секторов на размер сектора может не
+  /// поместиться в 32 бита. Номера страниц страничной памяти 32-битные, поэтому разметка, у которой
+  /// результат больше std::numeric_limits<uint32_t>::max(), отклоняется
+  static constexpr uint64_t used_pages_count(
+    uint64_t a_sectors_count, uint64_t a_sector_size_pages, uint64_t a_info_sector_size_pages
+  )
+  {
+    return a_info_sector_size_pages + a_sectors_count * a_sector_size_pages;
+  }
+
+  /// \brief Максимальный размер сектора для индекса значения типа ValueIndex
+  /// \details Индексы принимают на одно значение больше, чем страниц в секторе, а максимальное
+  /// значение типа означает пустую ячейку. 2-байтовый индекс меньше 0xff00, чтобы индекс с
+  /// записанным младшим байтом и стертым старшим не совпал с индексом записанной ячейки
+  template<class ValueIndex>
+  static constexpr uint32_t max_sector_size_pages()
+  {
+    return sizeof(ValueIndex) == 1 ? std::numeric_limits<ValueIndex>::max() - 1 : 0xfeff;
+  }
+
+  /// \brief Кол-во секторов данных, вычисленное во float, как в первых версиях мапы
+  /// \details В редких геометриях результат на единицу отличается от целочисленного из-за
+  /// округления vk
+  static constexpr uint32_t float_data_max_sectors_count(
+    uint32_t a_free_pages,
+    uint32_t a_sector_size_pages,
+    uint32_t a_keys_per_page,
+    uint32_t a_values_per_page
+  )
+  {
+    return static_cast<uint32_t>(
+      static_cast<float>(a_free_pages) /
+      (static_cast<float>(a_values_per_page) / static_cast<float>(a_keys_per_page) +
+       static_cast<float>(a_sector_size_pages))
+    );
+  }
+
+  static constexpr uint32_t float_info_sector_size_pages(
+    uint32_t a_sectors_count, uint32_t a_keys_per_page, uint32_t a_values_per_page
+  )
+  {
+    const float pages = static_cast<float>(a_sectors_count) *
+                        (static_cast<float>(a_values_per_page) /
+                         static_cast<float>(a_keys_per_page));
+    const uint32_t whole_pages = static_cast<uint32_t>(pages);
+    return static_cast<float>(whole_pages) < pages ? whole_pages + 1 : whole_pages;
+  }
+};
+
+/// \brief Разметка eeprom_safe_map_t, вычисляемая при создании мапы
+/// \details С 1-байтовым индексом кол-во секторов и размер блока информации вычисляются во float,
+/// как и в первых версиях мапы, чтобы не сломать совместимость с уже записанными образами. С
+/// 2-байтовым индексом старых образов нет, и разметка вычисляется целочисленными формулами
+/// \param ValueIndex Тип индекса значения: uint8_t (сектор до 254 страниц) или uint16_t (до 65279)
+template<class K, class V, class ValueIndex = uint8_t>
+class dynamic_layout_t
+{
+public:
+  typedef std::vector<uint8_t> page_buffer_t;
+  typedef ValueIndex value_index_t;
+
+  static_assert(
+    std::is_same<ValueIndex, uint8_t>::value || std::is_same<ValueIndex, uint16_t>::value,
+    "Индекс значения должен быть uint8_t или uint16_t"
+  );
+
+  dynamic_layout_t(size_t a_page_size, size_t a_free_pages, uint32_t a_data_sector_size_pages) :
+    m_page_size(static_cast<uint32_t>(a_page_size)),
+    m_data_sector_size_pages(a_data_sector_size_pages),
+    m_keys_per_page(eeprom_layout_math_t::keys_per_page(a_page_size, sizeof(K))),
+    m_values_per_page(
+      eeprom_layout_math_t::values_per_page(a_page_size, sizeof(V), sizeof(ValueIndex))
+    ),
+    m_data_max_sectors_count(data_max_sectors_count(
+      a_free_pages, m_data_sector_size_pages, m_keys_per_page, m_values_per_page
+    )),
+    m_info_sector_size_pages(info_sector_size_pages(
+      m_data_max_sectors_count, m_keys_per_page, m_values_per_page
+    ))
+  {
+    assert(fits(a_page_size, a_free_pages, a_data_sector_size_pages));
+  }
+
+  /// \brief Разметка с такими параметрами допустима
+  /// \details Те же проверки, что и в конструкторе, но без assert, поэтому подходит для перебора
+  /// геометрий
+  static bool fits(size_t a_page_size, size_t a_free_pages, uint32_t a_data_sector_size_pages)
+  {
+    const uint32_t keys_per_page = eeprom_layout_math_t::keys_per_page(a_page_size, sizeof(K));
+    const uint32_t values_per_page =
+      eeprom_layout_math_t::values_per_page(a_page_size, sizeof(V), sizeof(ValueIndex));
+    // Кол-во секторов и размер блока информации вычисляются в 32 битах
+    if (keys_per_page == 0 || values_per_page == 0 ||
+        a_data_sector_size_pages > eeprom_layout_math_t::max_sector_size_pages<ValueIndex>() ||
+        a_free_pages > std::numeric_limits<uint32_t>::max()) {
+      return false;
+    }
+    const uint32_t sectors_count = data_max_sectors_count(
+      a_free_pages, a_data_sector_size_pages, keys_per_page, values_per_page
+    );
+    return sectors_count > 0 &&
+           eeprom_layout_math_t::max_keys_count(sectors_count, values_per_page) > 0 &&
+           eeprom_layout_math_t::used_pages_count(
+             sectors_count,
+             a_data_sector_size_pages,
+             info_sector_size_pages(sectors_count, keys_per_page, values_per_page)
+           ) <= a_free_pages;
+  }
+
+  uint32_t page_size() const
+  {
+    return m_page_size;
+  }
+  uint32_t data_sector_size_pages() const
+  {
+    return m_data_sector_size_pages;
+  }
+  uint32_t keys_per_page() const
+  {
+    return m_keys_per_page;
+  }
+  uint32_t values_per_page() const
+  {
+    return m_values_per_page;
+  }
+  uint32_t data_max_sectors_count() const
+  {
+    return m_data_max_sectors_count;
+  }
+  uint32_t info_sector_size_pages() const
+  {
+    return m_info_sector_size_pages;
+  }
+  uint32_t max_keys_count() const
+  {
+    return eeprom_layout_math_t::max_keys_count(m_data_max_sectors_count, m_values_per_page);
+  }
+  page_buffer_t make_page_buffer() const
+  {
+    return page_buffer_t(m_page_size);
+  }
+
+private:
+  static uint32_t data_max_sectors_count(
+    uint64_t a_free_pages,
+    uint32_t a_sector_size_pages,
+    uint32_t a_keys_per_page,
+    uint32_t a_values_per_page
+  )
+  {
+    if (sizeof(ValueIndex) == 1) {
+      return eeprom_layout_math_t::float_data_max_sectors_count(
+        static_cast<uint32_t>(a_free_pages), a_sector_size_pages, a_keys_per_page, a_values_per_page
+      );
+    }
+    return eeprom_layout_math_t::data_max_sectors_count(
+      a_free_pages, a_sector_size_pages, a_keys_per_page, a_values_per_page
+    );
+  }
+  static uint32_t info_sector_size_pages(
+    uint32_t a_sectors_count, uint32_t a_keys_per_page, uint32_t a_values_per_page
+  )
+  {
+    if (sizeof(ValueIndex) == 1) {
+      return eeprom_layout_math_t::float_info_sector_size_pages(
+        a_sectors_count, a_keys_per_page, a_values_per_page
+      );
+    }
+    return eeprom_layout_math_t::info_sector_size_pages(
+      a_sectors_count, a_keys_per_page, a_values_per_page
+    );
+  }
+
+  uint32_t m_page_size;
+  uint32_t m_data_sector_size_pages;
+  uint32_t m_keys_per_page;
+  uint32_t m_values_per_page;
+  uint32_t m_data_max_sectors_count;
+  uint32_t m_info_sector_size_pages;
+};
+
+/// \brief Разметка eeprom_safe_map_t, вычисляемая при компиляции
+/// \details Все размеры - константы, поэтому смещения ячеек в странице вычисляются без умножений
+/// на переменные, а буфер страницы хранится внутри мапы без выделения памяти в куче. Геометрии,
+/// в которых dynamic_layout_t из-за округления float получил бы другую разметку, отвергаются при
+/// компиляции, поэтому образы обоих вариантов совместимы
+/// \param PageSize Размер страницы в байтах
+/// \param FreePages Кол-во страниц, отведенных под мапу
+/// \param SectorSizePages Размер сектора данных в страницах
+/// \param ValueIndex Тип индекса значения, как в dynamic_layout_t
+template<
+  class K,
+  class V,
+  uint32_t PageSize,
+  uint32_t FreePages,
+  uint32_t SectorSizePages,
+  class ValueIndex = uint8_t>
+class static_layout_t
+{
+public:
+  typedef std::array<uint8_t, PageSize> page_buffer_t;
+  typedef ValueIndex value_index_t;
+
+  static constexpr uint32_t page_size()
+  {
+    return PageSize;
+  }
+  static constexpr uint32_t data_sector_size_pages()
+  {
+    return SectorSizePages;
+  }
+  static constexpr uint32_t keys_per_page()
+  {
+    return m_keys_per_page;
+  }
+  static constexpr uint32_t values_per_page()
+  {
+    return m_values_per_page;
+  }
+  static constexpr uint32_t data_max_sectors_count()
+  {
+    return m_data_max_sectors_count;
+  }
+  static constexpr uint32_t info_sector_size_pages()
+  {
+    return m_info_sector_size_pages;
+  }
+  static constexpr uint32_t max_keys_count()
+  {
+    return eeprom_layout_math_t::max_keys_count(m_data_max_sectors_count, m_values_per_page);
+  }
+  static constexpr page_buffer_t make_page_buffer()
+  {
+    return page_buffer_t{};
+  }
+
+private:
+  static constexpr uint32_t m_keys_per_page =
+    eeprom_layout_math_t::keys_per_page(PageSize, sizeof(K));
+  static constexpr uint32_t m_values_per_page =
+    eeprom_layout_math_t::values_per_page(PageSize, sizeof(V), sizeof(ValueIndex));
+
+  static_assert(
+    std::is_same<ValueIndex, uint8_t>::value || std::is_same<ValueIndex, uint16_t>::value,
+    "Индекс значения должен быть uint8_t или uint16_t"
+  );
+  static_assert(
+    SectorSizePages <= eeprom_layout_math_t::max_sector_size_pages<ValueIndex>(),
+    "Размер сектора не помещается в индекс значения"
+  );
+  static_assert(m_keys_per_page > 0, "Ключ не помещается в страницу");
+  static_assert(m_values_per_page > 0, "Значение с индексом не помещается в страницу");
+
+  static constexpr uint32_t m_data_max_sectors_count =
+    eeprom_layout_math_t::data_max_sectors_count(
+      FreePages, SectorSizePages, m_keys_per_page, m_values_per_page
+    );
+  static constexpr uint32_t m_info_sector_size_pages =
+    eeprom_layout_math_t::info_sector_size_pages(
+      m_data_max_sectors_count, m_keys_per_page, m_values_per_page
+    );
+
+  static_assert(m_data_max_sectors_count > 0, "Не хватает страниц на один сектор данных");
+  static_assert(
+    eeprom_layout_math_t::max_keys_count(m_data_max_sectors_count, m_values_per_page) > 0,
+    "Кол-во ключей не помещается в 32 бита"
+  );
+  static_assert(
+    eeprom_layout_math_t::used_pages_count(
+      m_data_max_sectors_count, SectorSizePages, m_info_sector_size_pages
+    ) <= FreePages,
+    "Разметка не помещается в отведенные страницы"
+  );
+  // Для 2-байтового индекса dynamic_layout_t тоже использует целочисленные формулы
+  static_assert(
+    sizeof(ValueIndex) > 1 ||
+      (m_data_max_sectors_count ==
+         eeprom_layout_math_t::float_data_max_sectors_count(
+           FreePages, SectorSizePages, m_keys_per_page, m_values_per_page
+         ) &&
+       m_info_sector_size_pages ==
+         eeprom_layout_math_t::float_info_sector_size_pages(
+           m_data_max_sectors_count, m_keys_per_page, m_values_per_page
+         )),
+    "Геометрия несовместима с dynamic_layout_t из-за округления, измените кол-во страниц"
+  );
+};
+
+#endif // EEPROM_LAYOUT_H
@@ -3,53 +3,227 @@
 
 #include <algorithm>
 #include <cassert>
-#include <cmath>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
 #include <vector>
 
+#include "eeprom_layout.h"
+#include "key_index.h"
 #include "raw_file_page_mem.h"
+#ifdef EEPROM_SAFE_MAP_PROFILE
+#include "safe_map_profiler.h"
+#endif
 
 #define IRS_ASSERT(pred) assert((pred))
 
+/// \brief Способ поиска актуального значения ключа в секторе данных
+enum class value_search_t {
+  /// \brief Последовательное чтение страниц сектора с первой до разрыва индексов
+  linear,
+  /// \brief Двоичный поиск разрыва индексов, O(log n) чтений страниц
+  binary
+};
+
+/// \brief Необязательные параметры eeprom_safe_map_t
+struct eeprom_safe_map_config_t
+{
+  /// \brief Хранить в ОЗУ текущие значения всех ключей и их позиции в секторах
+  /// \details Зеркало заполняется при монтировании одним последовательным проходом по каждому
+  /// сектору данных. После этого get_value выполняется без обращения к eeprom, а set_value пишет
+  /// сразу в следующую страницу сектора без поиска актуального значения. Расход памяти на ключ
+  /// возвращает eeprom_safe_map_t::value_mirror_bytes_per_key
+  bool value_mirror = false;
+  /// \brief Способ поиска актуального значения при смене ключа
+  value_search_t value_search = value_search_t::linear;
+  /// \brief Записывать только ячейку значения и байт индекса, если страничная память умеет
+  /// записывать часть страницы (supports_partial_write). Страница перед записью не читается, но
+  /// записей две: у eeprom с циклом записи страницы это дольше и изнашивает страницу вдвое
+  /// сильнее, чем чтение и запись целой страницы. Выгодно для памяти без цикла записи
+  bool partial_write = false;
+  /// \brief Читать и записывать несколько страниц одной операцией, если страничная память это
+  /// умеет (supports_burst). Используется при монтировании и разметке нового сектора данных
+  bool burst = true;
+  /// \brief Не размечать страницы нового сектора данных, в которых все байты индексов уже равны
+  /// 0xff. Страница, состояние которой неизвестно, перед разметкой проверяется чтением
+  bool lazy_format = true;
+  /// \brief При последовательном поиске актуального значения читать следующую страницу сектора,
+  /// пока разбирается текущая, если страничная память принимает несколько операций подряд
+  /// (queue_depth больше 1). Требует второй буфер страницы в куче
+  bool pipeline = true;
+  /// \brief Считать записи значений каждого ключа для rebalance. Счетчики хранятся в ОЗУ, по 4
+  /// байта на ключ, и начинаются с нуля при монтировании
+  bool wear_balance = false;
+  /// \brief rebalance переносит ключ, если в самый нагруженный сектор записано больше значений,
+  /// чем wear_imbalance_ratio средних по секторам
+  float wear_imbalance_ratio = 1.5f;
+};
+
 /// \brief Класс для записи значений в eeprom
 /// \details Записывает значения в eeprom с экономией ресурса памяти
 /// \details Для корректной работы при первом использовании вызвать функцию reset
 /// \param K - тип данных для ключа
 /// \param V - тип данных для значения
-template<class K, class V>
+/// \param KeyIndex - индекс для поиска позиции ключа (linear_key_index_t или hash_key_index_t)
+/// \param PageMem - тип страничной памяти. По умолчанию вызовы идут через виртуальный интерфейс
+/// irs::page_mem_t. Если указать конкретный класс памяти, например raw_file_page_mem, то tick и
+/// status вызываются напрямую и могут быть встроены компилятором. Класс должен иметь методы
+/// read_page, write_page, page_size, page_count, status и tick с сигнатурами irs::page_mem_t.
+/// Память не должна использоваться никем, кроме мапы: при упреждающем чтении завершение
+/// операций мапы определяется по pending_ops
+/// \param Layout - разметка eeprom: dynamic_layout_t вычисляется при создании мапы,
+/// static_layout_t - при компиляции. Разметка задает и ширину индекса значения (1 или 2 байта)
+template<
+  class K,
+  class V,
+  class KeyIndex = linear_key_index_t<K>,
+  class PageMem = irs::page_mem_t,
+  class Layout = dynamic_layout_t<K, V>>
 class eeprom_safe_map_t
 {
 public:
+  typedef K key_type;
+  typedef V value_type;
+
+  struct op_page_stats_t
+  {
+    uint32_t page_reads;
+    uint32_t page_writes;
+  };
+
+  /// \brief Результат run_for и run_until_ready
+  struct run_result_t
+  {
+    /// \brief Кол-во выполненных переходов автомата мапы
+    uint32_t steps;
+    /// \brief Кол-во вызовов tick страничной памяти, пока она была занята
+    uint32_t page_mem_ticks;
+    /// \brief Мапа перешла в состояние ready
+    bool ready;
+  };
+
   /// \param a_page_offset Страница, с которой начинать запись в eeprom
   /// \param a_free_pages Кол-во свободных страниц
   /// \param a_data_sect_size_pages Размер сектора данных в страницах
   /// \param a_default_key Ключ, который будет использоваться по умолчанию.
   /// \param a_terminator_key Ключ, который будет терминатором списка ключей.
+  /// \param a_config Необязательные параметры
   explicit eeprom_safe_map_t(
-    irs::page_mem_t* ap_page,
+    PageMem* ap_page,
     uint32_t a_page_offset,
     size_t a_free_pages,
     uint32_t a_data_sect_size_pages,
     const K& a_default_key,
-    const K& a_terminator_key
+    const K& a_terminator_key,
+    const eeprom_safe_map_config_t& a_config = eeprom_safe_map_config_t()
+  );
+  /// \brief Конструктор для разметки static_layout_t, размеры которой заданы при компиляции
+  explicit eeprom_safe_map_t(
+    PageMem* ap_page,
+    uint32_t a_page_offset,
+    const K& a_default_key,
+    const K& a_terminator_key,
+    const eeprom_safe_map_config_t& a_config = eeprom_safe_map_config_t()
   );
 
   /// \brief Установить значения для выбранного ключа
   /// \details Если сектора с таким ключом нет, то такой сектор будет создан
   /// \param a_key Искомый ключ
-  /// \return Если возвращается false, то закончилось место для ключей
+  /// \return Если возвращается false, то закончилось место для ключей или страничная память в
+  /// состоянии ошибки (status)
   bool set_value(const K& a_key, const V& a_value);
+  /// \brief Установить значения нескольких ключей
+  /// \details Сначала находятся позиции следующей записи всех ключей (новые ключи добавляются),
+  /// затем обновления группируются по страницам секторов: ячейки ключей, следующая запись которых
+  /// попадает в одну страницу, записываются одной записью этой страницы. Порядок индексов каждого
+  /// ключа сохраняется. Если ключ встречается несколько раз, то записывается последнее значение
+  /// \param a_first, a_last Диапазон пар {ключ, значение}, например std::pair<K, V>
+  /// \return Если возвращается false, то для новых ключей не хватает места или страничная память в
+  /// состоянии ошибки, и ничего не записано
+  template<class InputIt>
+  bool set_values(InputIt a_first, InputIt a_last);
+  /// \details Если включено зеркало значений, то значение записывается в a_value сразу и мапа
+  /// остается в состоянии ready
   bool get_value(const K& a_key, V& a_value);
+  /// \brief Вызывает a_handler(ключ, значение) для всех ключей мапы
+  /// \details Каждый сектор данных читается один раз: актуальные значения всех его ключей
+  /// находятся за один последовательный проход, как при построении зеркала значений. Ключи
+  /// перечисляются по секторам: сначала ключи сектора 0 в порядке добавления, затем сектора 1 и
+  /// т. д. При включенном зеркале значения берутся из него без обращения к eeprom. Выполняется
+  /// синхронно, вызывать в состоянии ready
+  template<class Handler>
+  void for_each_value(Handler a_handler);
   /// \brief Заменяет ключ a_old_key на a_new_key с новым значением a_value
   /// \details Если замена идет на уже существующий ключ, то эта функция аналогична функции
   /// set_value
   void replace_key(const K& a_old_key, const K& a_new_key, V& a_value);
+  /// \brief Меняет местами самый часто записываемый ключ самого нагруженного сектора и редко
+  /// записываемый ключ другого сектора
+  /// \details Сектор ключа определяется его позицией в списке ключей, поэтому часто записываемый
+  /// ключ изнашивает страницы сектора вместе со всеми ключами, которые делят с ним сектор. Обмен
+  /// выбирается по счетчикам записей (config.wear_balance) так, чтобы максимум записей на сектор
+  /// уменьшился. Значения обоих ключей переписываются в ячейки их новых позиций. Обмен проходит
+  /// через две свободные позиции в конце списка ключей и устойчив к пропаданию питания:
+  /// прерванный обмен отменяется или завершается при следующем монтировании. Пары ключей, для
+  /// которых прерванная запись ключа совпала бы с другим ключом списка, не обмениваются. Вызывать в
+  /// состоянии ready
+  /// \return false, если нагрузка на секторы не превышает config.wear_imbalance_ratio средней,
+  /// нет выгодного обмена, счетчики выключены или в списке ключей нет трех свободных позиций
+  bool rebalance();
   void tick();
+  /// \brief Выполняет переходы автомата подряд, пока мапа не перейдет в состояние ready
+  /// \details Переходы, которые не ждут страничную память, выполняются без вызова ее tick. Пока
+  /// память занята, вызывается ее tick. Выполнение прерывается, когда сделано a_max_page_mem_ticks
+  /// вызовов tick памяти или наступил a_deadline. Время проверяется после каждого перехода и
+  /// вызова tick, поэтому вызов с истекшим сроком все равно продвигает операцию на один шаг
+  run_result_t run_for(
+    uint32_t a_max_page_mem_ticks,
+    std::chrono::steady_clock::time_point a_deadline = std::chrono::steady_clock::time_point::max()
+  );
+  /// \brief run_for без ограничений
+  run_result_t run_until_ready();
   void add_key();
+  /// \brief Операция завершена
+  /// \details После ошибки страничной памяти тоже возвращает true, чтобы циклы ожидания
+  /// завершались. Успех операции нужно проверять через status
   bool ready();
+  /// \brief irs_st_ready, irs_st_busy или irs_st_error, если страничная память перешла в состояние
+  /// ошибки
+  /// \details Ошибка не сбрасывается: операции возвращают false и не обращаются к памяти, reset
+  /// ничего не делает. Для повторной попытки мапу нужно создать заново
+  [[nodiscard]] irs_status_t status() const;
   void reset();
   [[nodiscard]] uint32_t get_data_sectors_count() const;
   [[nodiscard]] uint32_t get_keys_count() const;
+  [[nodiscard]] uint32_t get_max_keys_count() const;
   [[nodiscard]] K get_key(uint32_t a_index) const;
+  [[nodiscard]] bool has_key(const K& a_key) const;
+  /// \brief Кол-во записей значения ключа с момента монтирования
+  /// \details Считается, только если включен config.wear_balance, иначе возвращается 0
+  [[nodiscard]] uint32_t get_key_writes(const K& a_key) const;
+  /// \brief Значение ключа, известное без обращения к eeprom
+  /// \details Известно значение текущего ключа, а при включенном зеркале - значения всех ключей.
+  /// Вызывать в состоянии ready
+  /// \return false, если значение неизвестно
+  bool get_cached_value(const K& a_key, V& a_value) const;
+  /// \brief Кол-во записей страниц, сэкономленных последним вызовом set_values по сравнению с
+  /// последовательными вызовами set_value
+  [[nodiscard]] uint32_t get_batch_saved_page_writes() const;
+  /// \brief Кол-во чтений и записей страниц, выполненных последней операцией
+  /// \details Операцией считается вызов set_value, set_values, get_value, replace_key,
+  /// for_each_value, rebalance или reset
+  /// вместе со всеми тиками до перехода в состояние ready. До первой операции возвращаются счетчики
+  /// монтирования, выполненного конструктором. Если операция еще не завершена, то возвращаются
+  /// счетчики на текущий момент
+  [[nodiscard]] op_page_stats_t get_op_page_stats() const;
+  /// \brief Кол-во байт ОЗУ на один ключ, которое занимает зеркало значений
+  static constexpr size_t value_mirror_bytes_per_key();
+#ifdef EEPROM_SAFE_MAP_PROFILE
+  /// \brief Время и кол-во тиков по состояниям автомата и гистограммы времени операций
+  [[nodiscard]] const safe_map_profiler_t& get_profiler() const;
+  safe_map_profiler_t& get_profiler();
+#endif
 
 private:
   enum class status_t {
@@ -58,14 +232,26 @@ private:
     add_key,
     add_ended,
     find_current_value,
+    find_current_value_binary_first,
+    find_current_value_binary,
     replace_key,
     replace_value,
     write_value,
-    wait_page_mem
+    batch_write_page,
+    batch_next_page,
+    migrate_key,
+    migrate_key_page,
+    migrate_next,
+    wait_page_mem,
+    error
   };
   enum class add_status_t {
     update_info,
     add_data_sector,
+    verify_erased,
+    check_value_cell,
+    clear_value_cell,
+    clear_next_page,
     add_key_prep,
     add_key,
     add_terminator_key
@@ -74,23 +260,77 @@ private:
     none,
     read_value,
     write_value,
-    replace_key
+    replace_key,
+    batch_locate,
+    migrate_read,
+    migrate_write
   };
   enum class page_mem_op_t {
     read,
     write,
-    end_op
+    write_value_cell,
+    write_index_byte,
+    read_pages,
+    write_pages,
+    end_op,
+    take_prefetch,
+    drop_prefetch
+  };
+  enum class prefetch_status_t {
+    none,
+    wanted,
+    issued
+  };
+
+  typedef typename Layout::value_index_t value_index_t;
+
+  /// \brief Текущее значение ключа и позиция, в которую будет записано следующее значение
+  struct value_mirror_entry_t
+  {
+    V value;
+    uint32_t sector_page;
+    value_index_t value_index;
+  };
+
+  /// \brief Обновление ключа в set_values и позиция его следующей записи
+  struct batch_item_t
+  {
+    K key;
+    V value;
+    uint32_t key_index;
+    uint32_t sector;
+    uint32_t sector_page;
+    uint32_t value_cell;
+    value_index_t value_index;
+  };
+
+  /// \brief Шаг переноса ключей
+  struct migration_step_t
+  {
+    enum class op_t {
+      /// \brief Запись значения позиции src в ячейку позиции dst, затем ключа src на позицию dst.
+      /// Если dst - следующая за последней позиция, то ключ добавляется в конец списка вместе с
+      /// ключами, записанными ранее за ним. Ключ дальше за концом списка в список не входит
+      copy,
+      /// \brief Запись ключа-терминатора на позицию dst. Позиции от dst удаляются из списка
+      terminate
+    };
+    op_t op;
+    uint32_t src;
+    uint32_t dst;
   };
 
   static const uint32_t m_bytes_per_key = sizeof(K);
   static const uint32_t m_bytes_per_value = sizeof(V);
-  static const uint32_t m_bytes_per_value_index = 1;
+  static const uint32_t m_bytes_per_value_index = sizeof(value_index_t);
   const uint8_t m_data_sector_default_value_byte = 0xff;
+  // Индекс пустой ячейки: все байты индекса равны m_data_sector_default_value_byte
+  static constexpr value_index_t m_empty_value_index = std::numeric_limits<value_index_t>::max();
 
-  irs::page_mem_t* mp_page;
-  uint32_t m_data_sector_size_pages;
-  uint32_t m_page_size;
-  std::vector<uint8_t> m_page_buffer;
+  PageMem* mp_page;
+  Layout m_layout;
+  // Ключи и значения читаются из буфера по указателю, поэтому буфер внутри объекта выравнивается
+  alignas(std::max(alignof(K), alignof(V))) typename Layout::page_buffer_t m_page_buffer;
   const K m_terminator_key;
   K m_current_key;
   K m_new_key;
@@ -98,7 +338,7 @@ private:
   V m_new_value;
   uint32_t m_current_sector;
   uint32_t m_current_sector_page;
-  uint8_t m_current_value_index;
+  value_index_t m_current_value_index;
   uint32_t m_current_value_cell;
   status_t m_status;
   status_t m_next_status;
@@ -106,17 +346,84 @@ private:
   add_status_t m_next_add_status;
   action_t m_action_status;
   uint32_t m_keys_count;
-  uint32_t m_max_keys_count;
-  uint32_t m_values_per_page;
-  uint32_t m_keys_per_page;
-  uint32_t m_info_sector_size_pages;
-  uint32_t m_data_max_sectors_count;
   std::vector<K> m_keys;
+  KeyIndex m_key_index;
   uint32_t m_current_key_index;
   V* mp_buf_to_save_value;
   page_mem_op_t m_page_mem_op;
   uint32_t m_page_mem_page_index;
+  uint32_t m_page_mem_value_cell;
+  uint32_t m_page_mem_pages_count;
   uint32_t m_page_offset;
+  bool m_value_mirror_enabled;
+  bool m_partial_write;
+  // Буфер размером в сектор данных для пакетных операций. Пуст, если память их не поддерживает
+  std::vector<uint8_t> m_burst_buffer;
+  bool m_lazy_format;
+  // Известное состояние страниц данных: m_known_pages - состояние известно, m_erased_pages -
+  // страница стерта. Ведется только при m_lazy_format, индекс - номер страницы от начала данных
+  std::vector<bool> m_known_pages;
+  std::vector<bool> m_erased_pages;
+  std::vector<value_mirror_entry_t> m_value_mirror;
+  value_search_t m_value_search;
+  // Состояние двоичного поиска: границы диапазона страниц, читаемая страница, последняя страница
+  // непрерывной последовательности индексов и индекс первой страницы сектора
+  uint32_t m_search_low;
+  uint32_t m_search_high;
+  uint32_t m_search_page;
+  uint32_t m_search_found_page;
+  value_index_t m_search_first_index;
+  std::vector<batch_item_t> m_batch;
+  uint32_t m_batch_position;
+  uint32_t m_batch_saved_page_writes;
+  op_page_stats_t m_op_page_stats;
+  // Упреждающее чтение страницы сектора при последовательном поиске значения. Буфер пуст, если
+  // упреждение отключено или память не принимает несколько операций подряд
+  std::vector<uint8_t> m_prefetch_buffer;
+  prefetch_status_t m_prefetch_status;
+  uint32_t m_prefetch_page;
+  uint32_t m_prefetch_ticket;
+  // Номера операций памяти: операции номеруются в порядке начала и завершаются в том же порядке,
+  // поэтому операция t завершена, если незавершенных операций меньше m_page_mem_issued - t
+  uint32_t m_page_mem_issued;
+  uint32_t m_page_mem_ticket;
+  uint32_t m_page_mem_queue_depth;
+  bool m_wear_balance_enabled;
+  // Кол-во записей значений по позициям ключей. Пуст, если wear_balance выключен
+  std::vector<uint32_t> m_key_writes;
+  float m_wear_imbalance_ratio;
+  // Шаги переноса ключей rebalance или восстановления прерванного переноса при монтировании
+  std::vector<migration_step_t> m_migration;
+  uint32_t m_migration_position;
+  V m_migration_value;
+#ifdef EEPROM_SAFE_MAP_PROFILE
+  /// \brief Состояние автомата и время в начале профилируемого tick или шага run_for
+  struct profile_point_t
+  {
+    status_t status;
+    add_status_t add_status;
+    safe_map_profiler_t::clock_type::time_point time;
+  };
+
+  safe_map_profiler_t m_profiler = make_profiler();
+
+  static safe_map_profiler_t make_profiler();
+  profile_point_t profile_begin() const;
+  /// \brief Учет времени от a_point в состоянии a_point.status и завершение операции, если мапа
+  /// перешла в состояние ready
+  void profile_end(const profile_point_t& a_point, uint32_t a_steps, uint32_t a_page_mem_ticks);
+  /// \brief Начало операции профиля. Операция, которая не требует тиков, сразу завершается
+  void profile_begin_op(safe_map_profiler_t::op_t a_op);
+#endif
+
+  eeprom_safe_map_t(
+    PageMem* ap_page,
+    const Layout& a_layout,
+    uint32_t a_page_offset,
+    const K& a_default_key,
+    const K& a_terminator_key,
+    const eeprom_safe_map_config_t& a_config
+  );
 
   /// \details Ассинхронно читает и пишет в номера страниц, относительно стартовой страницы,
   /// используя внутренний буффер
@@ -130,39 +437,200 @@ private:
     status_t a_next_status,
     add_status_t a_next_add_status = add_status_t::update_info
   );
+  /// \brief Чтение a_count страниц в m_burst_buffer одной операцией
+  void read_pages(
+    uint32_t a_page_index,
+    uint32_t a_count,
+    status_t a_next_status,
+    add_status_t a_next_add_status
+  );
+  /// \brief Запись a_count страниц из m_burst_buffer одной операцией
+  void write_pages(
+    uint32_t a_page_index,
+    uint32_t a_count,
+    status_t a_next_status,
+    add_status_t a_next_add_status
+  );
+  /// \brief Запись ячейки значения, затем байта индекса страницы частичной записью
+  void write_value_cell(uint32_t a_page_index, uint32_t a_value_cell, status_t a_next_status);
+  /// \brief Чтение страницы сектора m_current_sector для состояния find_current_value
+  /// \details Если страница уже прочитана заранее, то она берется из m_prefetch_buffer. Иначе
+  /// вместе с ней начинается упреждающее чтение следующей страницы сектора
+  void read_value_page(uint32_t a_page_index);
+  void schedule_prefetch(uint32_t a_page_index);
+  /// \brief Ожидание незавершенного упреждающего чтения и повтор состояния find_current_value
+  void drop_prefetch();
   void page_mem_tick();
+  /// \brief Текущую операцию page_mem_tick можно начать или завершить
+  bool is_page_op_ready();
+  /// \brief page_mem_tick продвинет операцию, иначе остается только ждать память
+  bool can_page_mem_progress();
+  /// \brief Один переход автомата без вызова tick страничной памяти
+  void step();
+  /// \brief Переход к записи значения в текущую страницу сектора
+  /// \details При частичной записи страница не читается: остальные ячейки не перезаписываются
+  void begin_write_value();
+  /// \brief Ждет завершения операций страничной памяти, вызывая ее tick
+  /// \return false, если память перешла в состояние ошибки. Мапа тогда переходит в status_t::error
+  bool wait_page_mem_blocking();
+  /// \brief Синхронно читает страницу в m_page_buffer. Используется только при монтировании
+  /// \return false при ошибке страничной памяти
+  bool read_page_blocking(uint32_t a_page_index);
+  /// \brief Синхронно читает a_count страниц, начиная с a_page_index, и для каждой по порядку
+  /// вызывает a_handler(номер страницы от a_page_index), когда страница находится в m_page_buffer.
+  /// Чтение прекращается, если a_handler вернул false. Используется только при монтировании
+  /// \details Если память поддерживает пакетные операции, то страницы читаются пачками по 1, 2,
+  /// 4 и т. д. страниц, но не больше сектора данных. Поэтому лишних чтений после остановки не
+  /// больше, чем полезных. Сектора данных при построении зеркала значений читаются по одной
+  /// странице: поиск в них обычно останавливается на первых страницах, и лишние чтения обходятся
+  /// дороже сэкономленных задержек чтения
+  template<class Handler>
+  void read_pages_blocking(uint32_t a_page_index, uint32_t a_count, Handler a_handler);
 
   void change_key(const K& a_key, action_t a_action_status);
-  void evaluate_info_sector_size(uint32_t a_free_page_count);
+  /// \brief Поиск актуального значения ключа на позиции a_key_index
+  /// \param a_use_mirror Взять значение и позицию записи из зеркала, если оно включено
+  void begin_find_current_value(uint32_t a_key_index, bool a_use_mirror);
+  /// \brief Следующий шаг разметки сектора m_current_sector
+  /// \details Стертые страницы пропускаются. При m_lazy_format страницы с неизвестным состоянием
+  /// сначала читаются, результат проверяется в состоянии verify_erased
+  void format_data_sector();
+  /// \brief Все байты индексов страницы ap_page равны m_data_sector_default_value_byte
+  bool is_erased(const uint8_t* ap_page) const;
+  bool is_page_erased(uint32_t a_page_index) const;
+  bool is_page_state_known(uint32_t a_page_index, uint32_t a_count) const;
+  void mark_page_state(uint32_t a_page_index, bool a_erased);
   void get_keys();
+  void build_value_mirror();
+  /// \brief Находит актуальные значения всех ключей сектора за один проход по его страницам
+  /// \details Для каждого ключа сектора вызывает a_handler(индекс ключа, запись зеркала)
+  template<class Handler>
+  void scan_sector(uint32_t a_sector, Handler a_handler);
+  /// \brief Завершение поиска актуального значения: выполнение действия m_action_status
+  void end_find_current_value();
+  /// \brief Чтение следующей страницы двоичного поиска или его завершение
+  void binary_search_next_page();
+  /// \brief Поиск позиции следующего ключа пакета или переход к записи страниц
+  void batch_locate_next();
+  /// \brief Запись следующей страницы пакета или завершение set_values
+  void batch_write_next();
+  /// \brief Следующий шаг переноса ключей m_migration или его завершение
+  void migration_next();
+  /// \brief Изменение страницы ключей для текущего шага переноса в m_page_buffer
+  void migration_update_keys();
+  /// \brief План завершения обмена ключей, прерванного пропаданием питания
+  /// \details Во время обмена в конце списка стоят временные позиции с копиями обоих ключей, и
+  /// эти ключи встречаются в списке дважды. Если копии целые, то обмен завершается, иначе
+  /// временные позиции удаляются
+  void plan_migration_recovery();
+  /// \brief a_key оставлен записью ключа a_new на место a_old, прерванной внутри ключа
+  /// \details Страница пишется с первого байта, поэтому в ключе начало a_new и конец a_old. Сами
+  /// a_new и a_old таким ключом не считаются
+  static bool is_torn_key(const K& a_key, const K& a_new, const K& a_old);
+  /// \brief Прерванная запись любого ключа обмена позиций с ключами a_key_a и a_key_b (a раньше b)
+  /// распознается при монтировании
+  /// \details Ключ, оставленный прерванной записью, не должен совпадать с другим ключом списка, а
+  /// в середине списка - и с терминатором, иначе позиция обмена теряется или список обрывается
+  bool is_swap_recoverable(const K& a_key_a, const K& a_key_b) const;
 
   uint32_t get_data_sector_start_page(uint32_t a_sector);
 
+  /// \brief Индекс значения по адресу ap_index
+  /// \details Индекс хранится младшим байтом вперед независимо от процессора
+  static value_index_t load_index(const uint8_t* ap_index);
+
   // Функции, которые работают с m_page_buffer
-  uint8_t read_index(uint32_t a_value_cell);
-  void write_index(uint32_t a_value_cell, uint8_t a_index);
-  uint8_t read_value(uint32_t a_value_cell);
+  value_index_t read_index(uint32_t a_value_cell);
+  /// \brief Индекс принадлежит записанной ячейке
+  /// \details Индекс больше размера сектора считается пустым: кроме m_empty_value_index такой
+  /// индекс остается после прерванной записи 2-байтового индекса в пустую ячейку, когда записан
+  /// только младший байт
+  bool has_value_index(value_index_t a_index) const;
+  void write_index(uint32_t a_value_cell, value_index_t a_index);
+  V read_value(uint32_t a_value_cell);
   void write_value(uint32_t a_value_cell, const V& a_value);
   K read_key(uint32_t a_key_index);
   void write_key(uint32_t a_key_index, const K& a_key);
   void clear_page_buffer();
   bool is_page_ready();
-  bool has_key(K a_key);
 };
 
-template<class K, class V>
-eeprom_safe_map_t<K, V>::eeprom_safe_map_t(
-  irs::page_mem_t* ap_page,
+/// \brief Мапа со статическим вызовом методов страничной памяти PageMem
+template<class K, class V, class PageMem, class KeyIndex = linear_key_index_t<K>>
+using static_eeprom_safe_map_t = eeprom_safe_map_t<K, V, KeyIndex, PageMem>;
+
+/// \brief Мапа с разметкой, вычисленной при компиляции
+template<
+  class K,
+  class V,
+  uint32_t PageSize,
+  uint32_t FreePages,
+  uint32_t SectorSizePages,
+  class PageMem = irs::page_mem_t,
+  class KeyIndex = linear_key_index_t<K>,
+  class ValueIndex = uint8_t>
+using fixed_geometry_safe_map_t = eeprom_safe_map_t<
+  K,
+  V,
+  KeyIndex,
+  PageMem,
+  static_layout_t<K, V, PageSize, FreePages, SectorSizePages, ValueIndex>>;
+
+/// \brief Мапа с 2-байтовым индексом значения для секторов до 65279 страниц
+/// \details Образ несовместим с мапой с 1-байтовым индексом
+template<
+  class K,
+  class V,
+  class KeyIndex = linear_key_index_t<K>,
+  class PageMem = irs::page_mem_t>
+using wide_index_safe_map_t =
+  eeprom_safe_map_t<K, V, KeyIndex, PageMem, dynamic_layout_t<K, V, uint16_t>>;
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::eeprom_safe_map_t(
+  PageMem* ap_page,
   uint32_t a_page_offset,
   size_t a_free_pages,
   uint32_t a_data_sect_size_pages,
   const K& a_default_key,
-  const K& a_terminator_key
+  const K& a_terminator_key,
+  const eeprom_safe_map_config_t& a_config
+) :
+  eeprom_safe_map_t(
+    ap_page,
+    Layout(ap_page->page_size(), a_free_pages, a_data_sect_size_pages),
+    a_page_offset,
+    a_default_key,
+    a_terminator_key,
+    a_config
+  )
+{
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::eeprom_safe_map_t(
+  PageMem* ap_page,
+  uint32_t a_page_offset,
+  const K& a_default_key,
+  const K& a_terminator_key,
+  const eeprom_safe_map_config_t& a_config
+) :
+  eeprom_safe_map_t(ap_page, Layout(), a_page_offset, a_default_key, a_terminator_key, a_config)
+{
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::eeprom_safe_map_t(
+  PageMem* ap_page,
+  const Layout& a_layout,
+  uint32_t a_page_offset,
+  const K& a_default_key,
+  const K& a_terminator_key,
+  const eeprom_safe_map_config_t& a_config
 ) :
   mp_page(ap_page),
-  m_data_sector_size_pages(a_data_sect_size_pages),
-  m_page_size(mp_page->page_size()),
-  m_page_buffer(m_page_size),
+  m_layout(a_layout),
+  m_page_buffer(m_layout.make_page_buffer()),
   m_terminator_key(a_terminator_key),
   m_current_key(a_default_key),
   m_new_key(a_default_key),
@@ -178,98 +646,340 @@ eeprom_safe_map_t<K, V>::eeprom_safe_map_t(
   m_next_add_status(),
   m_action_status(),
   m_keys_count(0),
-  m_max_keys_count(0),
-  m_values_per_page(0),
-  m_keys_per_page(0),
-  m_info_sector_size_pages(0),
-  m_data_max_sectors_count(0),
   m_current_key_index(0),
   mp_buf_to_save_value(nullptr),
   m_page_mem_op(),
   m_page_mem_page_index(0),
-  m_page_offset(a_page_offset)
+  m_page_mem_value_cell(0),
+  m_page_mem_pages_count(0),
+  m_page_offset(a_page_offset),
+  m_value_mirror_enabled(a_config.value_mirror),
+  m_partial_write(a_config.partial_write && ap_page->supports_partial_write()),
+  m_burst_buffer(),
+  m_lazy_format(a_config.lazy_format),
+  m_known_pages(),
+  m_erased_pages(),
+  m_value_mirror(),
+  m_value_search(a_config.value_search),
+  m_search_low(0),
+  m_search_high(0),
+  m_search_page(0),
+  m_search_found_page(0),
+  m_search_first_index(0),
+  m_batch(),
+  m_batch_position(0),
+  m_batch_saved_page_writes(0),
+  m_op_page_stats{0, 0},
+  m_prefetch_buffer(),
+  m_prefetch_status(prefetch_status_t::none),
+  m_prefetch_page(0),
+  m_prefetch_ticket(0),
+  m_page_mem_issued(0),
+  m_page_mem_ticket(0),
+  m_page_mem_queue_depth(ap_page->queue_depth()),
+  m_wear_balance_enabled(a_config.wear_balance),
+  m_key_writes(),
+  m_wear_imbalance_ratio(a_config.wear_imbalance_ratio),
+  m_migration(),
+  m_migration_position(0),
+  m_migration_value()
 {
-  // Максимальный индекс должен быть на 1 больше количества страниц для работы алгоритма обнаружения
-  // актуального сектора
-  IRS_ASSERT(m_data_sector_size_pages < 255);
+  IRS_ASSERT(mp_page->page_size() == m_layout.page_size());
   clear_page_buffer();
-  evaluate_info_sector_size(a_free_pages);
-
+  if (a_config.burst && mp_page->supports_burst()) {
+    m_burst_buffer.resize(m_layout.data_sector_size_pages() * m_layout.page_size());
+  }
+  if (a_config.pipeline && m_page_mem_queue_depth > 1) {
+    m_prefetch_buffer.resize(m_layout.page_size());
+  }
+  // Номера страниц в мапе 32-битные. Проверка в 64 битах гарантирует, что номер последней страницы
+  // со смещением не переполняется
   IRS_ASSERT(
-    m_page_offset + m_data_max_sectors_count * m_data_sector_size_pages <= mp_page->page_count()
+    static_cast<uint64_t>(m_page_offset) +
+      eeprom_layout_math_t::used_pages_count(
+        m_layout.data_max_sectors_count(),
+        m_layout.data_sector_size_pages(),
+        m_layout.info_sector_size_pages()
+      ) <=
+    mp_page->page_count()
   );
+  if (m_lazy_format) {
+    const uint32_t data_pages_count =
+      m_layout.data_max_sectors_count() * m_layout.data_sector_size_pages();
+    m_known_pages.assign(data_pages_count, false);
+    m_erased_pages.assign(data_pages_count, false);
+  }
+  m_key_index.init(m_layout.max_keys_count());
 
   get_keys();
+  if (m_value_mirror_enabled) {
+    build_value_mirror();
+  }
+  if (m_wear_balance_enabled) {
+    m_key_writes.reserve(m_layout.max_keys_count());
+    m_key_writes.assign(m_keys_count, 0);
+  }
 
-  // Получение текущего значения
-  change_key(m_current_key, action_t::none);
+  if (m_status == status_t::error) {
+    return;
+  }
+  plan_migration_recovery();
+  if (!m_migration.empty()) {
+    // Текущее значение будет получено после восстановления
+    m_migration_position = 0;
+    migration_next();
+  } else {
+    // Получение текущего значения
+    change_key(m_current_key, action_t::none);
+  }
 }
 
-template<class K, class V>
-bool eeprom_safe_map_t<K, V>::set_value(const K& a_key, const V& a_value)
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::set_value(const K& a_key, const V& a_value)
 {
   IRS_ASSERT(ready());
-  if (!has_key(a_key) && m_keys_count + 1 > m_max_keys_count) {
+  m_op_page_stats = {0, 0};
+  if (m_status == status_t::error ||
+      (!has_key(a_key) && m_keys_count + 1 > m_layout.max_keys_count())) {
     return false;
   }
+#ifdef EEPROM_SAFE_MAP_PROFILE
+  const safe_map_profiler_t::op_t profile_op =
+    has_key(a_key) ? safe_map_profiler_t::op_t::set : safe_map_profiler_t::op_t::add;
+#endif
   m_new_value = a_value;
   if (m_current_key != a_key) {
     change_key(a_key, action_t::write_value);
   } else {
-    read_page(
-      get_data_sector_start_page(m_current_sector) + m_current_sector_page, status_t::write_value
-    );
+    begin_write_value();
   }
+#ifdef EEPROM_SAFE_MAP_PROFILE
+  profile_begin_op(profile_op);
+#endif
   return true;
 }
 
-template<class K, class V>
-bool eeprom_safe_map_t<K, V>::get_value(const K& a_key, V& a_value)
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::get_value(const K& a_key, V& a_value)
 {
   IRS_ASSERT(ready());
-  if (!has_key(a_key)) {
+  m_op_page_stats = {0, 0};
+  if (m_status == status_t::error || !has_key(a_key)) {
     return false;
+  } else if (m_value_mirror_enabled) {
+    a_value = m_value_mirror[m_key_index.find(m_keys, a_key)].value;
+#ifdef EEPROM_SAFE_MAP_PROFILE
+    profile_begin_op(safe_map_profiler_t::op_t::get);
+#endif
+    return true;
   } else {
     change_key(a_key, action_t::read_value);
     mp_buf_to_save_value = &a_value;
+#ifdef EEPROM_SAFE_MAP_PROFILE
+    profile_begin_op(safe_map_profiler_t::op_t::get);
+#endif
     return true;
   }
 }
 
-template<class K, class V>
-void eeprom_safe_map_t<K, V>::replace_key(const K& a_old_key, const K& a_new_key, V& a_value)
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::replace_key(
+  const K& a_old_key, const K& a_new_key, V& a_value
+)
 {
   IRS_ASSERT(ready());
+  m_op_page_stats = {0, 0};
+  if (m_status == status_t::error) {
+    return;
+  }
   if (has_key(a_new_key)) {
     set_value(a_new_key, a_value);
   } else {
     m_new_key = a_new_key;
     m_new_value = a_value;
     change_key(a_old_key, action_t::replace_key);
+#ifdef EEPROM_SAFE_MAP_PROFILE
+    profile_begin_op(safe_map_profiler_t::op_t::replace);
+#endif
+  }
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::rebalance()
+{
+  IRS_ASSERT(ready());
+  m_op_page_stats = {0, 0};
+  const uint32_t sectors_count = m_layout.data_max_sectors_count();
+  // Нужны две временные позиции в конце списка и место для терминатора после них
+  if (m_status == status_t::error || !m_wear_balance_enabled || m_keys_count <= sectors_count ||
+      m_keys_count + 3 > m_layout.max_keys_count()) {
+    return false;
+  }
+  std::vector<uint64_t> sector_writes(sectors_count, 0);
+  uint64_t total_writes = 0;
+  for (uint32_t key_index = 0; key_index < m_keys_count; ++key_index) {
+    sector_writes[key_index % sectors_count] += m_key_writes[key_index];
+    total_writes += m_key_writes[key_index];
+  }
+  const uint32_t hot_sector = static_cast<uint32_t>(
+    std::max_element(sector_writes.begin(), sector_writes.end()) - sector_writes.begin()
+  );
+  const uint64_t hot_sector_writes = sector_writes[hot_sector];
+  if (total_writes == 0 || static_cast<double>(hot_sector_writes) * sectors_count <=
+                             static_cast<double>(m_wear_imbalance_ratio) * total_writes) {
+    return false;
   }
+  uint32_t hot = hot_sector;
+  for (uint32_t key_index = hot_sector; key_index < m_keys_count; key_index += sectors_count) {
+    if (m_key_writes[key_index] > m_key_writes[hot]) {
+      hot = key_index;
+    }
+  }
+  // Наибольшие записи секторов, кроме самого нагруженного: второй сектор и третий по нагрузке
+  const uint32_t no_sector = std::numeric_limits<uint32_t>::max();
+  uint32_t second_sector = no_sector;
+  for (uint32_t sector = 0; sector < sectors_count; ++sector) {
+    if (sector != hot_sector &&
+        (second_sector == no_sector || sector_writes[sector] > sector_writes[second_sector])) {
+      second_sector = sector;
+    }
+  }
+  uint64_t third_sector_writes = 0;
+  for (uint32_t sector = 0; sector < sectors_count; ++sector) {
+    if (sector != hot_sector && sector != second_sector) {
+      third_sector_writes = std::max(third_sector_writes, sector_writes[sector]);
+    }
+  }
+  // Ключ другого сектора, обмен с которым дает наименьший максимум записей по всем секторам.
+  // Обмен, после которого этот максимум не уменьшается, не выполняется
+  const uint32_t no_key = std::numeric_limits<uint32_t>::max();
+  uint32_t cold = no_key;
+  uint64_t best_writes = hot_sector_writes;
+  for (uint32_t key_index = 0; key_index < m_keys_count; ++key_index) {
+    const uint32_t sector = key_index % sectors_count;
+    if (sector == hot_sector || m_key_writes[key_index] >= m_key_writes[hot] ||
+        !is_swap_recoverable(m_keys[std::min(hot, key_index)], m_keys[std::max(hot, key_index)])) {
+      continue;
+    }
+    const uint64_t moved_writes = m_key_writes[hot] - m_key_writes[key_index];
+    const uint64_t other_sectors_writes =
+      sector == second_sector ? third_sector_writes : sector_writes[second_sector];
+    const uint64_t max_writes = std::max(
+      {hot_sector_writes - moved_writes, sector_writes[sector] + moved_writes, other_sectors_writes}
+    );
+    if (max_writes < best_writes) {
+      best_writes = max_writes;
+      cold = key_index;
+    }
+  }
+  if (cold == no_key) {
+    return false;
+  }
+
+  // Обмен позиций a < b через временные позиции tmp_b и tmp_a в конце списка. Перед каждой
+  // записью ключа его значение уже записано в ячейку новой позиции, а из одинаковых ключей
+  // действует последний, поэтому после любого шага все ключи читаются со своими значениями.
+  // Терминатор и копия a пишутся за концом списка и появляются в нем одной записью копии b, так
+  // что при монтировании обе копии видны или не видны вместе и по ним находятся ключи обмена
+  const uint32_t a = std::min(hot, cold);
+  const uint32_t b = std::max(hot, cold);
+  const uint32_t tmp_b = m_keys_count;
+  const uint32_t tmp_a = m_keys_count + 1;
+  typedef typename migration_step_t::op_t op_t;
+  m_migration.clear();
+  m_migration.push_back({op_t::terminate, tmp_a + 1, tmp_a + 1});
+  m_migration.push_back({op_t::copy, a, tmp_a});
+  m_migration.push_back({op_t::copy, b, tmp_b});
+  m_migration.push_back({op_t::copy, tmp_b, a});
+  m_migration.push_back({op_t::copy, tmp_a, b});
+  m_migration.push_back({op_t::terminate, tmp_b, tmp_b});
+  // Копия a за терминатором стирается, чтобы прерванная запись терминатора при добавлении
+  // следующего ключа не открыла ее
+  m_migration.push_back({op_t::terminate, tmp_a, tmp_a});
+  if (m_value_mirror_enabled) {
+    m_value_mirror.resize(tmp_a + 1, {V(), 0, 0});
+  }
+  m_migration_position = 0;
+  migration_next();
+#ifdef EEPROM_SAFE_MAP_PROFILE
+  profile_begin_op(safe_map_profiler_t::op_t::rebalance);
+#endif
+  return true;
 }
 
-template<class K, class V>
-void eeprom_safe_map_t<K, V>::tick()
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::tick()
 {
+#ifdef EEPROM_SAFE_MAP_PROFILE
+  const profile_point_t profile_point = profile_begin();
+#endif
   mp_page->tick();
+  step();
+#ifdef EEPROM_SAFE_MAP_PROFILE
+  profile_end(profile_point, 1, 1);
+#endif
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+typename eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::run_result_t
+eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::run_for(
+  uint32_t a_max_page_mem_ticks, std::chrono::steady_clock::time_point a_deadline
+)
+{
+  const bool has_deadline = a_deadline != std::chrono::steady_clock::time_point::max();
+  run_result_t result{0, 0, false};
+  while (!ready()) {
+#ifdef EEPROM_SAFE_MAP_PROFILE
+    const profile_point_t profile_point = profile_begin();
+#endif
+    if (m_status == status_t::wait_page_mem && !can_page_mem_progress()) {
+      if (result.page_mem_ticks == a_max_page_mem_ticks) {
+        break;
+      }
+      mp_page->tick();
+      result.page_mem_ticks++;
+#ifdef EEPROM_SAFE_MAP_PROFILE
+      profile_end(profile_point, 0, 1);
+#endif
+    } else {
+      step();
+      result.steps++;
+#ifdef EEPROM_SAFE_MAP_PROFILE
+      profile_end(profile_point, 1, 0);
+#endif
+    }
+    if (has_deadline && std::chrono::steady_clock::now() >= a_deadline) {
+      break;
+    }
+  }
+  result.ready = ready();
+  return result;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+typename eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::run_result_t
+eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::run_until_ready()
+{
+  return run_for(UINT32_MAX);
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::step()
+{
   switch (m_status) {
     case status_t::free: {
     } break;
 
     case status_t::find_current_key: {
-      auto it = std::find(m_keys.begin(), m_keys.end(), m_current_key);
+      uint32_t key_index = m_key_index.find(m_keys, m_current_key);
       // Запись не была найдена
-      if (it == m_keys.end()) {
+      if (key_index == KeyIndex::npos) {
         m_status = status_t::add_key;
         m_add_status = add_status_t::update_info;
         m_current_key_index = m_keys_count;
       } else {
         // Запись была найдена
-        m_current_key_index = std::distance(m_keys.begin(), it);
-        m_current_sector = m_current_key_index % m_data_max_sectors_count;
-        m_current_value_cell = m_current_key_index / m_data_max_sectors_count;
-        read_page(get_data_sector_start_page(m_current_sector), status_t::find_current_value);
+        begin_find_current_value(key_index, true);
       }
     } break;
 
@@ -281,122 +991,270 @@ void eeprom_safe_map_t<K, V>::tick()
     case status_t::add_ended: {
       m_current_sector_page = 0;
       m_current_value_index = 0;
-      read_page(get_data_sector_start_page(m_current_sector), status_t::write_value);
+      if (m_action_status == action_t::batch_locate) {
+        end_find_current_value();
+      } else {
+        begin_write_value();
+      }
     } break;
 
       // Поиск последней записи значения
     case status_t::find_current_value: {
-      uint8_t value_index = read_index(m_current_value_cell);
-      bool no_jump = value_index == (m_current_value_index + 1) % (m_data_sector_size_pages + 1);
-      bool has_value = value_index != m_data_sector_default_value_byte;
-      bool in_range = m_current_sector_page < m_data_sector_size_pages;
+      value_index_t value_index = read_index(m_current_value_cell);
+      bool no_jump =
+        value_index == (m_current_value_index + 1) % (m_layout.data_sector_size_pages() + 1);
+      bool has_value = has_value_index(value_index);
+      bool in_range = m_current_sector_page < m_layout.data_sector_size_pages();
       if ((m_current_sector_page == 0 || (in_range && no_jump)) && has_value) {
         m_current_value_index = value_index;
         m_current_value = read_value(m_current_value_cell);
         m_current_sector_page++;
-        if (m_current_sector_page < m_data_sector_size_pages) {
-          read_page(
-            get_data_sector_start_page(m_current_sector) + m_current_sector_page,
-            status_t::find_current_value
-          );
+        if (m_current_sector_page < m_layout.data_sector_size_pages()) {
+          read_value_page(get_data_sector_start_page(m_current_sector) + m_current_sector_page);
         }
+      } else if (m_prefetch_status != prefetch_status_t::none) {
+        // Остальные операции мапы начинаются только после завершения упреждающего чтения
+        drop_prefetch();
       } else {
         if (m_current_sector_page == 0) {
+          // В секторе нет значений ключа
           m_current_value_index = 0;
+          m_current_value = V();
         } else {
-          m_current_value_index = (m_current_value_index + 1) % (m_data_sector_size_pages + 1);
-          if (m_current_sector_page == m_data_sector_size_pages) {
+          m_current_value_index =
+            (m_current_value_index + 1) % (m_layout.data_sector_size_pages() + 1);
+          if (m_current_sector_page == m_layout.data_sector_size_pages()) {
             m_current_sector_page = 0;
           }
         }
-        switch (m_action_status) {
-          case action_t::none: {
-            m_status = status_t::free;
-          } break;
-          case action_t::read_value: {
-            IRS_ASSERT(mp_buf_to_save_value != nullptr);
-            *mp_buf_to_save_value = m_current_value;
-            mp_buf_to_save_value = nullptr;
-            m_status = status_t::free;
-          } break;
-          case action_t::write_value: {
-            read_page(
-              get_data_sector_start_page(m_current_sector) + m_current_sector_page,
-              status_t::write_value
-            );
-          } break;
-          case action_t::replace_key: {
-            read_page(m_current_key_index / m_keys_per_page, status_t::replace_key);
-          } break;
-        }
-        m_action_status = action_t::none;
+        end_find_current_value();
+      }
+    } break;
+
+      // Двоичный поиск последней записи значения. Страница p содержит значение из непрерывной
+      // последовательности, если ее индекс отличается от индекса первой страницы ровно на p.
+      // Такие страницы идут подряд с начала сектора, поэтому граница находится двоичным поиском
+    case status_t::find_current_value_binary_first: {
+      value_index_t value_index = read_index(m_current_value_cell);
+      if (!has_value_index(value_index)) {
+        m_current_sector_page = 0;
+        m_current_value_index = 0;
+        m_current_value = V();
+        end_find_current_value();
+      } else {
+        m_search_first_index = value_index;
+        m_search_found_page = 0;
+        m_current_value = read_value(m_current_value_cell);
+        m_search_low = 1;
+        m_search_high = m_layout.data_sector_size_pages() - 1;
+        binary_search_next_page();
+      }
+    } break;
+
+    case status_t::find_current_value_binary: {
+      value_index_t value_index = read_index(m_current_value_cell);
+      bool has_value = has_value_index(value_index);
+      uint32_t distance =
+        (value_index + m_layout.data_sector_size_pages() + 1 - m_search_first_index) %
+        (m_layout.data_sector_size_pages() + 1);
+      if (has_value && distance == m_search_page) {
+        m_search_found_page = m_search_page;
+        m_current_value = read_value(m_current_value_cell);
+        m_search_low = m_search_page + 1;
+      } else {
+        m_search_high = m_search_page - 1;
       }
+      binary_search_next_page();
     } break;
 
     case status_t::replace_key: {
-      write_key(m_current_key_index % m_keys_per_page, m_new_key);
-      write_page(m_current_key_index / m_keys_per_page, status_t::replace_value);
+      write_key(m_current_key_index % m_layout.keys_per_page(), m_new_key);
+      write_page(m_current_key_index / m_layout.keys_per_page(), status_t::replace_value);
       m_keys[m_current_key_index] = m_new_key;
+      m_key_index.replace(m_keys, m_current_key, m_current_key_index);
+      if (m_wear_balance_enabled) {
+        m_key_writes[m_current_key_index] = 0;
+      }
+      // Текущим становится новый ключ, иначе старый ключ считался бы еще существующим
+      m_current_key = m_new_key;
     } break;
 
     case status_t::replace_value: {
-      read_page(
-        get_data_sector_start_page(m_current_sector) + m_current_sector_page, status_t::write_value
-      );
+      begin_write_value();
     } break;
 
       // Запись новой ячейки значения в следующую страницу сектора
     case status_t::write_value: {
       write_value(m_current_value_cell, m_new_value);
       write_index(m_current_value_cell, m_current_value_index);
-      write_page(
-        get_data_sector_start_page(m_current_sector) + m_current_sector_page, status_t::free
-      );
-      m_current_value_index = (m_current_value_index + 1) % (m_data_sector_size_pages + 1);
-      m_current_sector_page = (m_current_sector_page + 1) % m_data_sector_size_pages;
+      const uint32_t page = get_data_sector_start_page(m_current_sector) + m_current_sector_page;
+      mark_page_state(page, false);
+      // При переносе за записью значения следует запись ключа на новую позицию
+      const status_t next_status = m_migration.empty() ? status_t::free : status_t::migrate_key;
+      if (m_partial_write) {
+        write_value_cell(page, m_current_value_cell, next_status);
+      } else {
+        write_page(page, next_status);
+      }
+      if (m_wear_balance_enabled && m_migration.empty()) {
+        m_key_writes[m_current_key_index]++;
+      }
+      m_current_value_index = (m_current_value_index + 1) % (m_layout.data_sector_size_pages() + 1);
+      m_current_sector_page = (m_current_sector_page + 1) % m_layout.data_sector_size_pages();
       m_current_value = m_new_value;
+      if (m_value_mirror_enabled) {
+        m_value_mirror[m_current_key_index] = {
+          m_current_value, m_current_sector_page, m_current_value_index
+        };
+      }
+    } break;
+
+      // Запись всех ячеек пакета, попадающих в одну страницу сектора
+    case status_t::batch_write_page: {
+      const batch_item_t& first_item = m_batch[m_batch_position];
+      while (m_batch_position < m_batch.size() &&
+             m_batch[m_batch_position].sector == first_item.sector &&
+             m_batch[m_batch_position].sector_page == first_item.sector_page) {
+        const batch_item_t& item = m_batch[m_batch_position];
+        write_value(item.value_cell, item.value);
+        write_index(item.value_cell, item.value_index);
+        if (m_wear_balance_enabled) {
+          m_key_writes[item.key_index]++;
+        }
+        if (m_value_mirror_enabled) {
+          m_value_mirror[item.key_index] = {
+            item.value,
+            (item.sector_page + 1) % m_layout.data_sector_size_pages(),
+            static_cast<value_index_t>(
+              (item.value_index + 1) % (m_layout.data_sector_size_pages() + 1)
+            )
+          };
+        }
+        m_batch_position++;
+      }
+      const uint32_t page = get_data_sector_start_page(first_item.sector) + first_item.sector_page;
+      mark_page_state(page, false);
+      write_page(page, status_t::batch_next_page);
+    } break;
+
+    case status_t::batch_next_page: {
+      batch_write_next();
+    } break;
+
+      // Значение шага переноса записано или шаг не пишет значение: чтение страницы ключей
+    case status_t::migrate_key: {
+      const migration_step_t& step = m_migration[m_migration_position];
+      read_page(step.dst / m_layout.keys_per_page(), status_t::migrate_key_page);
+    } break;
+
+    case status_t::migrate_key_page: {
+      migration_update_keys();
+      const migration_step_t& step = m_migration[m_migration_position];
+      write_page(step.dst / m_layout.keys_per_page(), status_t::migrate_next);
+    } break;
+
+    case status_t::migrate_next: {
+      m_migration_position++;
+      migration_next();
     } break;
 
     case status_t::wait_page_mem: {
       page_mem_tick();
     } break;
+
+    case status_t::error: {
+    } break;
   }
 }
 
-template<class K, class V>
-void eeprom_safe_map_t<K, V>::add_key()
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::add_key()
 {
   switch (m_add_status) {
     case add_status_t::update_info: {
       m_keys.emplace_back(m_current_key);
+      m_key_index.insert(m_keys, m_keys_count);
+      if (m_value_mirror_enabled) {
+        m_value_mirror.push_back({V(), 0, 0});
+      }
+      if (m_wear_balance_enabled) {
+        m_key_writes.push_back(0);
+      }
       m_keys_count++;
-      m_current_sector = (m_keys_count - 1) % m_data_max_sectors_count;
-      m_current_value_cell = (m_keys_count - 1) / m_data_max_sectors_count;
+      m_current_sector = (m_keys_count - 1) % m_layout.data_max_sectors_count();
+      m_current_value_cell = (m_keys_count - 1) / m_layout.data_max_sectors_count();
 
-      // Если места под новый сектор нет, то значение будет храниться в уже существующем
-      if (m_keys_count > m_data_max_sectors_count) {
-        m_add_status = add_status_t::add_key_prep;
+      // Если места под новый сектор нет, то значение будет храниться в уже существующем. Ячейка
+      // позиции может остаться записанной от переноса ключей, поэтому она проверяется до записи
+      // ключа, иначе ключ после пропадания питания прочитал бы чужое значение
+      if (m_keys_count > m_layout.data_max_sectors_count()) {
+        read_page(
+          get_data_sector_start_page(m_current_sector),
+          status_t::add_key,
+          add_status_t::check_value_cell
+        );
       } else {
         // Добавление сектора, заполнение его значением m_data_sector_default_value_byte
-        clear_page_buffer();
         m_current_sector_page = 0;
         m_add_status = add_status_t::add_data_sector;
       }
     } break;
 
     case add_status_t::add_data_sector: {
-      if (m_current_sector_page < m_data_sector_size_pages - 1) {
-        write_page(
+      format_data_sector();
+    } break;
+
+      // Проверка страниц сектора, прочитанных перед разметкой
+    case add_status_t::verify_erased: {
+      const uint32_t start_page = get_data_sector_start_page(m_current_sector);
+      if (m_burst_buffer.empty()) {
+        mark_page_state(start_page + m_current_sector_page, is_erased(m_page_buffer.data()));
+      } else {
+        for (uint32_t page = 0; page < m_layout.data_sector_size_pages(); ++page) {
+          const uint8_t* p_page = m_burst_buffer.data() + page * m_layout.page_size();
+          mark_page_state(start_page + page, is_erased(p_page));
+        }
+      }
+      m_add_status = add_status_t::add_data_sector;
+    } break;
+
+      // Значения ячейки пишутся с первой страницы сектора, а очищаются с последней, поэтому
+      // пустая ячейка первой страницы означает пустую ячейку во всем секторе
+    case add_status_t::check_value_cell: {
+      if (has_value_index(read_index(m_current_value_cell))) {
+        m_current_sector_page = m_layout.data_sector_size_pages() - 1;
+        read_page(
           get_data_sector_start_page(m_current_sector) + m_current_sector_page,
           status_t::add_key,
-          add_status_t::add_data_sector
+          add_status_t::clear_value_cell
         );
-        m_current_sector_page++;
       } else {
-        write_page(
+        m_add_status = add_status_t::add_key_prep;
+      }
+    } break;
+
+    case add_status_t::clear_value_cell: {
+      const uint32_t page = get_data_sector_start_page(m_current_sector) + m_current_sector_page;
+      if (read_index(m_current_value_cell) != m_empty_value_index) {
+        uint8_t* p_value = m_page_buffer.data() + m_current_value_cell * m_bytes_per_value;
+        std::fill(p_value, p_value + m_bytes_per_value, m_data_sector_default_value_byte);
+        write_index(m_current_value_cell, m_empty_value_index);
+        mark_page_state(page, is_erased(m_page_buffer.data()));
+        write_page(page, status_t::add_key, add_status_t::clear_next_page);
+      } else {
+        m_add_status = add_status_t::clear_next_page;
+      }
+    } break;
+
+    case add_status_t::clear_next_page: {
+      if (m_current_sector_page == 0) {
+        m_add_status = add_status_t::add_key_prep;
+      } else {
+        m_current_sector_page--;
+        read_page(
           get_data_sector_start_page(m_current_sector) + m_current_sector_page,
           status_t::add_key,
-          add_status_t::add_key_prep
+          add_status_t::clear_value_cell
         );
       }
     } break;
@@ -404,7 +1262,7 @@ void eeprom_safe_map_t<K, V>::add_key()
       // Копируется страница, в которую будет добавлена запись
     case add_status_t::add_key_prep: {
       // -1 для перевода из кол-ва в индекс
-      m_current_sector_page = (m_keys_count - 1) / m_keys_per_page;
+      m_current_sector_page = (m_keys_count - 1) / m_layout.keys_per_page();
       read_page(m_current_sector_page, status_t::add_key, add_status_t::add_key);
     } break;
 
@@ -412,10 +1270,12 @@ void eeprom_safe_map_t<K, V>::add_key()
     case add_status_t::add_key: {
       // m_keys_count - m_notes_per_page * m_current_sector_page - 1 = номер
       // записи в текущей странице
-      write_key(m_keys_count - m_keys_per_page * m_current_sector_page - 1, m_current_key);
+      write_key(m_keys_count - m_layout.keys_per_page() * m_current_sector_page - 1, m_current_key);
       // Проверка на наличие места для ключа-терминатора в текущей странице
-      if (m_keys_count / m_keys_per_page == m_current_sector_page) {
-        write_key(m_keys_count - m_keys_per_page * m_current_sector_page, m_terminator_key);
+      if (m_keys_count / m_layout.keys_per_page() == m_current_sector_page) {
+        write_key(
+          m_keys_count - m_layout.keys_per_page() * m_current_sector_page, m_terminator_key
+        );
         write_page(m_current_sector_page, status_t::add_ended);
       } else {
         write_page(m_current_sector_page, status_t::add_key, add_status_t::add_terminator_key);
@@ -424,7 +1284,7 @@ void eeprom_safe_map_t<K, V>::add_key()
 
       // Добавление символа-терминатора в конец, если он не был добавлен в предыдущем состоянии
     case add_status_t::add_terminator_key: {
-      IRS_ASSERT(m_current_sector_page + 1 < m_info_sector_size_pages);
+      IRS_ASSERT(m_current_sector_page + 1 < m_layout.info_sector_size_pages());
       clear_page_buffer();
       write_key(0, m_terminator_key);
       write_page(m_current_sector_page + 1, status_t::add_ended);
@@ -432,14 +1292,30 @@ void eeprom_safe_map_t<K, V>::add_key()
   }
 }
 
-template<class K, class V>
-bool eeprom_safe_map_t<K, V>::ready()
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::ready()
 {
-  return m_status == status_t::free;
+  return m_status == status_t::free || m_status == status_t::error;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+irs_status_t eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::status() const
+{
+  switch (m_status) {
+    case status_t::free: {
+      return irs_st_ready;
+    }
+    case status_t::error: {
+      return irs_st_error;
+    }
+    default: {
+      return irs_st_busy;
+    }
+  }
 }
 
-template<class K, class V>
-void eeprom_safe_map_t<K, V>::read_page(
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::read_page(
   uint32_t a_page_index, status_t a_next_status, add_status_t a_next_add_status
 )
 {
@@ -450,8 +1326,8 @@ void eeprom_safe_map_t<K, V>::read_page(
   m_next_add_status = a_next_add_status;
 }
 
-template<class K, class V>
-void eeprom_safe_map_t<K, V>::write_page(
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::write_page(
   uint32_t a_page_index, status_t a_next_status, add_status_t a_next_add_status
 )
 {
@@ -462,189 +1338,1171 @@ void eeprom_safe_map_t<K, V>::write_page(
   m_next_add_status = a_next_add_status;
 }
 
-template<class K, class V>
-void eeprom_safe_map_t<K, V>::page_mem_tick()
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::read_pages(
+  uint32_t a_page_index,
+  uint32_t a_count,
+  status_t a_next_status,
+  add_status_t a_next_add_status
+)
 {
-  if (is_page_ready()) {
-    switch (m_page_mem_op) {
-      case page_mem_op_t::read: {
-        mp_page->read_page(m_page_buffer.data(), m_page_offset + m_page_mem_page_index);
-        m_page_mem_op = page_mem_op_t::end_op;
-      } break;
-      case page_mem_op_t::write: {
-        mp_page->write_page(m_page_buffer.data(), m_page_offset + m_page_mem_page_index);
-        m_page_mem_op = page_mem_op_t::end_op;
-      } break;
-      case page_mem_op_t::end_op: {
-        m_status = m_next_status;
-        m_add_status = m_next_add_status;
-      } break;
-    }
-  }
+  IRS_ASSERT(a_count * m_layout.page_size() <= m_burst_buffer.size());
+  m_page_mem_page_index = a_page_index;
+  m_page_mem_pages_count = a_count;
+  m_page_mem_op = page_mem_op_t::read_pages;
+  m_status = status_t::wait_page_mem;
+  m_next_status = a_next_status;
+  m_next_add_status = a_next_add_status;
 }
 
-template<class K, class V>
-void eeprom_safe_map_t<K, V>::change_key(const K& a_key, action_t a_action_status)
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::write_pages(
+  uint32_t a_page_index,
+  uint32_t a_count,
+  status_t a_next_status,
+  add_status_t a_next_add_status
+)
 {
-  m_status = status_t::find_current_key;
-  m_current_key = a_key;
-  m_current_sector_page = 0;
-  m_current_value_index = 0;
-  m_action_status = a_action_status;
+  IRS_ASSERT(a_count * m_layout.page_size() <= m_burst_buffer.size());
+  m_page_mem_page_index = a_page_index;
+  m_page_mem_pages_count = a_count;
+  m_page_mem_op = page_mem_op_t::write_pages;
+  m_status = status_t::wait_page_mem;
+  m_next_status = a_next_status;
+  m_next_add_status = a_next_add_status;
 }
 
-template<class K, class V>
-void eeprom_safe_map_t<K, V>::reset()
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::write_value_cell(
+  uint32_t a_page_index, uint32_t a_value_cell, status_t a_next_status
+)
 {
-  clear_page_buffer();
-  write_key(0, m_terminator_key);
-  while (!is_page_ready()) {
-    mp_page->tick();
-  }
-  // Запись символа-терминатора на первую позицию для ключей
-  mp_page->write_page(m_page_buffer.data(), m_page_offset);
-  while (!is_page_ready()) {
-    mp_page->tick();
-  }
-  m_keys_count = 0;
-  m_keys.clear();
-  change_key(m_current_key, action_t::write_value);
+  m_page_mem_page_index = a_page_index;
+  m_page_mem_value_cell = a_value_cell;
+  m_page_mem_op = page_mem_op_t::write_value_cell;
+  m_status = status_t::wait_page_mem;
+  m_next_status = a_next_status;
+  m_next_add_status = add_status_t::update_info;
 }
 
-template<class K, class V>
-uint32_t eeprom_safe_map_t<K, V>::get_data_sectors_count() const
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::read_value_page(uint32_t a_page_index)
 {
-  return m_data_max_sectors_count;
+  if (m_prefetch_status == prefetch_status_t::issued && m_prefetch_page == a_page_index) {
+    m_page_mem_op = page_mem_op_t::take_prefetch;
+    m_status = status_t::wait_page_mem;
+    m_next_status = status_t::find_current_value;
+    m_next_add_status = add_status_t::update_info;
+  } else {
+    IRS_ASSERT(m_prefetch_status != prefetch_status_t::issued);
+    read_page(a_page_index, status_t::find_current_value);
+    schedule_prefetch(a_page_index + 1);
+  }
 }
 
-template<class K, class V>
-uint32_t eeprom_safe_map_t<K, V>::get_keys_count() const
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::schedule_prefetch(uint32_t a_page_index)
 {
-  return m_keys_count;
+  const uint32_t sector_end_page =
+    get_data_sector_start_page(m_current_sector) + m_layout.data_sector_size_pages();
+  if (!m_prefetch_buffer.empty() && a_page_index < sector_end_page) {
+    m_prefetch_page = a_page_index;
+    m_prefetch_status = prefetch_status_t::wanted;
+  } else {
+    m_prefetch_status = prefetch_status_t::none;
+  }
 }
 
-template<class K, class V>
-K eeprom_safe_map_t<K, V>::get_key(uint32_t a_index) const
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::drop_prefetch()
 {
-  IRS_ASSERT(a_index < m_keys_count);
-  return m_keys[a_index];
+  if (m_prefetch_status == prefetch_status_t::issued) {
+    m_page_mem_op = page_mem_op_t::drop_prefetch;
+    m_status = status_t::wait_page_mem;
+    m_next_status = status_t::find_current_value;
+    m_next_add_status = add_status_t::update_info;
+  } else {
+    m_prefetch_status = prefetch_status_t::none;
+  }
 }
 
-template<class K, class V>
-void eeprom_safe_map_t<K, V>::evaluate_info_sector_size(uint32_t a_free_page_count)
-{
-  m_keys_per_page = m_page_size / m_bytes_per_key;
-  m_values_per_page = m_page_size / (m_bytes_per_value + m_bytes_per_value_index);
-  // p_vk = values_per_page / keys_per_page - кол-во страниц ключей для хранения ячеек значений,
-  // которые помещаются на одной странице (Если на странице помещается 20 ячеек значений, а ключей
-  // только 8, то потребуется 2,5 страницы с ключами, чтобы хранить 20 ячеек значений)
-  float key_pages_per_value_page =
-    static_cast<float>(m_values_per_page) / static_cast<float>(m_keys_per_page);
-  // Для каждого сектора необходимо иметь p_vk страниц с ключами,
-  // сектор занимает data_sect_size_pages страниц. При оптимальном распределении получается
-  // уравнение: (p_vk + data_sect_size_pages) * k = p, где k - кол-во пар "страниц записи - сектор"
-  // или кол-во секторов данных. Выражается k: k = floor(p / (p_vk + data_sect_size_pages)).
-  m_data_max_sectors_count = static_cast<uint32_t>(
-    static_cast<float>(a_free_page_count) /
-    (key_pages_per_value_page + static_cast<float>(m_data_sector_size_pages))
-  );
-  IRS_ASSERT(m_data_max_sectors_count > 0);
-  m_info_sector_size_pages = static_cast<uint32_t>(
-    ceil(static_cast<float>(m_data_max_sectors_count) * key_pages_per_value_page)
-  );
-  m_max_keys_count = m_data_max_sectors_count * m_values_per_page;
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::begin_write_value()
+{
+  if (m_partial_write) {
+    m_status = status_t::write_value;
+  } else {
+    read_page(
+      get_data_sector_start_page(m_current_sector) + m_current_sector_page, status_t::write_value
+    );
+  }
 }
 
-template<class K, class V>
-void eeprom_safe_map_t<K, V>::get_keys()
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::page_mem_tick()
 {
-  while (!is_page_ready()) {
-    mp_page->tick();
+  if (mp_page->status() == irs_st_error) {
+    m_status = status_t::error;
+    return;
   }
-  for (size_t i = 0; i < m_info_sector_size_pages; ++i) {
-    mp_page->read_page(m_page_buffer.data(), m_page_offset + i);
-    while (!is_page_ready()) {
-      mp_page->tick();
-    }
-    bool key_terminated_value_found = false;
-    for (size_t j = 0; j < m_keys_per_page; ++j) {
-      K tmp_value = read_key(j);
-      // Если найдено значение m_terminator_key, то это конец списка ключей
-      if (tmp_value == m_terminator_key) {
-        key_terminated_value_found = true;
-        break;
-      }
-      m_keys.emplace_back(tmp_value);
-    }
-    if (key_terminated_value_found) {
-      break;
+  if (is_page_op_ready()) {
+    switch (m_page_mem_op) {
+      case page_mem_op_t::read: {
+        mp_page->read_page(m_page_buffer.data(), m_page_offset + m_page_mem_page_index);
+        m_op_page_stats.page_reads++;
+        m_page_mem_ticket = m_page_mem_issued++;
+        m_page_mem_op = page_mem_op_t::end_op;
+      } break;
+      case page_mem_op_t::write: {
+        mp_page->write_page(m_page_buffer.data(), m_page_offset + m_page_mem_page_index);
+        m_op_page_stats.page_writes++;
+        m_page_mem_ticket = m_page_mem_issued++;
+        m_page_mem_op = page_mem_op_t::end_op;
+      } break;
+      // Байт индекса записывается после значения, как и при записи целой страницы
+      case page_mem_op_t::write_value_cell: {
+        mp_page->write_bytes(
+          m_page_buffer.data(),
+          m_page_offset + m_page_mem_page_index,
+          m_page_mem_value_cell * m_bytes_per_value,
+          m_bytes_per_value
+        );
+        m_op_page_stats.page_writes++;
+        m_page_mem_ticket = m_page_mem_issued++;
+        m_page_mem_op = page_mem_op_t::write_index_byte;
+      } break;
+      case page_mem_op_t::write_index_byte: {
+        mp_page->write_bytes(
+          m_page_buffer.data(),
+          m_page_offset + m_page_mem_page_index,
+          m_layout.page_size() - m_bytes_per_value_index * (m_page_mem_value_cell + 1),
+          m_bytes_per_value_index
+        );
+        m_page_mem_ticket = m_page_mem_issued++;
+        m_page_mem_op = page_mem_op_t::end_op;
+      } break;
+      case page_mem_op_t::read_pages: {
+        mp_page->read_pages(
+          m_burst_buffer.data(), m_page_offset + m_page_mem_page_index, m_page_mem_pages_count
+        );
+        m_op_page_stats.page_reads += m_page_mem_pages_count;
+        m_page_mem_ticket = m_page_mem_issued++;
+        m_page_mem_op = page_mem_op_t::end_op;
+      } break;
+      case page_mem_op_t::write_pages: {
+        mp_page->write_pages(
+          m_burst_buffer.data(), m_page_offset + m_page_mem_page_index, m_page_mem_pages_count
+        );
+        m_op_page_stats.page_writes += m_page_mem_pages_count;
+        m_page_mem_ticket = m_page_mem_issued++;
+        m_page_mem_op = page_mem_op_t::end_op;
+      } break;
+      case page_mem_op_t::end_op: {
+        m_status = m_next_status;
+        m_add_status = m_next_add_status;
+      } break;
+      case page_mem_op_t::take_prefetch: {
+        std::copy(m_prefetch_buffer.begin(), m_prefetch_buffer.end(), m_page_buffer.begin());
+        schedule_prefetch(m_prefetch_page + 1);
+        m_status = m_next_status;
+        m_add_status = m_next_add_status;
+      } break;
+      case page_mem_op_t::drop_prefetch: {
+        m_prefetch_status = prefetch_status_t::none;
+        m_status = m_next_status;
+        m_add_status = m_next_add_status;
+      } break;
+    }
+  }
+  // Упреждающее чтение начинается после основной операции, чтобы не задерживать ее
+  if (m_prefetch_status == prefetch_status_t::wanted &&
+      mp_page->pending_ops() < m_page_mem_queue_depth) {
+    mp_page->read_page(m_prefetch_buffer.data(), m_page_offset + m_prefetch_page);
+    m_op_page_stats.page_reads++;
+    m_prefetch_ticket = m_page_mem_issued++;
+    m_prefetch_status = prefetch_status_t::issued;
+  }
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::is_page_op_ready()
+{
+  if (m_prefetch_buffer.empty()) {
+    return is_page_ready();
+  }
+  if (mp_page->status() == irs_st_error) {
+    return false;
+  }
+  const uint32_t pending_ops = mp_page->pending_ops();
+  switch (m_page_mem_op) {
+    case page_mem_op_t::end_op: {
+      return pending_ops < m_page_mem_issued - m_page_mem_ticket;
+    }
+    case page_mem_op_t::take_prefetch:
+    case page_mem_op_t::drop_prefetch: {
+      return pending_ops < m_page_mem_issued - m_prefetch_ticket;
+    }
+    default: {
+      return pending_ops < m_page_mem_queue_depth;
+    }
+  }
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::can_page_mem_progress()
+{
+  // Ошибку памяти page_mem_tick обрабатывает переходом в status_t::error
+  return is_page_op_ready() || mp_page->status() == irs_st_error ||
+         (m_prefetch_status == prefetch_status_t::wanted &&
+          mp_page->pending_ops() < m_page_mem_queue_depth);
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::wait_page_mem_blocking()
+{
+  while (!is_page_ready()) {
+    if (mp_page->status() == irs_st_error) {
+      m_status = status_t::error;
+      return false;
+    }
+    mp_page->tick();
+  }
+  return true;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::read_page_blocking(uint32_t a_page_index)
+{
+  if (!wait_page_mem_blocking()) {
+    return false;
+  }
+  mp_page->read_page(m_page_buffer.data(), m_page_offset + a_page_index);
+  m_op_page_stats.page_reads++;
+  return wait_page_mem_blocking();
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+template<class Handler>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::read_pages_blocking(
+  uint32_t a_page_index, uint32_t a_count, Handler a_handler
+)
+{
+  const uint32_t page_size = m_layout.page_size();
+  uint32_t burst_pages_count = 1;
+  uint32_t page = 0;
+  while (page < a_count) {
+    if (m_burst_buffer.empty()) {
+      if (!read_page_blocking(a_page_index + page) || !a_handler(page)) {
+        return;
+      }
+      page++;
+      continue;
+    }
+    const uint32_t count = std::min(burst_pages_count, a_count - page);
+    if (!wait_page_mem_blocking()) {
+      return;
+    }
+    mp_page->read_pages(m_burst_buffer.data(), m_page_offset + a_page_index + page, count);
+    m_op_page_stats.page_reads += count;
+    if (!wait_page_mem_blocking()) {
+      return;
+    }
+    for (uint32_t i = 0; i < count; ++i, ++page) {
+      std::copy_n(m_burst_buffer.begin() + i * page_size, page_size, m_page_buffer.begin());
+      if (!a_handler(page)) {
+        return;
+      }
+    }
+    burst_pages_count = std::min(2 * burst_pages_count, m_layout.data_sector_size_pages());
+  }
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::change_key(
+  const K& a_key, action_t a_action_status
+)
+{
+  m_status = status_t::find_current_key;
+  m_current_key = a_key;
+  m_current_sector_page = 0;
+  m_current_value_index = 0;
+  m_action_status = a_action_status;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::begin_find_current_value(
+  uint32_t a_key_index, bool a_use_mirror
+)
+{
+  m_current_key_index = a_key_index;
+  m_current_sector = a_key_index % m_layout.data_max_sectors_count();
+  m_current_value_cell = a_key_index / m_layout.data_max_sectors_count();
+  m_current_sector_page = 0;
+  m_current_value_index = 0;
+  if (m_value_mirror_enabled && a_use_mirror) {
+    const value_mirror_entry_t& entry = m_value_mirror[a_key_index];
+    m_current_value = entry.value;
+    m_current_sector_page = entry.sector_page;
+    m_current_value_index = entry.value_index;
+    end_find_current_value();
+  } else if (m_value_search == value_search_t::binary) {
+    read_page(
+      get_data_sector_start_page(m_current_sector), status_t::find_current_value_binary_first
+    );
+  } else {
+    read_value_page(get_data_sector_start_page(m_current_sector));
+  }
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::end_find_current_value()
+{
+  // Действие сбрасывается заранее, так как batch_locate сразу начинает поиск следующего ключа
+  action_t action = m_action_status;
+  m_action_status = action_t::none;
+  switch (action) {
+    case action_t::none: {
+      m_status = status_t::free;
+    } break;
+    case action_t::read_value: {
+      IRS_ASSERT(mp_buf_to_save_value != nullptr);
+      *mp_buf_to_save_value = m_current_value;
+      mp_buf_to_save_value = nullptr;
+      m_status = status_t::free;
+    } break;
+    case action_t::migrate_read: {
+      m_migration_value = m_current_value;
+      const uint32_t dst = m_migration[m_migration_position].dst;
+      m_action_status = action_t::migrate_write;
+      // Ячейка позиции за концом списка не входит в зеркало
+      begin_find_current_value(dst, dst < m_keys_count);
+    } break;
+    case action_t::migrate_write: {
+      m_new_value = m_migration_value;
+      begin_write_value();
+    } break;
+    case action_t::write_value: {
+      begin_write_value();
+    } break;
+    case action_t::replace_key: {
+      read_page(m_current_key_index / m_layout.keys_per_page(), status_t::replace_key);
+    } break;
+    case action_t::batch_locate: {
+      batch_item_t& item = m_batch[m_batch_position];
+      item.key_index = m_current_key_index;
+      item.sector = m_current_sector;
+      item.sector_page = m_current_sector_page;
+      item.value_cell = m_current_value_cell;
+      item.value_index = m_current_value_index;
+      m_batch_position++;
+      batch_locate_next();
+    } break;
+  }
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+template<class InputIt>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::set_values(InputIt a_first, InputIt a_last)
+{
+  IRS_ASSERT(ready());
+  m_op_page_stats = {0, 0};
+  m_batch.clear();
+  m_batch_saved_page_writes = 0;
+  if (m_status == status_t::error) {
+    return false;
+  }
+  uint32_t new_keys_count = 0;
+  for (InputIt it = a_first; it != a_last; ++it) {
+    auto same_key = [&it](const batch_item_t& a_item) {
+      return a_item.key == it->first;
+    };
+    auto item = std::find_if(m_batch.begin(), m_batch.end(), same_key);
+    if (item != m_batch.end()) {
+      item->value = it->second;
+    } else {
+      m_batch.push_back({it->first, it->second, 0, 0, 0, 0, 0});
+      if (!has_key(it->first)) {
+        new_keys_count++;
+      }
+    }
+  }
+  if (m_keys_count + new_keys_count > m_layout.max_keys_count()) {
+    m_batch.clear();
+    return false;
+  }
+  m_batch_position = 0;
+  batch_locate_next();
+#ifdef EEPROM_SAFE_MAP_PROFILE
+  profile_begin_op(safe_map_profiler_t::op_t::batch);
+#endif
+  return true;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::batch_locate_next()
+{
+  if (m_batch_position < m_batch.size()) {
+    change_key(m_batch[m_batch_position].key, action_t::batch_locate);
+    return;
+  }
+  // Все позиции найдены. Ключи, следующая запись которых попадает в одну страницу, становятся
+  // соседними
+  std::stable_sort(
+    m_batch.begin(),
+    m_batch.end(),
+    [](const batch_item_t& a_left, const batch_item_t& a_right) {
+      if (a_left.sector != a_right.sector) {
+        return a_left.sector < a_right.sector;
+      }
+      return a_left.sector_page < a_right.sector_page;
+    }
+  );
+  uint32_t pages_count = 0;
+  for (size_t i = 0; i < m_batch.size(); ++i) {
+    if (i == 0 || m_batch[i].sector != m_batch[i - 1].sector ||
+        m_batch[i].sector_page != m_batch[i - 1].sector_page) {
+      pages_count++;
+    }
+  }
+  m_batch_saved_page_writes = m_batch.size() - pages_count;
+  m_batch_position = 0;
+  batch_write_next();
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::batch_write_next()
+{
+  if (m_batch_position < m_batch.size()) {
+    const batch_item_t& item = m_batch[m_batch_position];
+    read_page(
+      get_data_sector_start_page(item.sector) + item.sector_page, status_t::batch_write_page
+    );
+    return;
+  }
+  // Текущим становится последний записанный ключ
+  if (!m_batch.empty()) {
+    const batch_item_t& item = m_batch.back();
+    m_current_key = item.key;
+    m_current_key_index = item.key_index;
+    m_current_sector = item.sector;
+    m_current_value_cell = item.value_cell;
+    m_current_sector_page = (item.sector_page + 1) % m_layout.data_sector_size_pages();
+    m_current_value_index = (item.value_index + 1) % (m_layout.data_sector_size_pages() + 1);
+    m_current_value = item.value;
+  }
+  m_batch.clear();
+  m_status = status_t::free;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::migration_next()
+{
+  if (m_migration_position < m_migration.size()) {
+    const migration_step_t& step = m_migration[m_migration_position];
+    if (step.op == migration_step_t::op_t::copy) {
+      m_action_status = action_t::migrate_read;
+      begin_find_current_value(step.src, true);
+    } else {
+      m_status = status_t::migrate_key;
+    }
+    return;
+  }
+  m_migration.clear();
+  if (m_value_mirror_enabled) {
+    m_value_mirror.resize(m_keys_count);
+  }
+  m_key_index.clear();
+  for (uint32_t key_index = 0; key_index < m_keys_count; ++key_index) {
+    m_key_index.insert(m_keys, key_index);
+  }
+  // Позиция текущего ключа могла измениться
+  change_key(m_current_key, action_t::none);
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::migration_update_keys()
+{
+  const migration_step_t& step = m_migration[m_migration_position];
+  const uint32_t keys_per_page = m_layout.keys_per_page();
+  if (step.op == migration_step_t::op_t::copy) {
+    const K key = m_keys[step.src];
+    const uint32_t key_writes = m_wear_balance_enabled ? m_key_writes[step.src] : 0;
+    write_key(step.dst % keys_per_page, key);
+    // Ключи за концом списка хранятся в m_keys после m_keys_count, пока позиция m_keys_count не
+    // закроет разрыв
+    if (step.dst >= m_keys.size()) {
+      m_keys.resize(step.dst + 1, m_terminator_key);
+      if (m_wear_balance_enabled) {
+        m_key_writes.resize(step.dst + 1, 0);
+      }
+    }
+    m_keys[step.dst] = key;
+    if (m_wear_balance_enabled) {
+      m_key_writes[step.dst] = key_writes;
+    }
+    if (step.dst == m_keys_count) {
+      m_keys_count = static_cast<uint32_t>(m_keys.size());
+    }
+  } else {
+    write_key(step.dst % keys_per_page, m_terminator_key);
+    if (step.dst < m_keys_count) {
+      m_keys.resize(step.dst);
+      m_keys_count = step.dst;
+      if (m_wear_balance_enabled) {
+        m_key_writes.resize(step.dst);
+      }
+    }
+  }
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::plan_migration_recovery()
+{
+  m_migration.clear();
+  // Обмен не занимает последнюю позицию списка, иначе терминатор не найден и память не размечена
+  if (m_keys_count < 2 || m_keys_count + 1 > m_layout.max_keys_count()) {
+    return;
+  }
+  // Одинаковые ключи оказываются рядом в порядке позиций
+  std::vector<uint32_t> positions(m_keys_count);
+  for (uint32_t key_index = 0; key_index < m_keys_count; ++key_index) {
+    positions[key_index] = key_index;
+  }
+  std::sort(positions.begin(), positions.end(), [this](uint32_t a_left, uint32_t a_right) {
+    const int order = memcmp(&m_keys[a_left], &m_keys[a_right], sizeof(K));
+    return order != 0 ? order < 0 : a_left < a_right;
+  });
+  // Повторяться могут только ключи временных позиций tmp_b и tmp_a. Другие повторы бывают только
+  // в неразмеченной памяти до reset, и ее ключи не трогаются
+  const uint32_t tmp_b = m_keys_count - 2;
+  const uint32_t tmp_a = m_keys_count - 1;
+  const K key_b = m_keys[tmp_b];
+  const K key_a = m_keys[tmp_a];
+  if (key_a == key_b) {
+    return;
+  }
+  bool key_a_repeated = false;
+  bool key_b_repeated = false;
+  for (size_t i = 1; i < positions.size(); ++i) {
+    const K& key = m_keys[positions[i]];
+    if (!(m_keys[positions[i - 1]] == key)) {
+      continue;
+    }
+    if (key == key_a) {
+      key_a_repeated = true;
+    } else if (key == key_b) {
+      key_b_repeated = true;
+    } else {
+      return;
+    }
+  }
+  if (!key_a_repeated && !key_b_repeated) {
+    return;
+  }
+  typedef typename migration_step_t::op_t op_t;
+  // Копия a целая всегда: она пишется за концом списка. Если копия b не повторяется, то ее
+  // запись или удаление прервано, а позиции a и b целые, до или после обмена. Тогда удаляются
+  // только временные позиции
+  if (key_b_repeated) {
+    // Позиции a и b содержат key_a, key_b или прерванную запись одного из них поверх другого
+    std::vector<uint32_t> swapped;
+    for (uint32_t key_index = 0; key_index < tmp_b; ++key_index) {
+      const K& key = m_keys[key_index];
+      if (key == key_a || key == key_b || is_torn_key(key, key_a, key_b) ||
+          is_torn_key(key, key_b, key_a)) {
+        swapped.push_back(key_index);
+      }
+    }
+    if (swapped.size() != 2) {
+      return;
+    }
+    m_migration.push_back({op_t::copy, tmp_b, swapped[0]});
+    m_migration.push_back({op_t::copy, tmp_a, swapped[1]});
+  }
+  m_migration.push_back({op_t::terminate, tmp_b, tmp_b});
+  m_migration.push_back({op_t::terminate, tmp_a, tmp_a});
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::is_torn_key(
+  const K& a_key, const K& a_new, const K& a_old
+)
+{
+  if (a_key == a_new || a_key == a_old) {
+    return false;
+  }
+  const uint8_t* p_key = reinterpret_cast<const uint8_t*>(&a_key);
+  const uint8_t* p_new = reinterpret_cast<const uint8_t*>(&a_new);
+  const uint8_t* p_old = reinterpret_cast<const uint8_t*>(&a_old);
+  for (size_t split = 1; split < sizeof(K); ++split) {
+    if (memcmp(p_key, p_new, split) == 0 &&
+        memcmp(p_key + split, p_old + split, sizeof(K) - split) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::is_swap_recoverable(
+  const K& a_key_a, const K& a_key_b
+) const
+{
+  K key = a_key_a;
+  uint8_t* p_key = reinterpret_cast<uint8_t*>(&key);
+  const uint8_t* p_key_a = reinterpret_cast<const uint8_t*>(&a_key_a);
+  const uint8_t* p_key_b = reinterpret_cast<const uint8_t*>(&a_key_b);
+  // Позиции a и b: начало одного ключа обмена и конец другого
+  for (size_t split = 1; split < sizeof(K); ++split) {
+    for (int order = 0; order < 2; ++order) {
+      const uint8_t* p_new = order == 0 ? p_key_a : p_key_b;
+      const uint8_t* p_old = order == 0 ? p_key_b : p_key_a;
+      memcpy(p_key, p_new, split);
+      memcpy(p_key + split, p_old + split, sizeof(K) - split);
+      if (!(key == a_key_a) && !(key == a_key_b) && (key == m_terminator_key || has_key(key))) {
+        return false;
+      }
     }
   }
+  // Позиция tmp_b: терминатор, часть байт которого подряд заменена байтами b. Такой ключ остается
+  // и после повторно прерванного удаления при монтировании
+  for (size_t begin = 0; begin < sizeof(K); ++begin) {
+    for (size_t end = begin + 1; end <= sizeof(K); ++end) {
+      key = m_terminator_key;
+      memcpy(p_key + begin, p_key_b + begin, end - begin);
+      if (!(key == a_key_b) && !(key == m_terminator_key) && has_key(key)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::binary_search_next_page()
+{
+  if (m_search_low <= m_search_high) {
+    m_search_page = (m_search_low + m_search_high) / 2;
+    read_page(
+      get_data_sector_start_page(m_current_sector) + m_search_page,
+      status_t::find_current_value_binary
+    );
+  } else {
+    m_current_value_index =
+      (m_search_first_index + m_search_found_page + 1) % (m_layout.data_sector_size_pages() + 1);
+    m_current_sector_page = (m_search_found_page + 1) % m_layout.data_sector_size_pages();
+    end_find_current_value();
+  }
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::reset()
+{
+  m_op_page_stats = {0, 0};
+  clear_page_buffer();
+  write_key(0, m_terminator_key);
+  if (!wait_page_mem_blocking()) {
+    return;
+  }
+  // Запись символа-терминатора на первую позицию для ключей
+  mp_page->write_page(m_page_buffer.data(), m_page_offset);
+  m_op_page_stats.page_writes++;
+  if (!wait_page_mem_blocking()) {
+    return;
+  }
+  m_keys_count = 0;
+  m_keys.clear();
+  m_key_index.clear();
+  m_value_mirror.clear();
+  m_key_writes.clear();
+  // Прерванный перенос ключей и упреждающее чтение теряют смысл, операции памяти уже завершены
+  m_migration.clear();
+  m_prefetch_status = prefetch_status_t::none;
+  change_key(m_current_key, action_t::write_value);
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+uint32_t eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::get_data_sectors_count() const
+{
+  return m_layout.data_max_sectors_count();
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+uint32_t eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::get_keys_count() const
+{
+  return m_keys_count;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+uint32_t eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::get_max_keys_count() const
+{
+  return m_layout.max_keys_count();
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::get_cached_value(
+  const K& a_key, V& a_value
+) const
+{
+  uint32_t key_index = m_key_index.find(m_keys, a_key);
+  if (key_index == KeyIndex::npos) {
+    return false;
+  }
+  if (m_value_mirror_enabled) {
+    a_value = m_value_mirror[key_index].value;
+    return true;
+  }
+  if (a_key == m_current_key) {
+    a_value = m_current_value;
+    return true;
+  }
+  return false;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+K eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::get_key(uint32_t a_index) const
+{
+  IRS_ASSERT(a_index < m_keys_count);
+  return m_keys[a_index];
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+uint32_t eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::get_batch_saved_page_writes() const
+{
+  return m_batch_saved_page_writes;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+typename eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::op_page_stats_t
+eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::get_op_page_stats() const
+{
+  return m_op_page_stats;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+constexpr size_t eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::value_mirror_bytes_per_key()
+{
+  return sizeof(value_mirror_entry_t);
+}
+
+#ifdef EEPROM_SAFE_MAP_PROFILE
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+const safe_map_profiler_t& eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::get_profiler() const
+{
+  return m_profiler;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+safe_map_profiler_t& eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::get_profiler()
+{
+  return m_profiler;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+safe_map_profiler_t eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::make_profiler()
+{
+  // Порядок имен совпадает с порядком значений status_t и add_status_t
+  return safe_map_profiler_t(
+    {"free",
+     "find_current_key",
+     "add_key",
+     "add_ended",
+     "find_current_value",
+     "find_current_value_binary_first",
+     "find_current_value_binary",
+     "replace_key",
+     "replace_value",
+     "write_value",
+     "batch_write_page",
+     "batch_next_page",
+     "migrate_key",
+     "migrate_key_page",
+     "migrate_next",
+     "wait_page_mem",
+     "error"},
+    {"update_info",
+     "add_data_sector",
+     "verify_erased",
+     "check_value_cell",
+     "clear_value_cell",
+     "clear_next_page",
+     "add_key_prep",
+     "add_key",
+     "add_terminator_key"}
+  );
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+typename eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::profile_point_t
+eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::profile_begin() const
+{
+  return {m_status, m_add_status, safe_map_profiler_t::clock_type::now()};
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::profile_end(
+  const profile_point_t& a_point, uint32_t a_steps, uint32_t a_page_mem_ticks
+)
+{
+  const uint64_t ns = static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      safe_map_profiler_t::clock_type::now() - a_point.time
+    )
+      .count()
+  );
+  m_profiler.add_state(static_cast<uint32_t>(a_point.status), a_steps, a_page_mem_ticks, ns);
+  if (a_point.status == status_t::add_key) {
+    m_profiler.add_add_state(
+      static_cast<uint32_t>(a_point.add_status), a_steps, a_page_mem_ticks, ns
+    );
+  }
+  if (ready()) {
+    m_profiler.end_op();
+  }
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::profile_begin_op(
+  safe_map_profiler_t::op_t a_op
+)
+{
+  m_profiler.begin_op(a_op);
+  if (ready()) {
+    m_profiler.end_op();
+  }
+}
+#endif
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::get_keys()
+{
+  read_pages_blocking(0, m_layout.info_sector_size_pages(), [this](uint32_t /*a_page*/) {
+    for (size_t j = 0; j < m_layout.keys_per_page(); ++j) {
+      K tmp_value = read_key(j);
+      // Если найдено значение m_terminator_key, то это конец списка ключей
+      if (tmp_value == m_terminator_key) {
+        return false;
+      }
+      m_keys.emplace_back(tmp_value);
+      m_key_index.insert(m_keys, m_keys.size() - 1);
+    }
+    return true;
+  });
   m_keys_count = m_keys.size();
 }
 
-template<class K, class V>
-uint32_t eeprom_safe_map_t<K, V>::get_data_sector_start_page(uint32_t a_sector)
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::build_value_mirror()
+{
+  m_value_mirror.reserve(m_layout.max_keys_count());
+  m_value_mirror.assign(m_keys_count, {V(), 0, 0});
+  const uint32_t used_sectors_count = std::min(m_keys_count, m_layout.data_max_sectors_count());
+  for (uint32_t sector = 0; sector < used_sectors_count; ++sector) {
+    scan_sector(sector, [this](uint32_t a_key_index, const value_mirror_entry_t& a_entry) {
+      m_value_mirror[a_key_index] = a_entry;
+    });
+  }
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+template<class Handler>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::for_each_value(Handler a_handler)
+{
+  IRS_ASSERT(ready());
+  m_op_page_stats = {0, 0};
+  if (m_status == status_t::error) {
+    return;
+  }
+  const uint32_t sectors_count = m_layout.data_max_sectors_count();
+  const uint32_t used_sectors_count = std::min(m_keys_count, sectors_count);
+  for (uint32_t sector = 0; sector < used_sectors_count; ++sector) {
+    if (m_value_mirror_enabled) {
+      for (uint32_t key_index = sector; key_index < m_keys_count; key_index += sectors_count) {
+        a_handler(m_keys[key_index], m_value_mirror[key_index].value);
+      }
+    } else {
+      scan_sector(
+        sector,
+        [this, &a_handler](uint32_t a_key_index, const value_mirror_entry_t& a_entry) {
+          a_handler(m_keys[a_key_index], a_entry.value);
+        }
+      );
+    }
+  }
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+template<class Handler>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::scan_sector(
+  uint32_t a_sector, Handler a_handler
+)
 {
-  return m_info_sector_size_pages + a_sector * m_data_sector_size_pages;
+  // Тот же алгоритм, что и в состоянии find_current_value, но для всех ячеек страницы сразу.
+  // found_pages - кол-во страниц от начала сектора, составляющих непрерывную последовательность
+  // индексов ячейки
+  struct cell_scan_t
+  {
+    uint32_t key_index;
+    uint32_t found_pages;
+    value_index_t value_index;
+    bool done;
+    V value;
+  };
+  std::vector<cell_scan_t> cells;
+  for (uint32_t key_index = a_sector; key_index < m_keys_count;
+       key_index += m_layout.data_max_sectors_count()) {
+    cells.push_back({key_index, 0, 0, false, V()});
+  }
+  uint32_t active_cells_count = cells.size();
+  const uint32_t sector_size_pages = m_layout.data_sector_size_pages();
+  for (uint32_t page = 0; page < sector_size_pages && active_cells_count > 0; ++page) {
+    if (!read_page_blocking(get_data_sector_start_page(a_sector) + page)) {
+      return;
+    }
+    mark_page_state(get_data_sector_start_page(a_sector) + page, is_erased(m_page_buffer.data()));
+    for (uint32_t cell = 0; cell < cells.size(); ++cell) {
+      cell_scan_t& scan = cells[cell];
+      if (scan.done) {
+        continue;
+      }
+      value_index_t value_index = read_index(cell);
+      bool no_jump = value_index == (scan.value_index + 1) % (sector_size_pages + 1);
+      bool has_value = has_value_index(value_index);
+      if ((page == 0 || no_jump) && has_value) {
+        scan.value_index = value_index;
+        scan.found_pages = page + 1;
+        scan.value = read_value(cell);
+      } else {
+        scan.done = true;
+        active_cells_count--;
+      }
+    }
+  }
+  for (const cell_scan_t& scan : cells) {
+    value_mirror_entry_t entry = {scan.value, 0, 0};
+    if (scan.found_pages != 0) {
+      entry.sector_page = scan.found_pages % m_layout.data_sector_size_pages();
+      entry.value_index = (scan.value_index + 1) % (m_layout.data_sector_size_pages() + 1);
+    }
+    a_handler(scan.key_index, entry);
+  }
 }
 
-template<class K, class V>
-uint8_t eeprom_safe_map_t<K, V>::read_index(uint32_t a_value_cell)
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::format_data_sector()
 {
-  return *reinterpret_cast<uint8_t*>(
-    m_page_buffer.data() + m_page_size - m_bytes_per_value_index * (a_value_cell + 1)
+  const uint32_t start_page = get_data_sector_start_page(m_current_sector);
+  const uint32_t sector_size_pages = m_layout.data_sector_size_pages();
+  if (!m_burst_buffer.empty()) {
+    // Страницы с неизвестным состоянием проверяются одним чтением всего сектора
+    if (m_lazy_format && !is_page_state_known(start_page, sector_size_pages)) {
+      read_pages(start_page, sector_size_pages, status_t::add_key, add_status_t::verify_erased);
+      return;
+    }
+    // Страницы от первой до последней нестертой записываются одной операцией
+    uint32_t first_page = 0;
+    while (first_page < sector_size_pages && is_page_erased(start_page + first_page)) {
+      first_page++;
+    }
+    if (first_page == sector_size_pages) {
+      m_add_status = add_status_t::add_key_prep;
+      return;
+    }
+    uint32_t end_page = sector_size_pages;
+    while (is_page_erased(start_page + end_page - 1)) {
+      end_page--;
+    }
+    std::fill(m_burst_buffer.begin(), m_burst_buffer.end(), m_data_sector_default_value_byte);
+    for (uint32_t page = first_page; page < end_page; ++page) {
+      mark_page_state(start_page + page, true);
+    }
+    write_pages(
+      start_page + first_page,
+      end_page - first_page,
+      status_t::add_key,
+      add_status_t::add_key_prep
+    );
+    return;
+  }
+
+  while (m_current_sector_page < sector_size_pages &&
+         is_page_erased(start_page + m_current_sector_page)) {
+    m_current_sector_page++;
+  }
+  if (m_current_sector_page == sector_size_pages) {
+    m_add_status = add_status_t::add_key_prep;
+    return;
+  }
+  const uint32_t page = start_page + m_current_sector_page;
+  if (m_lazy_format && !is_page_state_known(page, 1)) {
+    read_page(page, status_t::add_key, add_status_t::verify_erased);
+    return;
+  }
+  clear_page_buffer();
+  mark_page_state(page, true);
+  m_current_sector_page++;
+  write_page(
+    page,
+    status_t::add_key,
+    m_current_sector_page == sector_size_pages ? add_status_t::add_key_prep
+                                               : add_status_t::add_data_sector
   );
 }
 
-template<class K, class V>
-void eeprom_safe_map_t<K, V>::write_index(uint32_t a_value_cell, uint8_t a_index)
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::is_erased(const uint8_t* ap_page) const
 {
-  *reinterpret_cast<uint8_t*>(
-    m_page_buffer.data() + m_page_size - m_bytes_per_value_index * (a_value_cell + 1)
-  ) = a_index;
+  for (uint32_t cell = 0; cell < m_layout.values_per_page(); ++cell) {
+    const value_index_t value_index =
+      load_index(ap_page + m_layout.page_size() - m_bytes_per_value_index * (cell + 1));
+    if (value_index != m_empty_value_index) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::is_page_erased(
+  uint32_t a_page_index
+) const
+{
+  if (!m_lazy_format) {
+    return false;
+  }
+  const uint32_t data_page = a_page_index - m_layout.info_sector_size_pages();
+  return m_known_pages[data_page] && m_erased_pages[data_page];
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::is_page_state_known(
+  uint32_t a_page_index, uint32_t a_count
+) const
+{
+  const uint32_t data_page = a_page_index - m_layout.info_sector_size_pages();
+  for (uint32_t page = data_page; page < data_page + a_count; ++page) {
+    if (!m_known_pages[page]) {
+      return false;
+    }
+  }
+  return true;
 }
 
-template<class K, class V>
-uint8_t eeprom_safe_map_t<K, V>::read_value(uint32_t a_value_cell)
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::mark_page_state(
+  uint32_t a_page_index, bool a_erased
+)
+{
+  if (!m_lazy_format) {
+    return;
+  }
+  const uint32_t data_page = a_page_index - m_layout.info_sector_size_pages();
+  m_known_pages[data_page] = true;
+  m_erased_pages[data_page] = a_erased;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+uint32_t eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::get_data_sector_start_page(
+  uint32_t a_sector
+)
+{
+  return m_layout.info_sector_size_pages() + a_sector * m_layout.data_sector_size_pages();
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+typename eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::value_index_t
+eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::load_index(const uint8_t* ap_index)
+{
+  value_index_t value_index = 0;
+  for (uint32_t i = 0; i < m_bytes_per_value_index; ++i) {
+    value_index = static_cast<value_index_t>(value_index | (ap_index[i] << (8 * i)));
+  }
+  return value_index;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+typename eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::value_index_t
+eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::read_index(uint32_t a_value_cell)
+{
+  return load_index(
+    m_page_buffer.data() + m_layout.page_size() - m_bytes_per_value_index * (a_value_cell + 1)
+  );
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::has_value_index(
+  value_index_t a_index
+) const
+{
+  return a_index <= m_layout.data_sector_size_pages();
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::write_index(
+  uint32_t a_value_cell, value_index_t a_index
+)
+{
+  uint8_t* p_index =
+    m_page_buffer.data() + m_layout.page_size() - m_bytes_per_value_index * (a_value_cell + 1);
+  for (uint32_t i = 0; i < m_bytes_per_value_index; ++i) {
+    p_index[i] = static_cast<uint8_t>(a_index >> (8 * i));
+  }
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+V eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::read_value(uint32_t a_value_cell)
 {
   return *reinterpret_cast<V*>(m_page_buffer.data() + a_value_cell * m_bytes_per_value);
 }
 
-template<class K, class V>
-void eeprom_safe_map_t<K, V>::write_value(uint32_t a_value_cell, const V& a_value)
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::write_value(
+  uint32_t a_value_cell, const V& a_value
+)
 {
-  *reinterpret_cast<uint32_t*>(m_page_buffer.data() + a_value_cell * m_bytes_per_value) = a_value;
+  *reinterpret_cast<V*>(m_page_buffer.data() + a_value_cell * m_bytes_per_value) = a_value;
 }
 
-template<class K, class V>
-K eeprom_safe_map_t<K, V>::read_key(uint32_t a_key_index)
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+K eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::read_key(uint32_t a_key_index)
 {
   return *reinterpret_cast<K*>(m_page_buffer.data() + a_key_index * m_bytes_per_key);
 }
 
-template<class K, class V>
-void eeprom_safe_map_t<K, V>::write_key(uint32_t a_key_index, const K& a_key)
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::write_key(
+  uint32_t a_key_index, const K& a_key
+)
 {
   *reinterpret_cast<K*>(m_page_buffer.data() + a_key_index * m_bytes_per_key) = a_key;
 }
 
-template<class K, class V>
-void eeprom_safe_map_t<K, V>::clear_page_buffer()
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+void eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::clear_page_buffer()
 {
   std::fill(m_page_buffer.begin(), m_page_buffer.end(), m_data_sector_default_value_byte);
 }
 
-template<class K, class V>
-bool eeprom_safe_map_t<K, V>::is_page_ready()
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::is_page_ready()
 {
   return mp_page->status() == irs_st_ready;
 }
 
-template<class K, class V>
-bool eeprom_safe_map_t<K, V>::has_key(K a_key)
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+bool eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::has_key(const K& a_key) const
 {
-  return std::find(m_keys.begin(), m_keys.end(), a_key) != m_keys.end();
+  return m_key_index.find(m_keys, a_key) != KeyIndex::npos;
+}
+
+template<class K, class V, class KeyIndex, class PageMem, class Layout>
+uint32_t eeprom_safe_map_t<K, V, KeyIndex, PageMem, Layout>::get_key_writes(const K& a_key) const
+{
+  const uint32_t key_index = m_key_index.find(m_keys, a_key);
+  if (!m_wear_balance_enabled || key_index == KeyIndex::npos) {
+    return 0;
+  }
+  return m_key_writes[key_index];
 }
 
 #endif // NOISE_GENERATOR_EEPROM_SAFE_MAP_H
@@ -0,0 +1,224 @@
+#ifndef KEY_INDEX_H
+#define KEY_INDEX_H
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+/// \brief Хэш FNV-1a по байтам ключа
+/// \details Ключи хранятся в eeprom побайтово, поэтому хэш считается по их представлению в памяти
+template<class K>
+struct key_hash_t
+{
+  uint32_t operator()(const K& a_key) const
+  {
+    uint8_t bytes[sizeof(K)];
+    memcpy(bytes, &a_key, sizeof(K));
+    uint32_t hash = 2166136261u;
+    for (uint8_t byte : bytes) {
+      hash ^= byte;
+      hash *= 16777619u;
+    }
+    return hash;
+  }
+};
+
+/// \brief Индекс ключей по умолчанию: линейный поиск по списку ключей мапы
+/// \details Не занимает памяти. Все индексы ключей имеют одинаковый интерфейс: список ключей
+/// хранит мапа, индекс только ускоряет поиск позиции ключа в этом списке
+template<class K>
+class linear_key_index_t
+{
+public:
+  static constexpr uint32_t npos = UINT32_MAX;
+
+  void init(uint32_t /*a_max_keys_count*/)
+  {
+  }
+  void clear()
+  {
+  }
+  /// \brief Добавляет в индекс ключ a_keys[a_index]
+  void insert(const std::vector<K>& /*a_keys*/, uint32_t /*a_index*/)
+  {
+  }
+  /// \brief Заменяет в индексе a_old_key на ключ a_keys[a_index]
+  void replace(const std::vector<K>& /*a_keys*/, const K& /*a_old_key*/, uint32_t /*a_index*/)
+  {
+  }
+  /// \return Позиция ключа в a_keys или npos
+  uint32_t find(const std::vector<K>& a_keys, const K& a_key) const
+  {
+    auto it = std::find(a_keys.begin(), a_keys.end(), a_key);
+    return it == a_keys.end() ? npos : static_cast<uint32_t>(std::distance(a_keys.begin(), it));
+  }
+};
+
+/// \brief Хэш-индекс ключей с открытой адресацией и линейным пробированием
+/// \details Хранит только позиции ключей в списке мапы. Если Capacity равно 0, то таблица
+/// выделяется при монтировании по максимальному кол-ву ключей мапы и увеличивается вдвое, если
+/// ключей прочитано больше. Иначе таблица размером Capacity ячеек находится внутри объекта и куча
+/// не используется. Ключи, не поместившиеся в заполненную таблицу, ищутся линейным поиском
+/// \param Capacity Кол-во ячеек таблицы, степень двойки
+template<class K, size_t Capacity = 0, class Hash = key_hash_t<K>>
+class hash_key_index_t
+{
+public:
+  static constexpr uint32_t npos = UINT32_MAX;
+
+  hash_key_index_t() :
+    m_slots(),
+    m_mask(0),
+    m_count(0),
+    m_overflow(false)
+  {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Размер таблицы должен быть степенью двойки");
+    if constexpr (Capacity > 0) {
+      m_mask = Capacity - 1;
+      clear();
+    }
+  }
+
+  void init(uint32_t a_max_keys_count)
+  {
+    // Таблица заполняется не более чем наполовину, чтобы цепочки пробирования были короткими
+    if constexpr (Capacity > 0) {
+      assert(a_max_keys_count <= Capacity / 2);
+    } else {
+      size_t capacity = 2;
+      while (capacity < 2 * static_cast<size_t>(a_max_keys_count)) {
+        capacity *= 2;
+      }
+      m_slots.assign(capacity, npos);
+      m_mask = capacity - 1;
+    }
+    m_count = 0;
+    m_overflow = false;
+  }
+
+  void clear()
+  {
+    std::fill(m_slots.begin(), m_slots.end(), npos);
+    m_count = 0;
+    m_overflow = false;
+  }
+
+  /// \brief Добавляет в индекс ключ a_keys[a_index]
+  /// \details В неразмеченной памяти мапа может прочитать больше ключей, чем максимальное кол-во.
+  /// Таблица в куче при этом увеличивается. Если в таблице внутри объекта не осталось свободных
+  /// ячеек, ключ не добавляется, а find переходит на линейный поиск
+  void insert(const std::vector<K>& a_keys, uint32_t a_index)
+  {
+    if constexpr (Capacity == 0) {
+      if (2 * (m_count + 1) > m_slots.size()) {
+        grow(a_keys);
+      }
+    }
+    if (place(a_keys[a_index], a_index)) {
+      m_count++;
+    } else {
+      m_overflow = true;
+    }
+  }
+
+  void replace(const std::vector<K>& a_keys, const K& a_old_key, uint32_t a_index)
+  {
+    erase(a_keys, a_old_key, a_index);
+    insert(a_keys, a_index);
+  }
+
+  uint32_t find(const std::vector<K>& a_keys, const K& a_key) const
+  {
+    if (m_slots.empty()) {
+      return npos;
+    }
+    size_t slot = m_hash(a_key) & m_mask;
+    // Заполненная таблица просматривается не более одного раза
+    for (size_t probe = 0; probe <= m_mask && m_slots[slot] != npos; ++probe) {
+      if (a_keys[m_slots[slot]] == a_key) {
+        return m_slots[slot];
+      }
+      slot = (slot + 1) & m_mask;
+    }
+    if (m_overflow) {
+      auto it = std::find(a_keys.begin(), a_keys.end(), a_key);
+      return it == a_keys.end() ? npos : static_cast<uint32_t>(std::distance(a_keys.begin(), it));
+    }
+    return npos;
+  }
+
+private:
+  typedef typename std::conditional<
+    Capacity == 0,
+    std::vector<uint32_t>,
+    std::array<uint32_t, Capacity>>::type slots_t;
+
+  slots_t m_slots;
+  size_t m_mask;
+  size_t m_count;
+  // Хотя бы один ключ не поместился в таблицу
+  bool m_overflow;
+  Hash m_hash;
+
+  bool place(const K& a_key, uint32_t a_index)
+  {
+    size_t slot = m_hash(a_key) & m_mask;
+    for (size_t probe = 0; probe <= m_mask; ++probe) {
+      if (m_slots[slot] == npos) {
+        m_slots[slot] = a_index;
+        return true;
+      }
+      slot = (slot + 1) & m_mask;
+    }
+    return false;
+  }
+
+  /// \brief Увеличивает таблицу вдвое и заново раскладывает позиции по хэшам ключей из a_keys
+  void grow(const std::vector<K>& a_keys)
+  {
+    slots_t slots(std::max<size_t>(2, 2 * m_slots.size()), npos);
+    m_slots.swap(slots);
+    m_mask = m_slots.size() - 1;
+    for (uint32_t index : slots) {
+      if (index != npos) {
+        place(a_keys[index], index);
+      }
+    }
+  }
+
+  /// \brief Удаляет позицию a_index, записанную под ключом a_key, со сдвигом хвоста цепочки
+  /// \details Ключ в a_keys[a_index] к этому моменту уже может быть заменен, поэтому ячейка ищется
+  /// по хэшу старого ключа и значению позиции
+  void erase(const std::vector<K>& a_keys, const K& a_key, uint32_t a_index)
+  {
+    size_t slot = m_hash(a_key) & m_mask;
+    size_t probe = 0;
+    while (m_slots[slot] != a_index) {
+      // Позиции нет в индексе, если при добавлении таблица была заполнена
+      if (m_slots.empty() || m_slots[slot] == npos || probe == m_mask) {
+        return;
+      }
+      slot = (slot + 1) & m_mask;
+      probe++;
+    }
+    size_t hole = slot;
+    size_t next = (hole + 1) & m_mask;
+    for (probe = 0; probe < m_mask && m_slots[next] != npos; ++probe) {
+      size_t home = m_hash(a_keys[m_slots[next]]) & m_mask;
+      // Элемент переносится в дыру, если его домашняя ячейка не лежит между дырой и ним
+      if (((next - home) & m_mask) >= ((next - hole) & m_mask)) {
+        m_slots[hole] = m_slots[next];
+        hole = next;
+      }
+      next = (next + 1) & m_mask;
+    }
+    m_slots[hole] = npos;
+    m_count--;
+  }
+};
+
+#endif // KEY_INDEX_H
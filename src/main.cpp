@@ -1,5 +1,6 @@
 #include <array>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
@@ -31,6 +32,15 @@ int main()
     make_eeprom(eeprom_path, page_size_bytes, pages_count);
   }
 
+  // Профиль времени эмулятора задается переменной окружения EEPROM_TIMING (legacy, fast, 24cxx,
+  // 25xx). В CI используется fast
+  page_mem_timing_t timing = page_mem_timing_t::legacy();
+  const char* p_timing_name = std::getenv("EEPROM_TIMING");
+  if (p_timing_name != nullptr && !page_mem_timing_t::by_name(p_timing_name, timing)) {
+    std::cerr << "Ошибка: неизвестный профиль времени " << p_timing_name << std::endl;
+    return 1;
+  }
+
   // page_mem_demo(eeprom_path, page_size_bytes, pages_count);
-  safe_map_demo(eeprom_path, page_size_bytes, pages_count, sector_size_pages);
+  safe_map_demo(eeprom_path, page_size_bytes, pages_count, sector_size_pages, timing);
 }
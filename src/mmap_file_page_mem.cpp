@@ -0,0 +1,185 @@
+#include "mmap_file_page_mem.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+mmap_file_page_mem::mmap_file_page_mem(
+  const std::string& a_eeprom_filename,
+  size_t a_page_count,
+  size_t a_page_size,
+  flush_policy_t a_flush_policy,
+  std::chrono::milliseconds a_flush_period
+) :
+  m_eeprom_filename(a_eeprom_filename),
+  m_page_count(a_page_count),
+  m_page_size(a_page_size),
+  m_image_size(a_page_count * a_page_size),
+  m_flush_policy(a_flush_policy),
+  m_flush_period(a_flush_period),
+  m_fd(-1),
+  mp_image(nullptr),
+  m_error(0),
+  mp_buffer(nullptr),
+  m_page_index(0),
+  m_status(status_t::ready),
+  m_dirty_pages(a_page_count, false),
+  m_dirty_pages_count(0),
+  m_last_flush(std::chrono::steady_clock::now())
+{
+  m_fd = open(m_eeprom_filename.c_str(), O_RDWR | O_CREAT, 0644);
+  if (m_fd < 0) {
+    m_error = errno;
+    return;
+  }
+  // Файл меньше образа дополняется нулями, как и при загрузке в raw_file_page_mem
+  struct stat file_stat {};
+  if (fstat(m_fd, &file_stat) != 0) {
+    m_error = errno;
+    return;
+  }
+  if (static_cast<size_t>(file_stat.st_size) < m_image_size) {
+    if (ftruncate(m_fd, static_cast<off_t>(m_image_size)) != 0) {
+      m_error = errno;
+      return;
+    }
+  }
+  void* p_map = mmap(nullptr, m_image_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (p_map == MAP_FAILED) {
+    m_error = errno;
+    return;
+  }
+  mp_image = static_cast<uint8_t*>(p_map);
+}
+
+mmap_file_page_mem::~mmap_file_page_mem()
+{
+  if (mp_image != nullptr) {
+    flush();
+    munmap(mp_image, m_image_size);
+  }
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+}
+
+void mmap_file_page_mem::read_page(uint8_t* ap_buf, uint32_t a_index)
+{
+  initialize_io_operation(ap_buf, a_index, status_t::read);
+}
+
+void mmap_file_page_mem::write_page(const uint8_t* ap_buf, uint32_t a_index)
+{
+  initialize_io_operation(const_cast<uint8_t*>(ap_buf), a_index, status_t::write);
+}
+
+size_t mmap_file_page_mem::page_size() const
+{
+  return m_page_size;
+}
+
+uint32_t mmap_file_page_mem::page_count() const
+{
+  return m_page_count;
+}
+
+bool mmap_file_page_mem::ready() const
+{
+  return m_status == status_t::ready;
+}
+
+irs_status_t mmap_file_page_mem::status() const
+{
+  if (mp_image == nullptr) {
+    return irs_st_error;
+  }
+  return m_status == status_t::ready ? irs_st_ready : irs_st_busy;
+}
+
+void mmap_file_page_mem::tick()
+{
+  switch (m_status) {
+    case status_t::ready: {
+    } break;
+    case status_t::read: {
+      memcpy(mp_buffer, mp_image + m_page_index * m_page_size, m_page_size);
+      m_status = status_t::ready;
+    } break;
+    case status_t::write: {
+      memcpy(mp_image + m_page_index * m_page_size, mp_buffer, m_page_size);
+      if (!m_dirty_pages[m_page_index]) {
+        m_dirty_pages[m_page_index] = true;
+        m_dirty_pages_count++;
+      }
+      if (m_flush_policy == flush_policy_t::per_op) {
+        flush();
+      }
+      m_status = status_t::ready;
+    } break;
+  }
+  if (m_flush_policy == flush_policy_t::periodic && m_dirty_pages_count > 0) {
+    if (std::chrono::steady_clock::now() - m_last_flush >= m_flush_period) {
+      flush();
+    }
+  }
+}
+
+int mmap_file_page_mem::error() const
+{
+  return m_error;
+}
+
+void mmap_file_page_mem::flush()
+{
+  if (mp_image == nullptr) {
+    return;
+  }
+  // Соседние грязные страницы сбрасываются одним вызовом msync
+  size_t page = 0;
+  while (m_dirty_pages_count > 0 && page < m_page_count) {
+    if (!m_dirty_pages[page]) {
+      page++;
+      continue;
+    }
+    size_t first_page = page;
+    while (page < m_page_count && m_dirty_pages[page]) {
+      m_dirty_pages[page] = false;
+      m_dirty_pages_count--;
+      page++;
+    }
+    sync_pages(first_page, page - first_page);
+  }
+  m_last_flush = std::chrono::steady_clock::now();
+}
+
+size_t mmap_file_page_mem::dirty_pages_count() const
+{
+  return m_dirty_pages_count;
+}
+
+void mmap_file_page_mem::initialize_io_operation(
+  uint8_t* ap_data, uint32_t a_index, status_t a_status
+)
+{
+  assert(a_index < m_page_count);
+
+  mp_buffer = ap_data;
+  m_page_index = a_index;
+  m_status = a_status;
+}
+
+void mmap_file_page_mem::sync_pages(size_t a_first_page, size_t a_pages_count)
+{
+  // msync требует адрес, выровненный на границу страницы виртуальной памяти
+  static const size_t vm_page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t begin = a_first_page * m_page_size;
+  size_t end = begin + a_pages_count * m_page_size;
+  size_t aligned_begin = begin - begin % vm_page_size;
+  if (msync(mp_image + aligned_begin, end - aligned_begin, MS_SYNC) != 0) {
+    m_error = errno;
+  }
+}
@@ -0,0 +1,82 @@
+#ifndef MMAP_FILE_PAGE_MEM_H
+#define MMAP_FILE_PAGE_MEM_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "raw_file_page_mem.h"
+
+/// \brief Эмуляция eeprom с помощью файла, отображенного в память (mmap)
+/// \details В отличие от raw_file_page_mem страница копируется в образ целиком за один вызов tick,
+/// а на диск сбрасываются только измененные (грязные) страницы согласно политике сброса
+class mmap_file_page_mem final : public irs::page_mem_t
+{
+public:
+  enum class flush_policy_t {
+    /// \brief msync после каждой записи страницы
+    per_op,
+    /// \brief msync всех грязных страниц не чаще, чем раз в период сброса
+    periodic,
+    /// \brief msync только в деструкторе или при явном вызове flush
+    on_destroy
+  };
+
+  /// \param a_flush_period Период сброса для политики flush_policy_t::periodic
+  explicit mmap_file_page_mem(
+    const std::string& a_eeprom_filename,
+    size_t a_page_count,
+    size_t a_page_size,
+    flush_policy_t a_flush_policy = flush_policy_t::on_destroy,
+    std::chrono::milliseconds a_flush_period = std::chrono::milliseconds(100)
+  );
+  ~mmap_file_page_mem() override;
+  mmap_file_page_mem(const mmap_file_page_mem&) = delete;
+  mmap_file_page_mem& operator=(const mmap_file_page_mem&) = delete;
+
+  typedef size_t size_type;
+  void read_page(uint8_t* ap_buf, uint32_t a_index) override;
+  void write_page(const uint8_t* ap_buf, uint32_t a_index) override;
+  [[nodiscard]] size_type page_size() const override;
+  [[nodiscard]] uint32_t page_count() const override;
+  [[nodiscard]] bool ready() const;
+  [[nodiscard]] irs_status_t status() const override;
+  void tick() override;
+  /// \return errno последней неудачной системной операции или 0
+  [[nodiscard]] int error() const;
+  /// \brief Синхронно сбрасывает все грязные страницы на диск
+  void flush();
+  [[nodiscard]] size_t dirty_pages_count() const;
+
+private:
+  enum class status_t {
+    ready,
+    write,
+    read
+  };
+
+  const std::string m_eeprom_filename;
+  const size_t m_page_count;
+  const size_t m_page_size;
+  const size_t m_image_size;
+  const flush_policy_t m_flush_policy;
+  const std::chrono::milliseconds m_flush_period;
+
+  int m_fd;
+  uint8_t* mp_image;
+  int m_error;
+
+  uint8_t* mp_buffer;
+  uint32_t m_page_index;
+  status_t m_status;
+
+  std::vector<bool> m_dirty_pages;
+  size_t m_dirty_pages_count;
+  std::chrono::steady_clock::time_point m_last_flush;
+
+  void initialize_io_operation(uint8_t* ap_data, uint32_t a_index, status_t a_status);
+  void sync_pages(size_t a_first_page, size_t a_pages_count);
+};
+
+#endif // MMAP_FILE_PAGE_MEM_H
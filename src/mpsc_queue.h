@@ -0,0 +1,65 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+/// \brief Неблокирующая очередь с несколькими производителями и одним потребителем
+/// \details Очередь Вьюкова на односвязном списке. push можно вызывать из любых потоков
+/// одновременно, pop - только из одного потока. Производители не ждут друг друга и потребителя:
+/// push - это один atomic exchange. pop может вернуть false, пока производитель находится между
+/// exchange и записью указателя next, поэтому наличие элементов отслеживается отдельно
+/// \param T Тип элемента, должен иметь конструктор по умолчанию и перемещаться
+template<class T>
+class mpsc_queue_t
+{
+public:
+  mpsc_queue_t() :
+    mp_head(new node_t()),
+    mp_tail(mp_head.load(std::memory_order_relaxed))
+  {
+  }
+  ~mpsc_queue_t()
+  {
+    T value;
+    while (pop(value)) {
+    }
+    delete mp_tail;
+  }
+  mpsc_queue_t(const mpsc_queue_t&) = delete;
+  mpsc_queue_t& operator=(const mpsc_queue_t&) = delete;
+
+  void push(T a_value)
+  {
+    node_t* p_node = new node_t();
+    p_node->value = std::move(a_value);
+    node_t* p_prev = mp_head.exchange(p_node, std::memory_order_acq_rel);
+    p_prev->next.store(p_node, std::memory_order_release);
+  }
+
+  /// \return false, если очередь пуста
+  bool pop(T& a_value)
+  {
+    node_t* p_next = mp_tail->next.load(std::memory_order_acquire);
+    if (p_next == nullptr) {
+      return false;
+    }
+    // Узел со значением становится новой заглушкой, старая заглушка удаляется
+    a_value = std::move(p_next->value);
+    delete mp_tail;
+    mp_tail = p_next;
+    return true;
+  }
+
+private:
+  struct node_t
+  {
+    std::atomic<node_t*> next{nullptr};
+    T value{};
+  };
+
+  std::atomic<node_t*> mp_head;
+  node_t* mp_tail;
+};
+
+#endif // MPSC_QUEUE_H
@@ -0,0 +1,112 @@
+#include "page_mem_bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "async_file_page_mem.h"
+#include "mmap_file_page_mem.h"
+#include "raw_file_page_mem.h"
+
+namespace {
+
+/// \brief Ожидание готовности памяти с измерением самого долгого вызова tick
+void wait_page_mem(irs::page_mem_t& a_page_mem, std::chrono::nanoseconds& a_max_tick)
+{
+  while (a_page_mem.status() == irs_st_busy) {
+    const auto tick_start = std::chrono::steady_clock::now();
+    a_page_mem.tick();
+    a_max_tick = std::max<std::chrono::nanoseconds>(
+      a_max_tick, std::chrono::steady_clock::now() - tick_start
+    );
+  }
+}
+
+void run_page_mem_bench(const std::string& a_name, irs::page_mem_t& a_page_mem, uint32_t a_rounds)
+{
+  const uint32_t pages_count = a_page_mem.page_count();
+  std::vector<uint8_t> buf(a_page_mem.page_size());
+  std::chrono::nanoseconds max_tick(0);
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t round = 0; round < a_rounds; ++round) {
+    for (uint32_t i = 0; i < pages_count; ++i) {
+      memset(buf.data(), static_cast<uint8_t>(round + i), buf.size());
+      a_page_mem.write_page(buf.data(), i);
+      wait_page_mem(a_page_mem, max_tick);
+    }
+  }
+  auto write_end = std::chrono::steady_clock::now();
+  for (uint32_t round = 0; round < a_rounds; ++round) {
+    for (uint32_t i = 0; i < pages_count; ++i) {
+      a_page_mem.read_page(buf.data(), i);
+      wait_page_mem(a_page_mem, max_tick);
+    }
+  }
+  auto read_end = std::chrono::steady_clock::now();
+
+  const double pages = static_cast<double>(pages_count) * a_rounds;
+  const double write_s = std::chrono::duration<double>(write_end - start).count();
+  const double read_s = std::chrono::duration<double>(read_end - write_end).count();
+  std::cout << std::left << std::setw(24) << a_name << std::right << std::setw(14)
+            << static_cast<uint64_t>(pages / write_s) << std::setw(14)
+            << static_cast<uint64_t>(pages / read_s) << std::setw(14)
+            << std::chrono::duration<double, std::micro>(max_tick).count() << std::endl;
+}
+
+} // namespace
+
+void page_mem_bench(
+  const std::string& a_eeprom_path,
+  uint32_t a_page_size_bytes,
+  uint32_t a_pages_count,
+  uint32_t a_rounds
+)
+{
+  const std::string raw_path = a_eeprom_path + ".bench_raw";
+  const std::string mmap_path = a_eeprom_path + ".bench_mmap";
+  const std::string async_path = a_eeprom_path + ".bench_async";
+
+  std::cout << "page_size=" << a_page_size_bytes << " pages_count=" << a_pages_count
+            << " rounds=" << a_rounds << std::endl;
+  std::cout << std::left << std::setw(24) << "backend" << std::right << std::setw(14)
+            << "write pg/s" << std::setw(14) << "read pg/s" << std::setw(14) << "max tick us"
+            << std::endl;
+  {
+    raw_file_page_mem page_mem(raw_path, a_pages_count, a_page_size_bytes);
+    run_page_mem_bench("raw_file", page_mem, a_rounds);
+  }
+  {
+    mmap_file_page_mem page_mem(
+      mmap_path, a_pages_count, a_page_size_bytes, mmap_file_page_mem::flush_policy_t::per_op
+    );
+    run_page_mem_bench("mmap_file per_op", page_mem, a_rounds);
+  }
+  {
+    mmap_file_page_mem page_mem(
+      mmap_path, a_pages_count, a_page_size_bytes, mmap_file_page_mem::flush_policy_t::periodic
+    );
+    run_page_mem_bench("mmap_file periodic", page_mem, a_rounds);
+  }
+  {
+    mmap_file_page_mem page_mem(
+      mmap_path, a_pages_count, a_page_size_bytes, mmap_file_page_mem::flush_policy_t::on_destroy
+    );
+    run_page_mem_bench("mmap_file on_destroy", page_mem, a_rounds);
+  }
+  {
+    async_file_page_mem page_mem(async_path, a_pages_count, a_page_size_bytes);
+    run_page_mem_bench("async_file", page_mem, a_rounds);
+  }
+  {
+    async_file_page_mem page_mem(async_path, a_pages_count, a_page_size_bytes, true);
+    run_page_mem_bench("async_file fdatasync", page_mem, a_rounds);
+  }
+  std::remove(raw_path.c_str());
+  std::remove(mmap_path.c_str());
+  std::remove(async_path.c_str());
+}
@@ -0,0 +1,19 @@
+#ifndef PAGE_MEM_BENCH_H
+#define PAGE_MEM_BENCH_H
+
+#include <cstdint>
+#include <string>
+
+/// \brief Сравнение пропускной способности raw_file_page_mem, mmap_file_page_mem и
+/// async_file_page_mem
+/// \details Каждый бэкенд записывает и читает все страницы образа a_rounds раз. Кроме страниц в
+/// секунду выводится самый долгий вызов tick: столько ждет поток, обслуживающий память. Образы
+/// создаются во временных файлах рядом с a_eeprom_path
+void page_mem_bench(
+  const std::string& a_eeprom_path,
+  uint32_t a_page_size_bytes,
+  uint32_t a_pages_count,
+  uint32_t a_rounds
+);
+
+#endif // PAGE_MEM_BENCH_H
@@ -0,0 +1,185 @@
+#include "page_mem_stats.h"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+page_mem_stats_t::page_mem_stats_t(irs::page_mem_t* ap_page) :
+  mp_page(ap_page),
+  m_stats()
+{
+  reset();
+}
+
+void page_mem_stats_t::read_page(uint8_t* ap_buf, unsigned int a_index)
+{
+  assert(a_index < m_stats.page_reads.size());
+  m_stats.page_reads[a_index]++;
+  m_stats.bytes_read += mp_page->page_size();
+  mp_page->read_page(ap_buf, a_index);
+}
+
+void page_mem_stats_t::write_page(const uint8_t* ap_buf, unsigned int a_index)
+{
+  assert(a_index < m_stats.page_writes.size());
+  m_stats.page_writes[a_index]++;
+  m_stats.bytes_written += mp_page->page_size();
+  mp_page->write_page(ap_buf, a_index);
+}
+
+page_mem_stats_t::size_type page_mem_stats_t::page_size() const
+{
+  return mp_page->page_size();
+}
+
+unsigned int page_mem_stats_t::page_count() const
+{
+  return mp_page->page_count();
+}
+
+irs_status_t page_mem_stats_t::status() const
+{
+  return mp_page->status();
+}
+
+void page_mem_stats_t::tick()
+{
+  m_stats.ticks++;
+  if (mp_page->status() == irs_st_busy) {
+    m_stats.busy_ticks++;
+  }
+  mp_page->tick();
+}
+
+bool page_mem_stats_t::supports_partial_write() const
+{
+  return mp_page->supports_partial_write();
+}
+
+void page_mem_stats_t::write_bytes(
+  const uint8_t* ap_buf, unsigned int a_index, size_type a_offset, size_type a_size
+)
+{
+  assert(a_index < m_stats.page_writes.size());
+  m_stats.page_writes[a_index]++;
+  m_stats.bytes_written += a_size;
+  mp_page->write_bytes(ap_buf, a_index, a_offset, a_size);
+}
+
+bool page_mem_stats_t::supports_burst() const
+{
+  return mp_page->supports_burst();
+}
+
+void page_mem_stats_t::read_pages(uint8_t* ap_buf, unsigned int a_index, unsigned int a_count)
+{
+  assert(a_index + a_count <= m_stats.page_reads.size());
+  for (unsigned int i = 0; i < a_count; ++i) {
+    m_stats.page_reads[a_index + i]++;
+  }
+  m_stats.bytes_read += a_count * mp_page->page_size();
+  mp_page->read_pages(ap_buf, a_index, a_count);
+}
+
+void page_mem_stats_t::write_pages(
+  const uint8_t* ap_buf, unsigned int a_index, unsigned int a_count
+)
+{
+  assert(a_index + a_count <= m_stats.page_writes.size());
+  for (unsigned int i = 0; i < a_count; ++i) {
+    m_stats.page_writes[a_index + i]++;
+  }
+  m_stats.bytes_written += a_count * mp_page->page_size();
+  mp_page->write_pages(ap_buf, a_index, a_count);
+}
+
+unsigned int page_mem_stats_t::queue_depth() const
+{
+  return mp_page->queue_depth();
+}
+
+unsigned int page_mem_stats_t::pending_ops() const
+{
+  return mp_page->pending_ops();
+}
+
+uint64_t page_mem_stats_t::page_reads(unsigned int a_index) const
+{
+  return m_stats.page_reads[a_index];
+}
+
+uint64_t page_mem_stats_t::page_writes(unsigned int a_index) const
+{
+  return m_stats.page_writes[a_index];
+}
+
+uint64_t page_mem_stats_t::total_reads() const
+{
+  return std::accumulate(m_stats.page_reads.begin(), m_stats.page_reads.end(), uint64_t(0));
+}
+
+uint64_t page_mem_stats_t::total_writes() const
+{
+  return std::accumulate(m_stats.page_writes.begin(), m_stats.page_writes.end(), uint64_t(0));
+}
+
+std::vector<page_mem_stats_t::sector_stats_t> page_mem_stats_t::sector_stats(
+  unsigned int a_first_page, unsigned int a_sector_size_pages, unsigned int a_sectors_count
+) const
+{
+  assert(a_first_page + a_sector_size_pages * a_sectors_count <= m_stats.page_writes.size());
+  std::vector<sector_stats_t> sectors(a_sectors_count);
+  for (unsigned int sector = 0; sector < a_sectors_count; ++sector) {
+    auto first = a_first_page + sector * a_sector_size_pages;
+    auto reads_begin = m_stats.page_reads.begin() + first;
+    auto writes_begin = m_stats.page_writes.begin() + first;
+    auto writes_end = writes_begin + a_sector_size_pages;
+    sector_stats_t& stats = sectors[sector];
+    stats.reads = std::accumulate(reads_begin, reads_begin + a_sector_size_pages, uint64_t(0));
+    stats.writes = std::accumulate(writes_begin, writes_end, uint64_t(0));
+    stats.min_page_writes = *std::min_element(writes_begin, writes_end);
+    stats.max_page_writes = *std::max_element(writes_begin, writes_end);
+  }
+  return sectors;
+}
+
+page_mem_stats_t::snapshot_t page_mem_stats_t::snapshot() const
+{
+  return m_stats;
+}
+
+void page_mem_stats_t::reset()
+{
+  m_stats.page_reads.assign(mp_page->page_count(), 0);
+  m_stats.page_writes.assign(mp_page->page_count(), 0);
+  m_stats.bytes_read = 0;
+  m_stats.bytes_written = 0;
+  m_stats.ticks = 0;
+  m_stats.busy_ticks = 0;
+}
+
+void page_mem_stats_t::dump_json(std::ostream& a_stream) const
+{
+  auto dump_array = [&a_stream](const std::vector<uint64_t>& a_values) {
+    a_stream << "[";
+    for (size_t i = 0; i < a_values.size(); ++i) {
+      a_stream << (i == 0 ? "" : ",") << a_values[i];
+    }
+    a_stream << "]";
+  };
+  a_stream << "{\"bytes_read\":" << m_stats.bytes_read
+           << ",\"bytes_written\":" << m_stats.bytes_written << ",\"ticks\":" << m_stats.ticks
+           << ",\"busy_ticks\":" << m_stats.busy_ticks << ",\"page_reads\":";
+  dump_array(m_stats.page_reads);
+  a_stream << ",\"page_writes\":";
+  dump_array(m_stats.page_writes);
+  a_stream << "}" << std::endl;
+}
+
+void page_mem_stats_t::dump_csv(std::ostream& a_stream) const
+{
+  a_stream << "page,reads,writes" << std::endl;
+  for (size_t i = 0; i < m_stats.page_reads.size(); ++i) {
+    a_stream << i << "," << m_stats.page_reads[i] << "," << m_stats.page_writes[i] << std::endl;
+  }
+}
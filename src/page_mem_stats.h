@@ -0,0 +1,74 @@
+#ifndef PAGE_MEM_STATS_H
+#define PAGE_MEM_STATS_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "raw_file_page_mem.h"
+
+/// \brief Обертка над любой страничной памятью, считающая обращения к страницам
+/// \details Считает чтения и записи каждой страницы, переданные байты и тики, в течение которых
+/// память была занята. Счетчики можно сохранить (snapshot), сбросить (reset) и вывести в JSON или
+/// CSV. По счетчикам записей страниц можно оценить износ eeprom
+class page_mem_stats_t : public irs::page_mem_t
+{
+public:
+  struct snapshot_t
+  {
+    std::vector<uint64_t> page_reads;
+    std::vector<uint64_t> page_writes;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t ticks;
+    uint64_t busy_ticks;
+  };
+
+  /// \brief Суммарные счетчики страниц сектора
+  struct sector_stats_t
+  {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t min_page_writes;
+    uint64_t max_page_writes;
+  };
+
+  explicit page_mem_stats_t(irs::page_mem_t* ap_page);
+
+  void read_page(uint8_t* ap_buf, unsigned int a_index) override;
+  void write_page(const uint8_t* ap_buf, unsigned int a_index) override;
+  [[nodiscard]] size_type page_size() const override;
+  [[nodiscard]] unsigned int page_count() const override;
+  [[nodiscard]] irs_status_t status() const override;
+  void tick() override;
+  [[nodiscard]] bool supports_partial_write() const override;
+  /// \details Запись части страницы считается записью страницы
+  void write_bytes(
+    const uint8_t* ap_buf, unsigned int a_index, size_type a_offset, size_type a_size
+  ) override;
+  [[nodiscard]] bool supports_burst() const override;
+  void read_pages(uint8_t* ap_buf, unsigned int a_index, unsigned int a_count) override;
+  void write_pages(const uint8_t* ap_buf, unsigned int a_index, unsigned int a_count) override;
+  [[nodiscard]] unsigned int queue_depth() const override;
+  [[nodiscard]] unsigned int pending_ops() const override;
+
+  [[nodiscard]] uint64_t page_reads(unsigned int a_index) const;
+  [[nodiscard]] uint64_t page_writes(unsigned int a_index) const;
+  [[nodiscard]] uint64_t total_reads() const;
+  [[nodiscard]] uint64_t total_writes() const;
+  /// \brief Счетчики секторов, лежащих подряд начиная со страницы a_first_page
+  [[nodiscard]] std::vector<sector_stats_t> sector_stats(
+    unsigned int a_first_page, unsigned int a_sector_size_pages, unsigned int a_sectors_count
+  ) const;
+  [[nodiscard]] snapshot_t snapshot() const;
+  void reset();
+  void dump_json(std::ostream& a_stream) const;
+  /// \details Одна строка на страницу: page,reads,writes
+  void dump_csv(std::ostream& a_stream) const;
+
+private:
+  irs::page_mem_t* mp_page;
+  snapshot_t m_stats;
+};
+
+#endif // PAGE_MEM_STATS_H
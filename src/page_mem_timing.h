@@ -0,0 +1,87 @@
+#ifndef PAGE_MEM_TIMING_H
+#define PAGE_MEM_TIMING_H
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+/// \brief Профиль временных характеристик эмулируемой микросхемы eeprom
+/// \details Один tick эмулятора соответствует tick_duration_us моделируемых микросекунд. За один
+/// tick по шине передается bytes_per_tick байт
+struct page_mem_timing_t
+{
+  /// \brief Кол-во байт, передаваемых за один tick
+  uint32_t bytes_per_tick = 1;
+  /// \brief Кол-во тиков между запросом чтения и передачей первого байта (команда и адрес)
+  uint32_t read_latency_ticks = 0;
+  /// \brief Кол-во тиков, в течение которых микросхема занята внутренним циклом записи страницы
+  uint32_t write_cycle_ticks = 0;
+  /// \brief Быстрый режим: страница передается за один tick, задержки не учитываются
+  bool full_page_per_tick = false;
+  /// \brief Длительность одного tick в моделируемых микросекундах
+  double tick_duration_us = 1.0;
+
+  /// \brief Поведение эмулятора без модели времени: 1 байт за tick, без задержек
+  static page_mem_timing_t legacy()
+  {
+    return page_mem_timing_t();
+  }
+
+  /// \brief Быстрый режим для CI
+  static page_mem_timing_t fast()
+  {
+    page_mem_timing_t timing;
+    timing.full_page_per_tick = true;
+    return timing;
+  }
+
+  /// \brief Профиль, заданный в микросекундах. Задержки округляются вверх до целого числа тиков
+  static page_mem_timing_t from_us(
+    uint32_t a_bytes_per_tick,
+    double a_tick_duration_us,
+    double a_read_latency_us,
+    double a_write_cycle_us
+  )
+  {
+    page_mem_timing_t timing;
+    timing.bytes_per_tick = a_bytes_per_tick;
+    timing.tick_duration_us = a_tick_duration_us;
+    timing.read_latency_ticks = static_cast<uint32_t>(ceil(a_read_latency_us / a_tick_duration_us));
+    timing.write_cycle_ticks = static_cast<uint32_t>(ceil(a_write_cycle_us / a_tick_duration_us));
+    return timing;
+  }
+
+  /// \brief 24Cxx на шине I2C 400 кГц: 9 бит на байт (22.5 мкс), 3 байта адресации перед чтением,
+  /// цикл записи страницы 5 мс
+  static page_mem_timing_t at24cxx()
+  {
+    return from_us(1, 22.5, 3 * 22.5, 5000);
+  }
+
+  /// \brief 25xx на шине SPI 5 МГц: 1.6 мкс на байт, команда и 2 байта адреса перед чтением,
+  /// цикл записи страницы 5 мс
+  static page_mem_timing_t at25xxx()
+  {
+    return from_us(1, 1.6, 3 * 1.6, 5000);
+  }
+
+  /// \brief Профиль по имени: legacy, fast, 24cxx, 25xx
+  /// \return false, если имя неизвестно
+  static bool by_name(const std::string& a_name, page_mem_timing_t& a_timing)
+  {
+    if (a_name == "legacy") {
+      a_timing = legacy();
+    } else if (a_name == "fast") {
+      a_timing = fast();
+    } else if (a_name == "24cxx") {
+      a_timing = at24cxx();
+    } else if (a_name == "25xx") {
+      a_timing = at25xxx();
+    } else {
+      return false;
+    }
+    return true;
+  }
+};
+
+#endif // PAGE_MEM_TIMING_H
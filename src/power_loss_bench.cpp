@@ -0,0 +1,426 @@
+#include "power_loss_bench.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "eeprom_safe_map.h"
+#include "ram_page_mem.h"
+
+namespace {
+
+using crash_key_t = std::array<uint8_t, 4>;
+using crash_map_t = eeprom_safe_map_t<crash_key_t, uint32_t>;
+using model_t = std::map<crash_key_t, uint32_t>;
+
+const crash_key_t default_key = {0, 0, 0, 0};
+const crash_key_t terminator_key = {0x7f, 0x7f, 0x7f, 0x7f};
+// Кол-во ключей, с которыми работает сценарий, не считая ключа по умолчанию. Ключей больше, чем
+// секторов данных, иначе rebalance нечего обменивать
+const uint32_t workload_keys_count = 8;
+const uint32_t workload_ops_count = 48;
+// Кол-во ошибок на геометрию, которые выводятся подробно
+const uint32_t reported_failures_count = 5;
+
+struct geometry_t
+{
+  uint32_t page_size_bytes;
+  uint32_t sector_size_pages;
+  uint32_t pages_count;
+};
+
+struct op_t
+{
+  enum class type_t {
+    set_value,
+    replace_key,
+    set_values,
+    rebalance
+  };
+  type_t type;
+  /// \brief Для replace_key - заменяемый ключ
+  crash_key_t old_key;
+  /// \brief Записываемые пары. Для set_value и replace_key - одна пара, для rebalance - пусто
+  std::vector<std::pair<crash_key_t, uint32_t>> items;
+};
+
+/// \brief Класс ошибки после прерывания операции
+/// \details Известные классы появляются при добавлении и замене ключа, которые пишут ключ раньше
+/// значения и ключ вместе с терминатором одной записью страницы. Они считаются отдельно, чтобы
+/// ошибки остальных операций, в т. ч. обмена ключей rebalance, не терялись среди них
+enum class failure_t {
+  none,
+  /// \brief Лишний ключ во время добавления ключа: прерванная запись страницы оставила смесь байт
+  /// нового ключа и терминатора или стертые байты за ним
+  torn_new_key,
+  /// \brief Новый ключ replace_key со значением заменяемого ключа: значение еще не записано
+  replaced_key_value,
+  other
+};
+const size_t failure_classes_count = 4;
+
+/// \brief Результат проверки точки прерывания
+struct crash_result_t
+{
+  failure_t failure;
+  std::string error;
+};
+
+/// \brief Сценарий и состояния мапы между его операциями
+struct workload_t
+{
+  std::vector<uint8_t> base_image;
+  std::vector<op_t> ops;
+  /// \brief states[i] - содержимое мапы перед операцией i, states.back() - после сценария
+  std::vector<model_t> states;
+  /// \brief Кол-во тиков сценария к моменту завершения операции i
+  std::vector<uint64_t> op_end_ticks;
+  /// \brief Кол-во вызовов rebalance, начавших обмен ключей
+  uint32_t swaps_count;
+};
+
+std::string key_to_string(const crash_key_t& a_key)
+{
+  std::ostringstream stream;
+  stream << std::hex << std::setfill('0');
+  for (uint8_t byte : a_key) {
+    stream << std::setw(2) << static_cast<uint32_t>(byte);
+  }
+  return stream.str();
+}
+
+void wait_safe_map(crash_map_t& a_safe_map)
+{
+  while (!a_safe_map.ready()) {
+    a_safe_map.tick();
+  }
+}
+
+std::unique_ptr<crash_map_t> mount(ram_page_mem& a_page_mem, const geometry_t& a_geometry)
+{
+  // Обмен начинается при любом перекосе записей по секторам
+  eeprom_safe_map_config_t config;
+  config.wear_balance = true;
+  config.wear_imbalance_ratio = 1.0f;
+  std::unique_ptr<crash_map_t> p_map(new crash_map_t(
+    &a_page_mem,
+    0,
+    a_geometry.pages_count,
+    a_geometry.sector_size_pages,
+    default_key,
+    terminator_key,
+    config
+  ));
+  wait_safe_map(*p_map);
+  return p_map;
+}
+
+model_t read_map_state(crash_map_t& a_safe_map)
+{
+  model_t state;
+  for (uint32_t i = 0; i < a_safe_map.get_keys_count(); ++i) {
+    const crash_key_t key = a_safe_map.get_key(i);
+    uint32_t value = 0;
+    a_safe_map.get_value(key, value);
+    wait_safe_map(a_safe_map);
+    state[key] = value;
+  }
+  return state;
+}
+
+/// \return false, если rebalance не начал обмен ключей
+bool issue_op(crash_map_t& a_safe_map, const op_t& a_op)
+{
+  switch (a_op.type) {
+    case op_t::type_t::set_value: {
+      a_safe_map.set_value(a_op.items[0].first, a_op.items[0].second);
+    } break;
+    case op_t::type_t::replace_key: {
+      uint32_t value = a_op.items[0].second;
+      a_safe_map.replace_key(a_op.old_key, a_op.items[0].first, value);
+    } break;
+    case op_t::type_t::set_values: {
+      a_safe_map.set_values(a_op.items.begin(), a_op.items.end());
+    } break;
+    case op_t::type_t::rebalance: {
+      return a_safe_map.rebalance();
+    }
+  }
+  return true;
+}
+
+/// \brief Случайный сценарий, не превышающий максимальное кол-во ключей мапы
+std::vector<op_t> make_ops(const model_t& a_initial_state, uint32_t a_max_keys_count)
+{
+  std::mt19937 random(12345);
+  model_t state = a_initial_state;
+  std::vector<op_t> ops;
+  uint32_t next_value = 1;
+  const uint32_t keys_count = std::min(workload_keys_count, a_max_keys_count - 1);
+  auto pool_key = [&random, keys_count]() {
+    return crash_key_t{static_cast<uint8_t>(1 + random() % keys_count), 0, 0, 0};
+  };
+  auto fits = [&state, a_max_keys_count](const crash_key_t& a_key) {
+    return state.count(a_key) > 0 || state.size() + 1 <= a_max_keys_count;
+  };
+
+  while (ops.size() < workload_ops_count) {
+    op_t op{op_t::type_t::set_value, default_key, {}};
+    const uint32_t kind = random() % 10;
+    if (kind == 9) {
+      // Счетчики записей в ОЗУ одинаковы при каждом выполнении сценария, поэтому обмен тоже
+      op.type = op_t::type_t::rebalance;
+    } else if (kind < 3) {
+      // Новый ключ на место существующего. Ключ по умолчанию не заменяется: при монтировании
+      // мапа добавляет его заново
+      crash_key_t new_key = pool_key();
+      auto old_it = state.begin();
+      std::advance(old_it, random() % state.size());
+      if (state.count(new_key) > 0 || old_it->first == default_key) {
+        continue;
+      }
+      op.type = op_t::type_t::replace_key;
+      op.old_key = old_it->first;
+      op.items.push_back({new_key, next_value++});
+      state.erase(old_it);
+      state[new_key] = op.items[0].second;
+    } else if (kind < 5) {
+      op.type = op_t::type_t::set_values;
+      model_t batch_state = state;
+      const uint32_t items_count = 2 + random() % 2;
+      for (uint32_t i = 0; i < items_count; ++i) {
+        crash_key_t key = pool_key();
+        if (batch_state.count(key) == 0 && batch_state.size() + 1 > a_max_keys_count) {
+          continue;
+        }
+        op.items.push_back({key, next_value++});
+        batch_state[key] = op.items.back().second;
+      }
+      state = batch_state;
+    } else {
+      crash_key_t key = pool_key();
+      if (!fits(key)) {
+        continue;
+      }
+      op.items.push_back({key, next_value++});
+      state[key] = op.items[0].second;
+    }
+    ops.push_back(op);
+  }
+  return ops;
+}
+
+/// \brief Форматирование образа, генерация сценария и его выполнение без прерываний
+workload_t make_workload(const geometry_t& a_geometry)
+{
+  workload_t workload;
+  workload.swaps_count = 0;
+  ram_page_mem format_page_mem(a_geometry.pages_count, a_geometry.page_size_bytes);
+  std::unique_ptr<crash_map_t> p_map = mount(format_page_mem, a_geometry);
+  p_map->reset();
+  wait_safe_map(*p_map);
+  workload.base_image = format_page_mem.image();
+
+  ram_page_mem page_mem(workload.base_image, a_geometry.page_size_bytes);
+  p_map = mount(page_mem, a_geometry);
+  model_t state = read_map_state(*p_map);
+  p_map = mount(page_mem, a_geometry);
+  workload.ops = make_ops(state, p_map->get_max_keys_count());
+  workload.states.push_back(state);
+
+  const uint64_t start_ticks = page_mem.elapsed_ticks();
+  for (const op_t& op : workload.ops) {
+    if (issue_op(*p_map, op) && op.type == op_t::type_t::rebalance) {
+      workload.swaps_count++;
+    }
+    wait_safe_map(*p_map);
+    workload.op_end_ticks.push_back(page_mem.elapsed_ticks() - start_ticks);
+    if (op.type == op_t::type_t::replace_key) {
+      state.erase(op.old_key);
+    }
+    for (const auto& item : op.items) {
+      state[item.first] = item.second;
+    }
+    workload.states.push_back(state);
+  }
+  return workload;
+}
+
+/// \brief Проверка смонтированного после прерывания операции a_op состояния
+/// \details Каждый ключ должен иметь значение до или после операции. Ключ, добавляемый
+/// операцией, может отсутствовать или иметь значение по умолчанию, если питание пропало между
+/// записью ключа и записью значения. Класс ошибки известный, только если известны все ошибки
+/// ключей
+crash_result_t verify(
+  const model_t& a_mounted, const op_t& a_op, const model_t& a_before, const model_t& a_after
+)
+{
+  std::ostringstream error;
+  failure_t failure = failure_t::none;
+  auto add_failure = [&failure](failure_t a_failure) {
+    failure = std::max(failure, a_failure);
+  };
+  bool adds_key = false;
+  for (const auto& item : a_op.items) {
+    adds_key = adds_key || a_before.count(item.first) == 0;
+  }
+  for (const auto& [key, value] : a_mounted) {
+    auto before = a_before.find(key);
+    auto after = a_after.find(key);
+    const bool old_value = before != a_before.end() && before->second == value;
+    const bool new_value = after != a_after.end() && after->second == value;
+    const bool empty_new_key = before == a_before.end() && after != a_after.end() && value == 0;
+    if (old_value || new_value || empty_new_key) {
+      continue;
+    }
+    error << "key " << key_to_string(key) << " has unexpected value " << value << "; ";
+    auto replaced = a_before.find(a_op.old_key);
+    if (adds_key && before == a_before.end() && after == a_after.end()) {
+      add_failure(failure_t::torn_new_key);
+    } else if (a_op.type == op_t::type_t::replace_key && key == a_op.items[0].first &&
+               replaced != a_before.end() && replaced->second == value) {
+      add_failure(failure_t::replaced_key_value);
+    } else {
+      add_failure(failure_t::other);
+    }
+  }
+  for (const auto& [key, value] : a_before) {
+    if (a_after.count(key) > 0 && a_mounted.count(key) == 0) {
+      error << "key " << key_to_string(key) << " lost; ";
+      add_failure(failure_t::other);
+    }
+  }
+  return {failure, error.str()};
+}
+
+/// \brief Выполняет сценарий до a_crash_tick, монтирует мапу заново и проверяет ее содержимое
+crash_result_t run_crash_point(
+  const geometry_t& a_geometry, const workload_t& a_workload, uint64_t a_crash_tick
+)
+{
+  ram_page_mem page_mem(a_workload.base_image, a_geometry.page_size_bytes);
+  std::unique_ptr<crash_map_t> p_map = mount(page_mem, a_geometry);
+  const uint64_t start_ticks = page_mem.elapsed_ticks();
+  size_t op_index = 0;
+  bool crashed = false;
+  for (; op_index < a_workload.ops.size() && !crashed; ++op_index) {
+    issue_op(*p_map, a_workload.ops[op_index]);
+    while (!p_map->ready()) {
+      if (page_mem.elapsed_ticks() - start_ticks >= a_crash_tick) {
+        crashed = true;
+        break;
+      }
+      p_map->tick();
+    }
+  }
+  if (!crashed) {
+    return {failure_t::other, "workload ended before crash tick"};
+  }
+  op_index--;
+
+  page_mem.power_cycle();
+  p_map = mount(page_mem, a_geometry);
+  crash_result_t result = verify(
+    read_map_state(*p_map),
+    a_workload.ops[op_index],
+    a_workload.states[op_index],
+    a_workload.states[op_index + 1]
+  );
+  if (result.failure != failure_t::none) {
+    result.error = "tick " + std::to_string(a_crash_tick) + ", op " + std::to_string(op_index) +
+                   ": " + result.error;
+  }
+  return result;
+}
+
+void bench_geometry(const geometry_t& a_geometry, uint32_t a_crash_points_count)
+{
+  const workload_t workload = make_workload(a_geometry);
+  const uint64_t workload_ticks = workload.op_end_ticks.back();
+
+  std::vector<uint64_t> crash_ticks;
+  if (a_crash_points_count == 0 || a_crash_points_count >= workload_ticks) {
+    for (uint64_t tick = 0; tick < workload_ticks; ++tick) {
+      crash_ticks.push_back(tick);
+    }
+  } else {
+    std::mt19937_64 random(a_geometry.pages_count);
+    for (uint32_t i = 0; i < a_crash_points_count; ++i) {
+      crash_ticks.push_back(random() % workload_ticks);
+    }
+  }
+
+  std::atomic<size_t> next_point(0);
+  std::array<std::atomic<uint64_t>, failure_classes_count> failures_counts{};
+  std::mutex failures_mutex;
+  // Подробно выводятся только ошибки неизвестного класса
+  std::vector<std::string> failures;
+  auto worker = [&]() {
+    for (size_t i = next_point.fetch_add(1); i < crash_ticks.size(); i = next_point.fetch_add(1)) {
+      crash_result_t result = run_crash_point(a_geometry, workload, crash_ticks[i]);
+      failures_counts[static_cast<size_t>(result.failure)].fetch_add(1);
+      if (result.failure == failure_t::other) {
+        std::lock_guard<std::mutex> lock(failures_mutex);
+        if (failures.size() < reported_failures_count) {
+          failures.push_back(std::move(result.error));
+        }
+      }
+    }
+  };
+
+  const uint32_t threads_count = std::max(1u, std::thread::hardware_concurrency());
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < threads_count; ++i) {
+    threads.emplace_back(worker);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                           .count();
+
+  std::cout << std::setw(6) << a_geometry.page_size_bytes << std::setw(8)
+            << a_geometry.sector_size_pages << std::setw(8) << a_geometry.pages_count
+            << std::setw(10) << workload_ticks << std::setw(8) << workload.swaps_count
+            << std::setw(10) << crash_ticks.size()
+            << std::setw(10) << failures_counts[static_cast<size_t>(failure_t::torn_new_key)]
+            << std::setw(10)
+            << failures_counts[static_cast<size_t>(failure_t::replaced_key_value)]
+            << std::setw(10) << failures_counts[static_cast<size_t>(failure_t::other)]
+            << std::setw(12)
+            << static_cast<uint64_t>(static_cast<double>(crash_ticks.size()) / seconds)
+            << std::endl;
+  for (const std::string& failure : failures) {
+    std::cout << "  " << failure << std::endl;
+  }
+}
+
+} // namespace
+
+void power_loss_bench(uint32_t a_crash_points_count)
+{
+  const geometry_t geometries[] = {{16, 4, 32}, {32, 4, 20}, {32, 8, 64}, {64, 16, 128}};
+
+  std::cout << "power loss crash points, threads=" << std::thread::hardware_concurrency()
+            << std::endl;
+  std::cout << std::setw(6) << "page" << std::setw(8) << "sector" << std::setw(8) << "pages"
+            << std::setw(10) << "ticks" << std::setw(8) << "swaps" << std::setw(10) << "points"
+            << std::setw(10) << "torn_key" << std::setw(10) << "replaced" << std::setw(10)
+            << "failures" << std::setw(12) << "points/s" << std::endl;
+  for (const geometry_t& geometry : geometries) {
+    bench_geometry(geometry, a_crash_points_count);
+  }
+}
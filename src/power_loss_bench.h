@@ -0,0 +1,19 @@
+#ifndef POWER_LOSS_BENCH_H
+#define POWER_LOSS_BENCH_H
+
+#include <cstdint>
+
+/// \brief Проверка eeprom_safe_map_t на устойчивость к пропаданию питания
+/// \details Для нескольких геометрий eeprom выполняет один и тот же сценарий операций set_value,
+/// replace_key, set_values и rebalance на образе в ОЗУ (ram_page_mem, 1 байт за tick) и прерывает
+/// его после каждого tick сценария или после a_crash_points_count случайно выбранных тиков. После
+/// прерывания мапа монтируется заново и каждый ключ должен читаться со значением до или после
+/// прерванной операции. Точки прерывания распределяются по всем ядрам процессора. Выводит кол-во
+/// обменов ключей rebalance в сценарии, кол-во ошибок и кол-во проверенных точек прерывания в
+/// секунду. Известные ошибки добавления ключа (лишний ключ из смеси байт нового ключа и
+/// терминатора) и replace_key (новый ключ со значением старого) считаются отдельно от остальных,
+/// подробно выводятся только остальные
+/// \param a_crash_points_count Кол-во точек прерывания на геометрию, 0 - все тики сценария
+void power_loss_bench(uint32_t a_crash_points_count);
+
+#endif // POWER_LOSS_BENCH_H
@@ -0,0 +1,161 @@
+#include "ram_page_mem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+ram_page_mem::ram_page_mem(
+  size_t a_page_count,
+  size_t a_page_size,
+  uint32_t a_bytes_per_tick,
+  uint32_t a_queue_depth
+) :
+  ram_page_mem(
+    std::vector<uint8_t>(a_page_count * a_page_size),
+    a_page_size,
+    a_bytes_per_tick,
+    a_queue_depth
+  )
+{
+}
+
+ram_page_mem::ram_page_mem(
+  const std::vector<uint8_t>& a_image,
+  size_t a_page_size,
+  uint32_t a_bytes_per_tick,
+  uint32_t a_queue_depth
+) :
+  m_page_size(a_page_size),
+  m_bytes_per_tick(a_bytes_per_tick),
+  m_queue_depth(a_queue_depth),
+  m_image(a_image),
+  m_operations(),
+  m_elapsed_ticks(0)
+{
+  assert(m_bytes_per_tick > 0);
+  assert(m_queue_depth > 0);
+  assert(m_image.size() % m_page_size == 0);
+}
+
+void ram_page_mem::read_page(uint8_t* ap_buf, uint32_t a_index)
+{
+  initialize_io_operation(ap_buf, a_index, op_t::read, 0, m_page_size);
+}
+
+void ram_page_mem::write_page(const uint8_t* ap_buf, uint32_t a_index)
+{
+  initialize_io_operation(const_cast<uint8_t*>(ap_buf), a_index, op_t::write, 0, m_page_size);
+}
+
+bool ram_page_mem::supports_partial_write() const
+{
+  return true;
+}
+
+void ram_page_mem::write_bytes(
+  const uint8_t* ap_buf, uint32_t a_index, size_type a_offset, size_type a_size
+)
+{
+  assert(a_offset + a_size <= m_page_size);
+  initialize_io_operation(
+    const_cast<uint8_t*>(ap_buf), a_index, op_t::write, a_offset, a_size
+  );
+}
+
+bool ram_page_mem::supports_burst() const
+{
+  return true;
+}
+
+void ram_page_mem::read_pages(uint8_t* ap_buf, uint32_t a_index, uint32_t a_count)
+{
+  assert(a_count > 0 && a_index + a_count <= page_count());
+  initialize_io_operation(ap_buf, a_index, op_t::read, 0, a_count * m_page_size);
+}
+
+void ram_page_mem::write_pages(const uint8_t* ap_buf, uint32_t a_index, uint32_t a_count)
+{
+  assert(a_count > 0 && a_index + a_count <= page_count());
+  initialize_io_operation(
+    const_cast<uint8_t*>(ap_buf), a_index, op_t::write, 0, a_count * m_page_size
+  );
+}
+
+size_t ram_page_mem::page_size() const
+{
+  return m_page_size;
+}
+
+uint32_t ram_page_mem::page_count() const
+{
+  return static_cast<uint32_t>(m_image.size() / m_page_size);
+}
+
+irs_status_t ram_page_mem::status() const
+{
+  return m_operations.empty() ? irs_st_ready : irs_st_busy;
+}
+
+void ram_page_mem::tick()
+{
+  m_elapsed_ticks++;
+  if (m_operations.empty()) {
+    return;
+  }
+  io_operation_t& operation = m_operations.front();
+  const size_t bytes_count =
+    std::min<size_t>(m_bytes_per_tick, operation.end_byte - operation.current_byte);
+  uint8_t* p_page = m_image.data() + operation.page_index * m_page_size;
+  if (operation.op == op_t::read) {
+    memcpy(
+      operation.p_buffer + operation.current_byte, p_page + operation.current_byte, bytes_count
+    );
+  } else {
+    memcpy(
+      p_page + operation.current_byte, operation.p_buffer + operation.current_byte, bytes_count
+    );
+  }
+  operation.current_byte += bytes_count;
+  if (operation.current_byte == operation.end_byte) {
+    m_operations.pop_front();
+  }
+}
+
+unsigned int ram_page_mem::queue_depth() const
+{
+  return m_queue_depth;
+}
+
+unsigned int ram_page_mem::pending_ops() const
+{
+  return static_cast<unsigned int>(m_operations.size());
+}
+
+void ram_page_mem::power_cycle()
+{
+  m_operations.clear();
+}
+
+const std::vector<uint8_t>& ram_page_mem::image() const
+{
+  return m_image;
+}
+
+uint64_t ram_page_mem::elapsed_ticks() const
+{
+  return m_elapsed_ticks;
+}
+
+void ram_page_mem::initialize_io_operation(
+  uint8_t* ap_data,
+  uint32_t a_index,
+  op_t a_op,
+  size_t a_offset,
+  size_t a_size
+)
+{
+  assert(a_index < page_count());
+  assert(m_operations.size() < m_queue_depth);
+
+  m_operations.push_back({ap_data, a_index, a_op, a_offset, a_offset + a_size});
+}
@@ -0,0 +1,87 @@
+#ifndef RAM_PAGE_MEM_H
+#define RAM_PAGE_MEM_H
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "raw_file_page_mem.h"
+
+/// \brief Эмуляция eeprom в ОЗУ без обращений к диску
+/// \details Как и raw_file_page_mem, передает a_bytes_per_tick байт страницы за один вызов tick,
+/// поэтому прерванная запись оставляет страницу частично записанной. Используется для проверки
+/// устойчивости к пропаданию питания: образ можно скопировать в любой момент и смонтировать заново.
+/// С a_queue_depth больше 1 принимает до a_queue_depth операций подряд и выполняет их по очереди,
+/// как память с очередью команд: tick передает байты только первой операции очереди
+class ram_page_mem final : public irs::page_mem_t
+{
+public:
+  explicit ram_page_mem(
+    size_t a_page_count,
+    size_t a_page_size,
+    uint32_t a_bytes_per_tick = 1,
+    uint32_t a_queue_depth = 1
+  );
+  /// \param a_image Начальный образ, его размер должен быть кратен a_page_size
+  explicit ram_page_mem(
+    const std::vector<uint8_t>& a_image,
+    size_t a_page_size,
+    uint32_t a_bytes_per_tick = 1,
+    uint32_t a_queue_depth = 1
+  );
+
+  typedef size_t size_type;
+  void read_page(uint8_t* ap_buf, uint32_t a_index) override;
+  void write_page(const uint8_t* ap_buf, uint32_t a_index) override;
+  [[nodiscard]] size_type page_size() const override;
+  [[nodiscard]] uint32_t page_count() const override;
+  [[nodiscard]] irs_status_t status() const override;
+  void tick() override;
+  [[nodiscard]] bool supports_partial_write() const override;
+  void write_bytes(
+    const uint8_t* ap_buf, uint32_t a_index, size_type a_offset, size_type a_size
+  ) override;
+  [[nodiscard]] bool supports_burst() const override;
+  void read_pages(uint8_t* ap_buf, uint32_t a_index, uint32_t a_count) override;
+  void write_pages(const uint8_t* ap_buf, uint32_t a_index, uint32_t a_count) override;
+  [[nodiscard]] unsigned int queue_depth() const override;
+  [[nodiscard]] unsigned int pending_ops() const override;
+  /// \brief Пропадание питания: текущая операция прерывается, уже записанные байты остаются,
+  /// операции из очереди отбрасываются
+  void power_cycle();
+  [[nodiscard]] const std::vector<uint8_t>& image() const;
+  /// \brief Кол-во вызовов tick с момента создания
+  [[nodiscard]] uint64_t elapsed_ticks() const;
+
+private:
+  enum class op_t {
+    read,
+    write
+  };
+  struct io_operation_t
+  {
+    uint8_t* p_buffer;
+    uint32_t page_index;
+    op_t op;
+    size_t current_byte;
+    size_t end_byte;
+  };
+
+  const size_t m_page_size;
+  const uint32_t m_bytes_per_tick;
+  const uint32_t m_queue_depth;
+  std::vector<uint8_t> m_image;
+
+  std::deque<io_operation_t> m_operations;
+  uint64_t m_elapsed_ticks;
+
+  void initialize_io_operation(
+    uint8_t* ap_data,
+    uint32_t a_index,
+    op_t a_op,
+    size_t a_offset,
+    size_t a_size
+  );
+};
+
+#endif // RAM_PAGE_MEM_H
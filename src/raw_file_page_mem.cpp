@@ -1,11 +1,17 @@
 #include "raw_file_page_mem.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 
 raw_file_page_mem::raw_file_page_mem(
-  const std::string& a_eeprom_filename, size_t a_page_count, size_t a_page_size, size_t a_start_page
+  const std::string& a_eeprom_filename,
+  size_t a_page_count,
+  size_t a_page_size,
+  size_t a_start_page,
+  const page_mem_timing_t& a_timing
 ) :
   m_eeprom_filename(a_eeprom_filename),
   m_page_count(a_page_count),
@@ -13,30 +19,66 @@ raw_file_page_mem::raw_file_page_mem(
   m_start_page(a_start_page),
   mp_buffer(nullptr),
   m_page_index(0),
-  m_current_byte(0),
   m_status(status_t::ready),
-  m_eeprom_data(m_page_count)
+  m_current_byte(0),
+  m_end_byte(0),
+  m_timing(a_timing),
+  m_wait_ticks(0),
+  m_elapsed_ticks(0),
+  m_eeprom_data(m_page_count * m_page_size)
 {
+  assert(m_timing.bytes_per_tick > 0);
+  // Образ читается одним вызовом прямо в хранилище, без промежуточных буферов. Если файл короче
+  // образа, то недостающие байты остаются нулевыми
   std::ifstream eeprom_file(a_eeprom_filename, std::ios::binary | std::ios::in);
-
-  for (size_t i = 0; i < m_page_count; ++i) {
-    m_eeprom_data[i].resize(m_page_size);
-
-    eeprom_file.get(
-      reinterpret_cast<char*>(m_eeprom_data[i].data()),
-      static_cast<std::streamsize>(m_page_size + 1)
-    );
-  }
+  eeprom_file.read(
+    reinterpret_cast<char*>(m_eeprom_data.data()),
+    static_cast<std::streamsize>(m_eeprom_data.size())
+  );
 }
 
 void raw_file_page_mem::read_page(uint8_t* ap_buf, uint32_t a_index)
 {
-  initialize_io_operation(ap_buf, a_index, status_t::read);
+  initialize_io_operation(ap_buf, a_index, status_t::read, 0, m_page_size);
 }
 
 void raw_file_page_mem::write_page(const uint8_t* ap_buf, uint32_t a_index)
 {
-  initialize_io_operation(const_cast<uint8_t*>(ap_buf), a_index, status_t::write);
+  initialize_io_operation(const_cast<uint8_t*>(ap_buf), a_index, status_t::write, 0, m_page_size);
+}
+
+bool raw_file_page_mem::supports_partial_write() const
+{
+  return true;
+}
+
+void raw_file_page_mem::write_bytes(
+  const uint8_t* ap_buf, uint32_t a_index, size_type a_offset, size_type a_size
+)
+{
+  assert(a_offset + a_size <= m_page_size);
+  initialize_io_operation(
+    const_cast<uint8_t*>(ap_buf), a_index, status_t::write, a_offset, a_size
+  );
+}
+
+bool raw_file_page_mem::supports_burst() const
+{
+  return true;
+}
+
+void raw_file_page_mem::read_pages(uint8_t* ap_buf, uint32_t a_index, uint32_t a_count)
+{
+  assert(a_count > 0 && a_index + a_count <= m_page_count);
+  initialize_io_operation(ap_buf, a_index, status_t::read, 0, a_count * m_page_size);
+}
+
+void raw_file_page_mem::write_pages(const uint8_t* ap_buf, uint32_t a_index, uint32_t a_count)
+{
+  assert(a_count > 0 && a_index + a_count <= m_page_count);
+  initialize_io_operation(
+    const_cast<uint8_t*>(ap_buf), a_index, status_t::write, 0, a_count * m_page_size
+  );
 }
 
 size_t raw_file_page_mem::page_size() const
@@ -61,24 +103,53 @@ irs_status_t raw_file_page_mem::status() const
 
 void raw_file_page_mem::tick()
 {
+  m_elapsed_ticks++;
   switch (m_status) {
     case status_t::ready: {
     } break;
+    case status_t::read_latency: {
+      m_wait_ticks--;
+      if (m_wait_ticks == 0) {
+        m_status = status_t::read;
+      }
+    } break;
     case status_t::read: {
-      mp_buffer[m_current_byte] = m_eeprom_data[m_page_index][m_current_byte];
-      m_current_byte += 1;
-
-      if (m_current_byte == m_page_size) {
+      const size_t bytes_count = bytes_per_tick();
+      memcpy(
+        mp_buffer + m_current_byte,
+        m_eeprom_data.data() + m_page_index * m_page_size + m_current_byte,
+        bytes_count
+      );
+      m_current_byte += bytes_count;
+
+      if (m_current_byte == m_end_byte) {
         m_status = status_t::ready;
       }
     } break;
     case status_t::write: {
-      m_eeprom_data[m_page_index][m_current_byte] = mp_buffer[m_current_byte];
-      m_current_byte += 1;
+      const size_t bytes_count = bytes_per_tick();
+      memcpy(
+        m_eeprom_data.data() + m_page_index * m_page_size + m_current_byte,
+        mp_buffer + m_current_byte,
+        bytes_count
+      );
+      m_current_byte += bytes_count;
 
       write_eeprom_file();
-      if (m_current_byte == m_page_size) {
-        m_status = status_t::ready;
+      // Цикл записи выполняется после каждой страницы, в том числе внутри write_pages
+      if (m_current_byte == m_end_byte || m_current_byte % m_page_size == 0) {
+        m_wait_ticks = m_timing.full_page_per_tick ? 0 : m_timing.write_cycle_ticks;
+        if (m_wait_ticks > 0) {
+          m_status = status_t::write_cycle;
+        } else if (m_current_byte == m_end_byte) {
+          m_status = status_t::ready;
+        }
+      }
+    } break;
+    case status_t::write_cycle: {
+      m_wait_ticks--;
+      if (m_wait_ticks == 0) {
+        m_status = m_current_byte == m_end_byte ? status_t::ready : status_t::write;
       }
     } break;
   }
@@ -94,25 +165,71 @@ uint32_t raw_file_page_mem::start_page() const
   return m_start_page;
 }
 
+const page_mem_timing_t& raw_file_page_mem::timing() const
+{
+  return m_timing;
+}
+
+void raw_file_page_mem::set_timing(const page_mem_timing_t& a_timing)
+{
+  assert(a_timing.bytes_per_tick > 0);
+  assert(m_status == status_t::ready);
+  m_timing = a_timing;
+}
+
+uint64_t raw_file_page_mem::elapsed_ticks() const
+{
+  return m_elapsed_ticks;
+}
+
+double raw_file_page_mem::elapsed_us() const
+{
+  return static_cast<double>(m_elapsed_ticks) * m_timing.tick_duration_us;
+}
+
 void raw_file_page_mem::initialize_io_operation(
-  uint8_t* ap_data, uint32_t a_index, status_t a_status
+  uint8_t* ap_data,
+  uint32_t a_index,
+  status_t a_status,
+  size_t a_offset,
+  size_t a_size
 )
 {
   assert(a_index < m_page_count);
+  assert(a_index * m_page_size + a_offset + a_size <= m_page_count * m_page_size);
 
   mp_buffer = ap_data;
   m_page_index = m_start_page + a_index;
   m_status = a_status;
 
-  m_current_byte = 0;
+  m_current_byte = a_offset;
+  m_end_byte = a_offset + a_size;
+  if (a_status == status_t::read && !m_timing.full_page_per_tick) {
+    m_wait_ticks = m_timing.read_latency_ticks;
+    if (m_wait_ticks > 0) {
+      m_status = status_t::read_latency;
+    }
+  }
+}
+
+size_t raw_file_page_mem::bytes_per_tick() const
+{
+  if (m_timing.full_page_per_tick) {
+    return m_end_byte - m_current_byte;
+  }
+  // Запись не переходит границу страницы за один tick: после страницы идет цикл записи
+  size_t page_end_byte = m_end_byte;
+  if (m_status == status_t::write) {
+    page_end_byte = std::min<size_t>(m_end_byte, (m_current_byte / m_page_size + 1) * m_page_size);
+  }
+  return std::min<size_t>(m_timing.bytes_per_tick, page_end_byte - m_current_byte);
 }
 
 void raw_file_page_mem::write_eeprom_file()
 {
   std::ofstream eeprom_file(m_eeprom_filename, std::ios::binary | std::ios::out);
-  for (int i = 0; i < m_page_count; ++i) {
-    for (int j = 0; j < m_page_size; ++j) {
-      eeprom_file << m_eeprom_data[i][j];
-    }
-  }
+  eeprom_file.write(
+    reinterpret_cast<const char*>(m_eeprom_data.data()),
+    static_cast<std::streamsize>(m_eeprom_data.size())
+  );
 }
@@ -1,11 +1,14 @@
 #ifndef NOISE_GENERATOR_SD_PAGE_MEM_H
 #define NOISE_GENERATOR_SD_PAGE_MEM_H
 
+#include <cassert>
 #include <cstdint>
 #include <fstream>
 #include <string>
 #include <vector>
 
+#include "page_mem_timing.h"
+
 enum irs_status_t {
   irs_st_busy,
   irs_st_ready,
@@ -24,17 +27,77 @@ public:
   virtual unsigned int page_count() const = 0;
   virtual irs_status_t status() const = 0;
   virtual void tick() = 0;
+  /// \brief Память умеет записывать часть страницы без перезаписи остальных байт
+  virtual bool supports_partial_write() const
+  {
+    return false;
+  }
+  /// \brief Запись байт [a_offset, a_offset + a_size) страницы a_index
+  /// \details ap_buf указывает на буфер размером в страницу, из него берутся байты с теми же
+  /// смещениями. Вызывать, только если supports_partial_write возвращает true
+  virtual void write_bytes(
+    const uint8_t* /*ap_buf*/,
+    unsigned int /*a_index*/,
+    size_type /*a_offset*/,
+    size_type /*a_size*/
+  )
+  {
+    assert(false);
+  }
+  /// \brief Память читает и записывает несколько подряд идущих страниц одной операцией, которая
+  /// завершается в tick, как и операция с одной страницей
+  virtual bool supports_burst() const
+  {
+    return false;
+  }
+  /// \brief Чтение a_count страниц, начиная с a_index, в буфер размером a_count страниц
+  /// \details По умолчанию страницы читаются по одной, а tick вызывается до готовности памяти, то
+  /// есть вызов блокирующий
+  virtual void read_pages(uint8_t* ap_buf, unsigned int a_index, unsigned int a_count)
+  {
+    for (unsigned int i = 0; i < a_count; ++i) {
+      read_page(ap_buf + i * page_size(), a_index + i);
+      while (status() == irs_st_busy) {
+        tick();
+      }
+    }
+  }
+  /// \brief Запись a_count страниц, начиная с a_index, из буфера размером a_count страниц
+  /// \details По умолчанию блокирующая, как и read_pages
+  virtual void write_pages(const uint8_t* ap_buf, unsigned int a_index, unsigned int a_count)
+  {
+    for (unsigned int i = 0; i < a_count; ++i) {
+      write_page(ap_buf + i * page_size(), a_index + i);
+      while (status() == irs_st_busy) {
+        tick();
+      }
+    }
+  }
+  /// \brief Кол-во операций, которые память принимает, не дожидаясь завершения предыдущих
+  /// \details Если больше 1, то новую операцию можно начать, пока pending_ops меньше queue_depth.
+  /// Операции выполняются и завершаются в порядке вызова, status возвращает irs_st_busy, пока
+  /// есть незавершенные операции
+  virtual unsigned int queue_depth() const
+  {
+    return 1;
+  }
+  /// \brief Кол-во начатых и еще не завершенных операций
+  virtual unsigned int pending_ops() const
+  {
+    return status() == irs_st_busy ? 1 : 0;
+  }
 };
 } // namespace irs
 
-class raw_file_page_mem : public irs::page_mem_t
+class raw_file_page_mem final : public irs::page_mem_t
 {
 public:
   explicit raw_file_page_mem(
     const std::string& a_eeprom_filename,
     size_t a_page_count,
     size_t a_page_size,
-    size_t a_start_page = 0
+    size_t a_start_page = 0,
+    const page_mem_timing_t& a_timing = page_mem_timing_t::legacy()
   );
   typedef size_t size_type;
   void read_page(uint8_t* ap_buf, uint32_t a_index);
@@ -44,14 +107,30 @@ public:
   [[nodiscard]] bool ready() const;
   [[nodiscard]] irs_status_t status() const;
   void tick();
+  [[nodiscard]] bool supports_partial_write() const;
+  void write_bytes(const uint8_t* ap_buf, uint32_t a_index, size_type a_offset, size_type a_size);
+  [[nodiscard]] bool supports_burst() const;
+  /// \details Чтение идет подряд с одной задержкой read_latency_ticks на всю операцию
+  void read_pages(uint8_t* ap_buf, uint32_t a_index, uint32_t a_count);
+  /// \details Цикл записи write_cycle_ticks выполняется после каждой страницы
+  void write_pages(const uint8_t* ap_buf, uint32_t a_index, uint32_t a_count);
   [[nodiscard]] uint8_t error() const;
   [[nodiscard]] uint32_t start_page() const;
+  [[nodiscard]] const page_mem_timing_t& timing() const;
+  /// \brief Меняет профиль времени. Вызывать только в состоянии ready
+  void set_timing(const page_mem_timing_t& a_timing);
+  /// \brief Кол-во вызовов tick с момента создания
+  [[nodiscard]] uint64_t elapsed_ticks() const;
+  /// \brief Моделируемое время с момента создания в микросекундах
+  [[nodiscard]] double elapsed_us() const;
 
 private:
   enum class status_t {
     ready,
+    read_latency,
+    read,
     write,
-    read
+    write_cycle
   };
 
   const std::string m_eeprom_filename;
@@ -64,11 +143,24 @@ private:
   status_t m_status;
 
   uint32_t m_current_byte;
+  /// \brief Байт страницы, на котором завершается текущая операция
+  uint32_t m_end_byte;
+  page_mem_timing_t m_timing;
+  uint32_t m_wait_ticks;
+  uint64_t m_elapsed_ticks;
 
-  std::vector<std::vector<uint8_t>> m_eeprom_data;
+  // Образ eeprom, страницы лежат друг за другом
+  std::vector<uint8_t> m_eeprom_data;
 
-  void initialize_io_operation(uint8_t* ap_data, uint32_t a_index, status_t a_status);
+  void initialize_io_operation(
+    uint8_t* ap_data,
+    uint32_t a_index,
+    status_t a_status,
+    size_t a_offset,
+    size_t a_size
+  );
   void write_eeprom_file();
+  [[nodiscard]] size_t bytes_per_tick() const;
 };
 
 #endif // NOISE_GENERATOR_SD_PAGE_MEM_H
@@ -0,0 +1,1209 @@
+#include "safe_map_bench.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+#include "async_file_page_mem.h"
+#include "eeprom_safe_map.h"
+#include "page_mem_stats.h"
+#include "ram_page_mem.h"
+#include "raw_file_page_mem.h"
+
+namespace {
+
+struct geometry_t
+{
+  uint32_t page_size_bytes;
+  uint32_t sector_size_pages;
+  uint32_t pages_count;
+};
+
+/// \brief Измеряет группу одинаковых операций по счетчикам page_mem_stats_t и часам
+class op_meter_t
+{
+public:
+  op_meter_t(page_mem_stats_t& a_page_mem, std::ostream& a_out, const std::string& a_row_prefix) :
+    m_page_mem(a_page_mem),
+    m_out(a_out),
+    m_row_prefix(a_row_prefix),
+    m_ticks(0),
+    m_reads(0),
+    m_writes(0),
+    m_start()
+  {
+  }
+
+  void begin()
+  {
+    m_ticks = m_page_mem.snapshot().ticks;
+    m_reads = m_page_mem.total_reads();
+    m_writes = m_page_mem.total_writes();
+    m_start = std::chrono::steady_clock::now();
+  }
+
+  /// \brief Выводит строку CSV со средними значениями на одну из a_ops_count операций
+  void end(const char* ap_op, uint32_t a_ops_count)
+  {
+    const auto wall = std::chrono::steady_clock::now() - m_start;
+    const double ops = static_cast<double>(a_ops_count);
+    const double wall_ns = static_cast<double>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count()
+    );
+    m_out << m_row_prefix << "," << ap_op << "," << a_ops_count << ","
+          << static_cast<double>(m_page_mem.snapshot().ticks - m_ticks) / ops << ","
+          << static_cast<double>(m_page_mem.total_reads() - m_reads) / ops << ","
+          << static_cast<double>(m_page_mem.total_writes() - m_writes) / ops << ","
+          << wall_ns / ops << std::endl;
+  }
+
+private:
+  page_mem_stats_t& m_page_mem;
+  std::ostream& m_out;
+  const std::string m_row_prefix;
+  uint64_t m_ticks;
+  uint64_t m_reads;
+  uint64_t m_writes;
+  std::chrono::steady_clock::time_point m_start;
+};
+
+template<class Map>
+void wait_safe_map(Map& a_safe_map)
+{
+  while (!a_safe_map.ready()) {
+    a_safe_map.tick();
+  }
+}
+
+/// \brief Ключ с номером a_number. Нулевой ключ используется как ключ по умолчанию
+template<size_t KeySize>
+std::array<uint8_t, KeySize> make_key(uint32_t a_number)
+{
+  std::array<uint8_t, KeySize> key{};
+  memcpy(key.data(), &a_number, std::min(sizeof(a_number), KeySize));
+  return key;
+}
+
+template<size_t ValueSize>
+std::array<uint8_t, ValueSize> make_value(uint32_t a_number)
+{
+  std::array<uint8_t, ValueSize> value{};
+  value.fill(static_cast<uint8_t>(a_number));
+  return value;
+}
+
+/// \brief Разметка Layout допустима для геометрии и вмещает ключи, нужные тесту
+template<class Layout>
+bool geometry_fits(const geometry_t& a_geometry)
+{
+  if (!Layout::fits(
+        a_geometry.page_size_bytes, a_geometry.pages_count, a_geometry.sector_size_pages
+      )) {
+    return false;
+  }
+  const Layout layout(
+    a_geometry.page_size_bytes, a_geometry.pages_count, a_geometry.sector_size_pages
+  );
+  // Для смены ключей нужно хотя бы 3 ключа кроме ключа по умолчанию
+  return layout.max_keys_count() >= 4;
+}
+
+template<size_t KeySize, size_t ValueSize>
+void bench_geometry(
+  const std::string& a_bench_path,
+  const geometry_t& a_geometry,
+  const page_mem_timing_t& a_timing,
+  std::ostream& a_out
+)
+{
+  typedef std::array<uint8_t, KeySize> key_t;
+  typedef std::array<uint8_t, ValueSize> value_t;
+  typedef eeprom_safe_map_t<key_t, value_t> map_t;
+
+  if (!geometry_fits<dynamic_layout_t<key_t, value_t>>(a_geometry)) {
+    return;
+  }
+  const uint32_t ops_count = 64;
+  const uint32_t mounts_count = 8;
+  const uint32_t resets_count = 4;
+  const key_t default_key = make_key<KeySize>(0);
+  key_t terminator_key;
+  terminator_key.fill(0xff);
+
+  std::remove(a_bench_path.c_str());
+  raw_file_page_mem file_page_mem(
+    a_bench_path, a_geometry.pages_count, a_geometry.page_size_bytes, 0, a_timing
+  );
+  page_mem_stats_t page_mem(&file_page_mem);
+  auto create_map = [&]() {
+    return std::unique_ptr<map_t>(new map_t(
+      &page_mem,
+      0,
+      a_geometry.pages_count,
+      a_geometry.sector_size_pages,
+      default_key,
+      terminator_key
+    ));
+  };
+  std::unique_ptr<map_t> p_map = create_map();
+  wait_safe_map(*p_map);
+
+  op_meter_t meter(
+    page_mem,
+    a_out,
+    std::to_string(KeySize) + "," + std::to_string(ValueSize) + "," +
+      std::to_string(a_geometry.page_size_bytes) + "," +
+      std::to_string(a_geometry.sector_size_pages) + "," + std::to_string(a_geometry.pages_count)
+  );
+
+  meter.begin();
+  for (uint32_t i = 0; i < resets_count; ++i) {
+    p_map->reset();
+    wait_safe_map(*p_map);
+  }
+  meter.end("reset", resets_count);
+
+  // После reset в мапе есть только ключ по умолчанию. Один ключ остается свободным для
+  // replace_key
+  const uint32_t keys_count = std::min<uint32_t>(p_map->get_max_keys_count() - 2, 16);
+  meter.begin();
+  for (uint32_t i = 1; i <= keys_count; ++i) {
+    p_map->set_value(make_key<KeySize>(i), make_value<ValueSize>(i));
+    wait_safe_map(*p_map);
+  }
+  meter.end("add_key", keys_count);
+
+  meter.begin();
+  for (uint32_t i = 0; i < ops_count; ++i) {
+    p_map->set_value(make_key<KeySize>(keys_count), make_value<ValueSize>(i));
+    wait_safe_map(*p_map);
+  }
+  meter.end("set_value", ops_count);
+
+  meter.begin();
+  for (uint32_t i = 0; i < ops_count; ++i) {
+    p_map->set_value(make_key<KeySize>(1 + i % keys_count), make_value<ValueSize>(i));
+    wait_safe_map(*p_map);
+  }
+  meter.end("set_value_switch", ops_count);
+
+  value_t value;
+  meter.begin();
+  for (uint32_t i = 0; i < ops_count; ++i) {
+    p_map->get_value(make_key<KeySize>(1 + (i + 1) % keys_count), value);
+    wait_safe_map(*p_map);
+  }
+  meter.end("get_value", ops_count);
+
+  // Ключ попеременно заменяется на свободный ключ и обратно
+  meter.begin();
+  for (uint32_t i = 0; i < ops_count; ++i) {
+    const key_t old_key = make_key<KeySize>(i % 2 == 0 ? keys_count : keys_count + 1);
+    const key_t new_key = make_key<KeySize>(i % 2 == 0 ? keys_count + 1 : keys_count);
+    value = make_value<ValueSize>(i);
+    p_map->replace_key(old_key, new_key, value);
+    wait_safe_map(*p_map);
+  }
+  meter.end("replace_key", ops_count);
+
+  meter.begin();
+  for (uint32_t i = 0; i < mounts_count; ++i) {
+    p_map = create_map();
+    wait_safe_map(*p_map);
+  }
+  meter.end("mount", mounts_count);
+
+  p_map.reset();
+  std::remove(a_bench_path.c_str());
+}
+
+template<size_t KeySize, size_t ValueSize>
+void bench_geometries(
+  const std::string& a_bench_path,
+  const page_mem_timing_t& a_timing,
+  std::ostream& a_out
+)
+{
+  const uint32_t page_sizes[] = {16, 32, 64, 128};
+  const uint32_t sector_sizes[] = {4, 16, 64};
+  const uint32_t pages_counts[] = {64, 256, 1024};
+  for (uint32_t page_size_bytes : page_sizes) {
+    for (uint32_t sector_size_pages : sector_sizes) {
+      for (uint32_t pages_count : pages_counts) {
+        bench_geometry<KeySize, ValueSize>(
+          a_bench_path, {page_size_bytes, sector_size_pages, pages_count}, a_timing, a_out
+        );
+      }
+    }
+  }
+}
+
+/// \brief Геометрия тестов вызова страничной памяти и разметки
+const uint32_t switch_page_size_bytes = 32;
+const uint32_t switch_pages_count = 64;
+const uint32_t switch_sector_size_pages = 8;
+const uint32_t switch_ops_count = 200000;
+
+typedef std::array<uint8_t, 8> switch_key_t;
+
+switch_key_t switch_terminator_key()
+{
+  switch_key_t key;
+  key.fill(0xff);
+  return key;
+}
+
+/// \brief Переключение ключей с записью и чтением значений
+/// \return Кол-во вызовов tick мапы и время их выполнения в секундах
+template<class Map>
+std::pair<uint64_t, double> run_key_switches(Map& a_safe_map)
+{
+  const uint32_t keys_count = 8;
+  a_safe_map.reset();
+  wait_safe_map(a_safe_map);
+
+  uint64_t ticks = 0;
+  uint32_t value = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < switch_ops_count; ++i) {
+    const switch_key_t key = make_key<8>(1 + i % keys_count);
+    if (i % 2 == 0) {
+      a_safe_map.set_value(key, i);
+    } else {
+      a_safe_map.get_value(key, value);
+    }
+    while (!a_safe_map.ready()) {
+      a_safe_map.tick();
+      ticks++;
+    }
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return {ticks, elapsed.count()};
+}
+
+/// \brief Добавление ключей до заполнения мапы и монтирование заполненной мапы
+/// \details Первые get_data_sectors_count ключей размечают новые сектора данных (add_key_sector),
+/// остальные ключи попадают в уже размеченные сектора (add_key)
+void bench_burst(
+  const std::string& a_bench_path,
+  const page_mem_timing_t& a_timing,
+  bool a_burst,
+  std::ostream& a_out
+)
+{
+  typedef std::array<uint8_t, 4> key_t;
+  typedef eeprom_safe_map_t<key_t, uint32_t> map_t;
+  const geometry_t geometry = {32, 16, 512};
+  const uint32_t mounts_count = 4;
+  const key_t default_key = make_key<4>(0);
+  key_t terminator_key;
+  terminator_key.fill(0xff);
+
+  std::remove(a_bench_path.c_str());
+  raw_file_page_mem file_page_mem(
+    a_bench_path, geometry.pages_count, geometry.page_size_bytes, 0, a_timing
+  );
+  page_mem_stats_t page_mem(&file_page_mem);
+  auto create_map = [&](bool a_value_mirror) {
+    eeprom_safe_map_config_t config;
+    config.burst = a_burst;
+    config.value_mirror = a_value_mirror;
+    return std::unique_ptr<map_t>(new map_t(
+      &page_mem,
+      0,
+      geometry.pages_count,
+      geometry.sector_size_pages,
+      default_key,
+      terminator_key,
+      config
+    ));
+  };
+  std::unique_ptr<map_t> p_map = create_map(false);
+  p_map->reset();
+  wait_safe_map(*p_map);
+
+  op_meter_t meter(page_mem, a_out, a_burst ? "burst" : "page");
+  // Ключ по умолчанию уже занимает первый сектор
+  const uint32_t sector_keys_count = p_map->get_data_sectors_count() - 1;
+  meter.begin();
+  for (uint32_t i = 1; i <= sector_keys_count; ++i) {
+    p_map->set_value(make_key<4>(i), i);
+    wait_safe_map(*p_map);
+  }
+  meter.end("add_key_sector", sector_keys_count);
+
+  const uint32_t keys_count = p_map->get_max_keys_count() - 1;
+  meter.begin();
+  for (uint32_t i = sector_keys_count + 1; i <= keys_count; ++i) {
+    p_map->set_value(make_key<4>(i), i);
+    wait_safe_map(*p_map);
+  }
+  meter.end("add_key", keys_count - sector_keys_count);
+
+  meter.begin();
+  for (uint32_t i = 0; i < mounts_count; ++i) {
+    p_map = create_map(false);
+    wait_safe_map(*p_map);
+  }
+  meter.end("mount", mounts_count);
+
+  meter.begin();
+  for (uint32_t i = 0; i < mounts_count; ++i) {
+    p_map = create_map(true);
+    wait_safe_map(*p_map);
+  }
+  meter.end("mount_mirror", mounts_count);
+
+  p_map.reset();
+  std::remove(a_bench_path.c_str());
+}
+
+/// \brief Добавление ключей, каждый из которых получает новый сектор данных
+void provision_sectors(eeprom_safe_map_t<std::array<uint8_t, 4>, uint32_t>& a_safe_map)
+{
+  a_safe_map.reset();
+  wait_safe_map(a_safe_map);
+  // Ключ по умолчанию уже занимает первый сектор
+  for (uint32_t i = 1; i < a_safe_map.get_data_sectors_count(); ++i) {
+    a_safe_map.set_value(make_key<4>(i), i);
+    wait_safe_map(a_safe_map);
+  }
+}
+
+/// \brief Разметка секторов на стертой eeprom, повторная разметка после reset и после
+/// монтирования, когда состояние страниц неизвестно
+void bench_lazy_format(
+  const std::string& a_bench_path,
+  const page_mem_timing_t& a_timing,
+  bool a_lazy_format,
+  std::ostream& a_out
+)
+{
+  typedef std::array<uint8_t, 4> key_t;
+  typedef eeprom_safe_map_t<key_t, uint32_t> map_t;
+  const geometry_t geometry = {32, 16, 512};
+  const key_t default_key = make_key<4>(0);
+  key_t terminator_key;
+  terminator_key.fill(0xff);
+
+  {
+    // Стертая eeprom заполнена 0xff
+    std::ofstream erased_file(a_bench_path, std::ios::binary | std::ios::trunc);
+    const std::vector<char> erased_image(
+      geometry.pages_count * geometry.page_size_bytes, static_cast<char>(0xff)
+    );
+    erased_file.write(erased_image.data(), static_cast<std::streamsize>(erased_image.size()));
+  }
+  raw_file_page_mem file_page_mem(
+    a_bench_path, geometry.pages_count, geometry.page_size_bytes, 0, a_timing
+  );
+  page_mem_stats_t page_mem(&file_page_mem);
+  auto create_map = [&]() {
+    eeprom_safe_map_config_t config;
+    config.lazy_format = a_lazy_format;
+    return std::unique_ptr<map_t>(new map_t(
+      &page_mem,
+      0,
+      geometry.pages_count,
+      geometry.sector_size_pages,
+      default_key,
+      terminator_key,
+      config
+    ));
+  };
+  std::unique_ptr<map_t> p_map = create_map();
+  wait_safe_map(*p_map);
+
+  op_meter_t meter(page_mem, a_out, a_lazy_format ? "lazy" : "eager");
+  const uint32_t sectors_count = p_map->get_data_sectors_count();
+  meter.begin();
+  provision_sectors(*p_map);
+  meter.end("provision_erased", sectors_count);
+
+  meter.begin();
+  provision_sectors(*p_map);
+  meter.end("provision_reset", sectors_count);
+
+  p_map = create_map();
+  wait_safe_map(*p_map);
+  meter.begin();
+  provision_sectors(*p_map);
+  meter.end("provision_remount", sectors_count);
+
+  p_map.reset();
+  std::remove(a_bench_path.c_str());
+}
+
+/// \brief Чтение всех значений заполненной мапы: get_key и get_value для каждого ключа и один
+/// вызов for_each_value
+void bench_export(
+  const std::string& a_bench_path,
+  const page_mem_timing_t& a_timing,
+  std::ostream& a_out
+)
+{
+  typedef std::array<uint8_t, 4> key_t;
+  typedef eeprom_safe_map_t<key_t, uint32_t> map_t;
+  const geometry_t geometry = {32, 16, 512};
+  const uint32_t updates_count = 3;
+  const key_t default_key = make_key<4>(0);
+  key_t terminator_key;
+  terminator_key.fill(0xff);
+
+  std::remove(a_bench_path.c_str());
+  raw_file_page_mem file_page_mem(
+    a_bench_path, geometry.pages_count, geometry.page_size_bytes, 0, a_timing
+  );
+  page_mem_stats_t page_mem(&file_page_mem);
+  map_t safe_map(
+    &page_mem, 0, geometry.pages_count, geometry.sector_size_pages, default_key, terminator_key
+  );
+  safe_map.reset();
+  wait_safe_map(safe_map);
+  // Несколько обновлений каждого ключа, чтобы актуальные значения были не в первой странице
+  const uint32_t keys_count = safe_map.get_max_keys_count();
+  for (uint32_t update = 0; update < updates_count; ++update) {
+    for (uint32_t i = 0; i < keys_count; ++i) {
+      safe_map.set_value(make_key<4>(i), update * keys_count + i);
+      wait_safe_map(safe_map);
+    }
+  }
+
+  op_meter_t meter(page_mem, a_out, std::to_string(keys_count));
+  uint64_t checksum = 0;
+  meter.begin();
+  for (uint32_t i = 0; i < safe_map.get_keys_count(); ++i) {
+    uint32_t value = 0;
+    safe_map.get_value(safe_map.get_key(i), value);
+    wait_safe_map(safe_map);
+    checksum += value;
+  }
+  meter.end("get_value", 1);
+
+  uint64_t export_checksum = 0;
+  meter.begin();
+  safe_map.for_each_value([&export_checksum](const key_t& /*a_key*/, uint32_t a_value) {
+    export_checksum += a_value;
+  });
+  meter.end("for_each_value", 1);
+
+  if (checksum != export_checksum) {
+    a_out << "Ошибка: for_each_value вернул другие значения" << std::endl;
+  }
+  std::remove(a_bench_path.c_str());
+}
+
+/// \brief Средние на одну операцию вызовы мапы, переходы автомата, тики памяти и время
+struct loop_cost_t
+{
+  double calls;
+  double steps;
+  double page_mem_ticks;
+  double ns;
+};
+
+/// \brief Переключение ключей с ожиданием циклом tick или вызовом run_until_ready
+loop_cost_t measure_wait_loop(bool a_run_until_ready)
+{
+  ram_page_mem page_mem(switch_pages_count, switch_page_size_bytes, switch_page_size_bytes);
+  eeprom_safe_map_t<switch_key_t, uint32_t> safe_map(
+    &page_mem,
+    0,
+    switch_pages_count,
+    switch_sector_size_pages,
+    make_key<8>(0),
+    switch_terminator_key()
+  );
+  safe_map.reset();
+  wait_safe_map(safe_map);
+
+  const uint32_t keys_count = 8;
+  const uint32_t ops_count = switch_ops_count / 4;
+  uint64_t calls = 0;
+  uint64_t steps = 0;
+  const uint64_t start_ticks = page_mem.elapsed_ticks();
+  const auto start = std::chrono::steady_clock::now();
+  uint32_t value = 0;
+  for (uint32_t i = 0; i < ops_count; ++i) {
+    const switch_key_t key = make_key<8>(1 + i % keys_count);
+    if (i % 2 == 0) {
+      safe_map.set_value(key, i);
+    } else {
+      safe_map.get_value(key, value);
+    }
+    if (a_run_until_ready) {
+      steps += safe_map.run_until_ready().steps;
+      calls++;
+    } else {
+      while (!safe_map.ready()) {
+        safe_map.tick();
+        calls++;
+        steps++;
+      }
+    }
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  const double ops = static_cast<double>(ops_count);
+  return {
+    static_cast<double>(calls) / ops,
+    static_cast<double>(steps) / ops,
+    static_cast<double>(page_mem.elapsed_ticks() - start_ticks) / ops,
+    elapsed.count() / ops
+  };
+}
+
+/// \brief Средние на одну запись значения тики, команды записи и байты обмена со страничной
+/// памятью
+struct value_write_cost_t
+{
+  double ticks;
+  double write_cycles;
+  double bytes_read;
+  double bytes_written;
+};
+
+/// \brief Повторная запись значений одного ключа с частичной записью страницы или без нее
+/// \details Каждый вызов write_page или write_bytes считается отдельной командой записи: у eeprom
+/// после каждой из них идет цикл записи страницы
+value_write_cost_t measure_value_writes(
+  irs::page_mem_t& a_page_mem,
+  bool a_partial_write,
+  uint32_t a_ops_count
+)
+{
+  page_mem_stats_t stats_page_mem(&a_page_mem);
+  eeprom_safe_map_config_t config;
+  config.partial_write = a_partial_write;
+  eeprom_safe_map_t<switch_key_t, uint32_t> safe_map(
+    &stats_page_mem,
+    0,
+    switch_pages_count,
+    switch_sector_size_pages,
+    make_key<8>(0),
+    switch_terminator_key(),
+    config
+  );
+  safe_map.reset();
+  wait_safe_map(safe_map);
+  const switch_key_t key = make_key<8>(1);
+  safe_map.set_value(key, 0);
+  wait_safe_map(safe_map);
+
+  const page_mem_stats_t::snapshot_t before = stats_page_mem.snapshot();
+  const uint64_t writes_before = stats_page_mem.total_writes();
+  for (uint32_t i = 1; i <= a_ops_count; ++i) {
+    safe_map.set_value(key, i);
+    wait_safe_map(safe_map);
+  }
+  const page_mem_stats_t::snapshot_t after = stats_page_mem.snapshot();
+  const double ops = static_cast<double>(a_ops_count);
+  return {
+    static_cast<double>(after.ticks - before.ticks) / ops,
+    static_cast<double>(stats_page_mem.total_writes() - writes_before) / ops,
+    static_cast<double>(after.bytes_read - before.bytes_read) / ops,
+    static_cast<double>(after.bytes_written - before.bytes_written) / ops
+  };
+}
+
+/// \brief Средние на одну операцию тики и чтения страниц
+struct pipeline_cost_t
+{
+  double ticks;
+  double page_reads;
+};
+
+/// \brief Смена ключа с чтением (a_write = false) или записью значения при ожидании циклом tick
+/// \details Перед измерением ключи записываются разное кол-во раз, чтобы поиск актуального
+/// значения останавливался на разных страницах сектора
+pipeline_cost_t measure_pipeline(
+  uint32_t a_bytes_per_tick,
+  uint32_t a_queue_depth,
+  bool a_pipeline,
+  bool a_write
+)
+{
+  ram_page_mem page_mem(
+    switch_pages_count, switch_page_size_bytes, a_bytes_per_tick, a_queue_depth
+  );
+  page_mem_stats_t stats_page_mem(&page_mem);
+  eeprom_safe_map_config_t config;
+  config.pipeline = a_pipeline;
+  eeprom_safe_map_t<switch_key_t, uint32_t> safe_map(
+    &stats_page_mem,
+    0,
+    switch_pages_count,
+    switch_sector_size_pages,
+    make_key<8>(0),
+    switch_terminator_key(),
+    config
+  );
+  safe_map.reset();
+  wait_safe_map(safe_map);
+  const uint32_t keys_count = 8;
+  for (uint32_t key = 1; key <= keys_count; ++key) {
+    for (uint32_t i = 0; i < key * 3; ++i) {
+      safe_map.set_value(make_key<8>(key), i);
+      wait_safe_map(safe_map);
+    }
+  }
+
+  const uint32_t ops_count = 20000;
+  const uint64_t start_ticks = page_mem.elapsed_ticks();
+  const uint64_t start_reads = stats_page_mem.total_reads();
+  uint32_t value = 0;
+  for (uint32_t i = 0; i < ops_count; ++i) {
+    const switch_key_t key = make_key<8>(1 + i % keys_count);
+    if (a_write) {
+      safe_map.set_value(key, i);
+    } else {
+      safe_map.get_value(key, value);
+    }
+    wait_safe_map(safe_map);
+  }
+  const double ops = static_cast<double>(ops_count);
+  return {
+    static_cast<double>(page_mem.elapsed_ticks() - start_ticks) / ops,
+    static_cast<double>(stats_page_mem.total_reads() - start_reads) / ops
+  };
+}
+
+/// \brief Геометрия и нагрузка теста выравнивания износа
+const uint32_t wear_page_size_bytes = 32;
+const uint32_t wear_pages_count = 256;
+const uint32_t wear_sector_size_pages = 8;
+const uint32_t wear_writes_count = 40000;
+/// \brief Ресурс страницы eeprom в циклах записи для оценки срока службы
+const uint64_t wear_page_endurance = 1000000;
+
+typedef std::array<uint8_t, 4> wear_key_t;
+typedef eeprom_safe_map_t<wear_key_t, uint32_t> wear_map_t;
+
+/// \brief Износ на одной и той же нагрузке до и после выравнивания
+struct wear_balance_result_t
+{
+  uint32_t keys_count;
+  uint32_t sectors_count;
+  uint32_t swaps;
+  uint64_t migration_page_writes;
+  uint64_t max_page_writes_before;
+  uint64_t max_page_writes_after;
+};
+
+/// \brief Наибольшее кол-во записей одной страницы между снимками
+uint64_t max_page_writes(
+  const page_mem_stats_t::snapshot_t& a_before, const page_mem_stats_t::snapshot_t& a_after
+)
+{
+  uint64_t max_writes = 0;
+  for (size_t page = 0; page < a_after.page_writes.size(); ++page) {
+    max_writes = std::max(max_writes, a_after.page_writes[page] - a_before.page_writes[page]);
+  }
+  return max_writes;
+}
+
+/// \brief a_writes_count записей ключей с распределением Ципфа: ключ ранга r записывается с
+/// вероятностью, пропорциональной 1 / (r + 1)
+/// \details Последовательность ключей при каждом вызове одна и та же, поэтому износ до и после
+/// выравнивания сравнивается на одинаковой нагрузке
+void run_skewed_writes(
+  wear_map_t& a_safe_map,
+  const std::vector<wear_key_t>& a_keys_by_rank,
+  uint32_t a_writes_count
+)
+{
+  std::vector<double> weights;
+  for (size_t rank = 0; rank < a_keys_by_rank.size(); ++rank) {
+    weights.push_back(1.0 / static_cast<double>(rank + 1));
+  }
+  std::discrete_distribution<size_t> distribution(weights.begin(), weights.end());
+  std::mt19937 random(1);
+  for (uint32_t i = 0; i < a_writes_count; ++i) {
+    a_safe_map.set_value(a_keys_by_rank[distribution(random)], i);
+    a_safe_map.run_until_ready();
+  }
+}
+
+/// \brief Нагрузка до выравнивания, вызовы rebalance, пока он находит обмен, и та же нагрузка
+/// после выравнивания
+/// \param a_clustered Два самых горячих ключа добавлены в один сектор. Иначе ранги ключей
+/// распределены по позициям случайно
+wear_balance_result_t measure_wear_balance(bool a_clustered)
+{
+  ram_page_mem page_mem(wear_pages_count, wear_page_size_bytes, wear_page_size_bytes);
+  page_mem_stats_t stats_page_mem(&page_mem);
+  eeprom_safe_map_config_t config;
+  config.wear_balance = true;
+  wear_map_t safe_map(
+    &stats_page_mem,
+    0,
+    wear_pages_count,
+    wear_sector_size_pages,
+    make_key<4>(0),
+    {0xff, 0xff, 0xff, 0xff},
+    config
+  );
+  safe_map.reset();
+  safe_map.run_until_ready();
+  const uint32_t sectors_count = safe_map.get_data_sectors_count();
+  const uint32_t keys_count = 2 * sectors_count;
+  // Ключ по умолчанию занимает позицию 0, остальные добавляются по порядку номеров
+  for (uint32_t number = 1; number < keys_count; ++number) {
+    safe_map.set_value(make_key<4>(number), 0);
+    safe_map.run_until_ready();
+  }
+  std::vector<wear_key_t> keys_by_rank;
+  for (uint32_t number = 0; number < keys_count; ++number) {
+    keys_by_rank.push_back(make_key<4>(number));
+  }
+  if (a_clustered) {
+    // Ключ на позиции sectors_count попадает в сектор ключа на позиции 0
+    std::swap(keys_by_rank[1], keys_by_rank[sectors_count]);
+  } else {
+    std::mt19937 random(7);
+    std::shuffle(keys_by_rank.begin(), keys_by_rank.end(), random);
+  }
+
+  wear_balance_result_t result = {keys_count, sectors_count, 0, 0, 0, 0};
+  page_mem_stats_t::snapshot_t start = stats_page_mem.snapshot();
+  run_skewed_writes(safe_map, keys_by_rank, wear_writes_count);
+  page_mem_stats_t::snapshot_t end = stats_page_mem.snapshot();
+  result.max_page_writes_before = max_page_writes(start, end);
+
+  const uint64_t writes_before_migration = stats_page_mem.total_writes();
+  while (safe_map.rebalance()) {
+    safe_map.run_until_ready();
+    result.swaps++;
+  }
+  result.migration_page_writes = stats_page_mem.total_writes() - writes_before_migration;
+
+  start = stats_page_mem.snapshot();
+  run_skewed_writes(safe_map, keys_by_rank, wear_writes_count);
+  end = stats_page_mem.snapshot();
+  result.max_page_writes_after = max_page_writes(start, end);
+  return result;
+}
+
+#ifdef EEPROM_SAFE_MAP_PROFILE
+/// \brief Смешанная нагрузка: добавление ключей, set_value, get_value, replace_key и set_values
+/// \details Операции ждут завершения вызовами tick, чтобы ожидание памяти попало в профиль так же,
+/// как в обычном цикле обслуживания мапы
+void bench_profile(
+  const std::string& a_bench_path,
+  const page_mem_timing_t& a_timing,
+  std::ostream& a_out
+)
+{
+  typedef std::array<uint8_t, 4> key_t;
+  typedef eeprom_safe_map_t<key_t, uint32_t> map_t;
+  const geometry_t geometry = {32, 16, 512};
+  const uint32_t ops_count = 2000;
+  const uint32_t replaces_count = 100;
+  const uint32_t batches_count = 50;
+  const uint32_t batch_size = 8;
+  const key_t default_key = make_key<4>(0);
+  key_t terminator_key;
+  terminator_key.fill(0xff);
+
+  std::remove(a_bench_path.c_str());
+  raw_file_page_mem page_mem(
+    a_bench_path, geometry.pages_count, geometry.page_size_bytes, 0, a_timing
+  );
+  map_t safe_map(
+    &page_mem, 0, geometry.pages_count, geometry.sector_size_pages, default_key, terminator_key
+  );
+  safe_map.reset();
+  wait_safe_map(safe_map);
+  safe_map.get_profiler().clear();
+
+  // Ключ по умолчанию занимает одно место
+  const uint32_t keys_count = safe_map.get_max_keys_count() - 1;
+  std::mt19937 random(12345);
+  for (uint32_t i = 1; i <= keys_count; ++i) {
+    safe_map.set_value(make_key<4>(i), i);
+    wait_safe_map(safe_map);
+  }
+  for (uint32_t i = 0; i < ops_count; ++i) {
+    safe_map.set_value(make_key<4>(1 + random() % keys_count), i);
+    wait_safe_map(safe_map);
+  }
+  for (uint32_t i = 0; i < ops_count; ++i) {
+    uint32_t value = 0;
+    safe_map.get_value(make_key<4>(1 + random() % keys_count), value);
+    wait_safe_map(safe_map);
+  }
+  // Ключи заменяются на новые, поэтому кол-во ключей в мапе не меняется
+  for (uint32_t i = 1; i <= replaces_count; ++i) {
+    uint32_t value = i;
+    safe_map.replace_key(make_key<4>(i), make_key<4>(keys_count + i), value);
+    wait_safe_map(safe_map);
+  }
+  std::vector<std::pair<key_t, uint32_t>> batch;
+  for (uint32_t i = 0; i < batches_count; ++i) {
+    batch.clear();
+    for (uint32_t j = 0; j < batch_size; ++j) {
+      batch.emplace_back(make_key<4>(replaces_count + 1 + random() % keys_count), j);
+    }
+    safe_map.set_values(batch.begin(), batch.end());
+    wait_safe_map(safe_map);
+  }
+
+  safe_map.get_profiler().print_table(a_out);
+  a_out << std::endl;
+  safe_map.get_profiler().print_json(a_out);
+  std::remove(a_bench_path.c_str());
+}
+#endif
+
+/// \brief Состояние мапы после операции, прерванной ошибкой страничной памяти
+struct io_error_result_t
+{
+  int page_mem_error;
+  bool map_ready;
+  irs_status_t map_status;
+  /// \brief Кол-во вызовов tick мапы до перехода в ready
+  uint32_t ticks;
+  /// \brief Результат set_value, вызванного после ошибки
+  bool next_set_value;
+};
+
+const uint32_t io_error_page_size_bytes = 32;
+const uint32_t io_error_pages_count = 64;
+const uint32_t io_error_sector_size_pages = 8;
+typedef std::array<uint8_t, 4> io_error_key_t;
+typedef eeprom_safe_map_t<io_error_key_t, uint32_t> io_error_map_t;
+
+/// \brief Ожидание циклом tick с ограничением, чтобы зависание было видно в результате
+uint32_t wait_io_error_map(io_error_map_t& a_safe_map)
+{
+  const uint32_t max_ticks = 10000000;
+  uint32_t ticks = 0;
+  while (!a_safe_map.ready() && ticks < max_ticks) {
+    a_safe_map.tick();
+    ticks++;
+  }
+  return ticks;
+}
+
+/// \brief Мапа создается на async_file_page_mem, файл которой не удалось открыть
+/// \details Вместо файла передается каталог: open завершается ошибкой EISDIR даже у root
+io_error_result_t measure_io_error_mount(const std::string& a_bench_path)
+{
+  mkdir(a_bench_path.c_str(), 0755);
+  async_file_page_mem page_mem(a_bench_path, io_error_pages_count, io_error_page_size_bytes);
+  io_error_map_t safe_map(
+    &page_mem,
+    0,
+    io_error_pages_count,
+    io_error_sector_size_pages,
+    make_key<4>(0),
+    {0xff, 0xff, 0xff, 0xff}
+  );
+  const uint32_t ticks = wait_io_error_map(safe_map);
+  const bool next_set_value = safe_map.set_value(make_key<4>(1), 1);
+  rmdir(a_bench_path.c_str());
+  return {page_mem.error(), safe_map.ready(), safe_map.status(), ticks, next_set_value};
+}
+
+/// \brief Файл мапы усекается во время работы, и поиск значения читает страницу за концом файла
+io_error_result_t measure_io_error_read(const std::string& a_bench_path)
+{
+  std::remove(a_bench_path.c_str());
+  async_file_page_mem page_mem(a_bench_path, io_error_pages_count, io_error_page_size_bytes);
+  io_error_map_t safe_map(
+    &page_mem,
+    0,
+    io_error_pages_count,
+    io_error_sector_size_pages,
+    make_key<4>(0),
+    {0xff, 0xff, 0xff, 0xff}
+  );
+  wait_io_error_map(safe_map);
+  safe_map.reset();
+  wait_io_error_map(safe_map);
+  for (uint32_t i = 1; i <= 2; ++i) {
+    safe_map.set_value(make_key<4>(i), i);
+    wait_io_error_map(safe_map);
+  }
+  if (truncate(a_bench_path.c_str(), 0) != 0) {
+    return {errno, false, irs_st_error, 0, false};
+  }
+  uint32_t value = 0;
+  safe_map.get_value(make_key<4>(1), value);
+  const uint32_t ticks = wait_io_error_map(safe_map);
+  const bool next_set_value = safe_map.set_value(make_key<4>(2), 3);
+  std::remove(a_bench_path.c_str());
+  return {page_mem.error(), safe_map.ready(), safe_map.status(), ticks, next_set_value};
+}
+
+const char* irs_status_name(irs_status_t a_status)
+{
+  switch (a_status) {
+    case irs_st_ready: {
+      return "ready";
+    }
+    case irs_st_busy: {
+      return "busy";
+    }
+    default: {
+      return "error";
+    }
+  }
+}
+
+void print_io_error(std::ostream& a_out, const char* ap_case, const io_error_result_t& a_result)
+{
+  a_out << ap_case << "," << a_result.page_mem_error << "," << a_result.map_ready << ","
+        << irs_status_name(a_result.map_status) << "," << a_result.ticks << ","
+        << a_result.next_set_value << std::endl;
+}
+
+} // namespace
+
+void safe_map_bench(
+  const std::string& a_eeprom_path,
+  const page_mem_timing_t& a_timing,
+  std::ostream& a_out
+)
+{
+  const std::string bench_path = a_eeprom_path + ".bench_safe_map";
+  a_out << "key_size,value_size,page_size,sector_size_pages,pages_count,op,ops,ticks_per_op,"
+           "page_reads_per_op,page_writes_per_op,wall_ns_per_op"
+        << std::endl;
+  bench_geometries<4, 4>(bench_path, a_timing, a_out);
+  bench_geometries<8, 4>(bench_path, a_timing, a_out);
+  bench_geometries<16, 4>(bench_path, a_timing, a_out);
+  bench_geometries<8, 1>(bench_path, a_timing, a_out);
+  bench_geometries<8, 16>(bench_path, a_timing, a_out);
+}
+
+void safe_map_dispatch_bench(std::ostream& a_out)
+{
+  ram_page_mem virtual_page_mem(switch_pages_count, switch_page_size_bytes);
+  eeprom_safe_map_t<switch_key_t, uint32_t> virtual_map(
+    &virtual_page_mem,
+    0,
+    switch_pages_count,
+    switch_sector_size_pages,
+    make_key<8>(0),
+    switch_terminator_key()
+  );
+  const auto virtual_result = run_key_switches(virtual_map);
+
+  ram_page_mem static_page_mem(switch_pages_count, switch_page_size_bytes);
+  static_eeprom_safe_map_t<switch_key_t, uint32_t, ram_page_mem> static_map(
+    &static_page_mem,
+    0,
+    switch_pages_count,
+    switch_sector_size_pages,
+    make_key<8>(0),
+    switch_terminator_key()
+  );
+  const auto static_result = run_key_switches(static_map);
+
+  a_out << "dispatch,ticks,seconds,ticks_per_sec" << std::endl;
+  a_out << "virtual," << virtual_result.first << "," << virtual_result.second << ","
+        << static_cast<double>(virtual_result.first) / virtual_result.second << std::endl;
+  a_out << "static," << static_result.first << "," << static_result.second << ","
+        << static_cast<double>(static_result.first) / static_result.second << std::endl;
+}
+
+void safe_map_layout_bench(std::ostream& a_out)
+{
+  ram_page_mem dynamic_page_mem(switch_pages_count, switch_page_size_bytes);
+  static_eeprom_safe_map_t<switch_key_t, uint32_t, ram_page_mem> dynamic_map(
+    &dynamic_page_mem,
+    0,
+    switch_pages_count,
+    switch_sector_size_pages,
+    make_key<8>(0),
+    switch_terminator_key()
+  );
+  const auto dynamic_result = run_key_switches(dynamic_map);
+
+  ram_page_mem static_page_mem(switch_pages_count, switch_page_size_bytes);
+  fixed_geometry_safe_map_t<
+    switch_key_t,
+    uint32_t,
+    switch_page_size_bytes,
+    switch_pages_count,
+    switch_sector_size_pages,
+    ram_page_mem>
+    static_map(&static_page_mem, 0, make_key<8>(0), switch_terminator_key());
+  const auto static_result = run_key_switches(static_map);
+
+  a_out << "layout,ticks,ns_per_op,ns_per_tick,map_bytes" << std::endl;
+  a_out << "dynamic," << dynamic_result.first << ","
+        << dynamic_result.second * 1e9 / switch_ops_count << ","
+        << dynamic_result.second * 1e9 / static_cast<double>(dynamic_result.first) << ","
+        << sizeof(dynamic_map) + switch_page_size_bytes << std::endl;
+  a_out << "static," << static_result.first << ","
+        << static_result.second * 1e9 / switch_ops_count << ","
+        << static_result.second * 1e9 / static_cast<double>(static_result.first) << ","
+        << sizeof(static_map) << std::endl;
+}
+
+void safe_map_partial_write_bench(const std::string& a_eeprom_path, std::ostream& a_out)
+{
+  struct memory_t
+  {
+    const char* name;
+    page_mem_timing_t timing;
+    uint32_t ops_count;
+  };
+  // ram - эмулятор без цикла записи, 1 байт за tick. У 24cxx и 25xx цикл записи 5 мс
+  const memory_t memories[] = {
+    {"ram", page_mem_timing_t::legacy(), 10000},
+    {"24cxx", page_mem_timing_t::at24cxx(), 1000},
+    {"25xx", page_mem_timing_t::at25xxx(), 1000}
+  };
+  const std::string bench_path = a_eeprom_path + ".bench_partial_write";
+
+  a_out << "memory,write,ticks_per_op,us_per_op,write_cycles_per_op,bytes_read_per_op,"
+           "bytes_written_per_op"
+        << std::endl;
+  for (const memory_t& memory : memories) {
+    for (bool partial_write : {false, true}) {
+      value_write_cost_t cost;
+      if (memory.timing.write_cycle_ticks == 0) {
+        ram_page_mem page_mem(switch_pages_count, switch_page_size_bytes);
+        cost = measure_value_writes(page_mem, partial_write, memory.ops_count);
+      } else {
+        std::remove(bench_path.c_str());
+        raw_file_page_mem page_mem(
+          bench_path, switch_pages_count, switch_page_size_bytes, 0, memory.timing
+        );
+        cost = measure_value_writes(page_mem, partial_write, memory.ops_count);
+      }
+      a_out << memory.name << "," << (partial_write ? "cell" : "page") << "," << cost.ticks
+            << "," << cost.ticks * memory.timing.tick_duration_us << "," << cost.write_cycles
+            << "," << cost.bytes_read << "," << cost.bytes_written << std::endl;
+    }
+  }
+  std::remove(bench_path.c_str());
+}
+
+void safe_map_pipeline_bench(std::ostream& a_out)
+{
+  struct mode_t
+  {
+    uint32_t queue_depth;
+    bool pipeline;
+  };
+  const uint32_t bytes_per_tick_list[] = {1, 8, 32};
+  const mode_t modes[] = {{1, false}, {2, false}, {2, true}};
+
+  a_out << "bytes_per_tick,queue_depth,pipeline,op,ticks_per_op,page_reads_per_op" << std::endl;
+  for (uint32_t bytes_per_tick : bytes_per_tick_list) {
+    for (const mode_t& mode : modes) {
+      for (bool write : {false, true}) {
+        const pipeline_cost_t cost =
+          measure_pipeline(bytes_per_tick, mode.queue_depth, mode.pipeline, write);
+        a_out << bytes_per_tick << "," << mode.queue_depth << "," << mode.pipeline << ","
+              << (write ? "set_value" : "get_value") << "," << cost.ticks << ","
+              << cost.page_reads << std::endl;
+      }
+    }
+  }
+}
+
+void safe_map_io_error_bench(const std::string& a_eeprom_path, std::ostream& a_out)
+{
+  a_out << "case,page_mem_errno,map_ready,map_status,ticks,next_set_value" << std::endl;
+  const std::string bench_path = a_eeprom_path + ".bench_io_error";
+  print_io_error(a_out, "mount_unopenable", measure_io_error_mount(bench_path + "_dir"));
+  print_io_error(a_out, "read_truncated", measure_io_error_read(bench_path));
+}
+
+void safe_map_wear_balance_bench(std::ostream& a_out)
+{
+  a_out << "placement,keys,sectors,swaps,migration_page_writes,max_page_writes_before,"
+           "max_page_writes_after,lifetime_writes_before,lifetime_writes_after,"
+           "lifetime_writes_even"
+        << std::endl;
+  for (bool clustered : {true, false}) {
+    const wear_balance_result_t result = measure_wear_balance(clustered);
+    // Срок службы - кол-во записей значений, после которого самая изношенная страница исчерпает
+    // ресурс. even - если бы записи распределялись по всем страницам секторов поровну
+    const uint64_t data_pages_count =
+      static_cast<uint64_t>(result.sectors_count) * wear_sector_size_pages;
+    a_out << (clustered ? "clustered" : "random") << "," << result.keys_count << ","
+          << result.sectors_count << "," << result.swaps << "," << result.migration_page_writes
+          << "," << result.max_page_writes_before << "," << result.max_page_writes_after << ","
+          << wear_page_endurance * wear_writes_count / result.max_page_writes_before << ","
+          << wear_page_endurance * wear_writes_count / result.max_page_writes_after << ","
+          << wear_page_endurance * data_pages_count << std::endl;
+  }
+}
+
+void safe_map_burst_bench(
+  const std::string& a_eeprom_path,
+  const page_mem_timing_t& a_timing,
+  std::ostream& a_out
+)
+{
+  const std::string bench_path = a_eeprom_path + ".bench_burst";
+  a_out << "io,op,ops,ticks_per_op,page_reads_per_op,page_writes_per_op,wall_ns_per_op"
+        << std::endl;
+  bench_burst(bench_path, a_timing, false, a_out);
+  bench_burst(bench_path, a_timing, true, a_out);
+}
+
+void safe_map_lazy_format_bench(
+  const std::string& a_eeprom_path,
+  const page_mem_timing_t& a_timing,
+  std::ostream& a_out
+)
+{
+  const std::string bench_path = a_eeprom_path + ".bench_lazy_format";
+  a_out << "format,op,ops,ticks_per_op,page_reads_per_op,page_writes_per_op,wall_ns_per_op"
+        << std::endl;
+  bench_lazy_format(bench_path, a_timing, false, a_out);
+  bench_lazy_format(bench_path, a_timing, true, a_out);
+}
+
+void safe_map_run_loop_bench(std::ostream& a_out)
+{
+  const loop_cost_t tick_cost = measure_wait_loop(false);
+  const loop_cost_t run_cost = measure_wait_loop(true);
+
+  a_out << "loop,calls_per_op,steps_per_op,page_mem_ticks_per_op,ns_per_op" << std::endl;
+  a_out << "tick," << tick_cost.calls << "," << tick_cost.steps << "," << tick_cost.page_mem_ticks
+        << "," << tick_cost.ns << std::endl;
+  a_out << "run_until_ready," << run_cost.calls << "," << run_cost.steps << ","
+        << run_cost.page_mem_ticks << "," << run_cost.ns << std::endl;
+}
+
+void safe_map_profile_bench(
+  const std::string& a_eeprom_path,
+  const page_mem_timing_t& a_timing,
+  std::ostream& a_out
+)
+{
+#ifdef EEPROM_SAFE_MAP_PROFILE
+  bench_profile(a_eeprom_path + ".bench_profile", a_timing, a_out);
+#else
+  (void)a_eeprom_path;
+  (void)a_timing;
+  a_out << "Профиль не собран: нужна сборка с EEPROM_SAFE_MAP_PROFILE=ON" << std::endl;
+#endif
+}
+
+void safe_map_export_bench(
+  const std::string& a_eeprom_path,
+  const page_mem_timing_t& a_timing,
+  std::ostream& a_out
+)
+{
+  a_out << "keys,op,ops,ticks_per_op,page_reads_per_op,page_writes_per_op,wall_ns_per_op"
+        << std::endl;
+  bench_export(a_eeprom_path + ".bench_export", a_timing, a_out);
+}
@@ -0,0 +1,103 @@
+#ifndef SAFE_MAP_BENCH_H
+#define SAFE_MAP_BENCH_H
+
+#include <ostream>
+#include <string>
+
+#include "page_mem_timing.h"
+
+/// \brief Измерение операций eeprom_safe_map_t на разных геометриях eeprom
+/// \details Перебирает размер страницы, размер сектора, кол-во страниц, размер ключа и размер
+/// значения. Для reset, первого добавления ключа, set_value, get_value, replace_key и монтирования
+/// (конструктор с чтением ключей) выводит в a_out строку CSV со средними на одну операцию тиками,
+/// чтениями и записями страниц и временем выполнения. Образ создается во временном файле рядом с
+/// a_eeprom_path
+void safe_map_bench(
+  const std::string& a_eeprom_path,
+  const page_mem_timing_t& a_timing,
+  std::ostream& a_out
+);
+
+/// \brief Кол-во вызовов tick мапы в секунду при вызове страничной памяти через виртуальный
+/// интерфейс irs::page_mem_t и при статическом вызове (static_eeprom_safe_map_t)
+/// \details Используется эмуляция в ОЗУ ram_page_mem, чтобы время tick не зависело от диска.
+/// Результат выводится в a_out в формате CSV
+void safe_map_dispatch_bench(std::ostream& a_out);
+
+/// \brief Время операции и tick мапы с разметкой dynamic_layout_t и static_layout_t
+/// \details Для dynamic_layout_t в размер мапы включен буфер страницы, выделенный в куче. Результат
+/// выводится в a_out в формате CSV
+void safe_map_layout_bench(std::ostream& a_out);
+
+/// \brief Тики, время, команды записи и байты обмена со страничной памятью на один set_value при
+/// записи целой страницы и при частичной записи ячейки значения и байта индекса
+/// \details Измеряется на ram_page_mem без цикла записи и на raw_file_page_mem с профилями 24cxx
+/// и 25xx, файл создается рядом с a_eeprom_path. Результат выводится в a_out в формате CSV
+void safe_map_partial_write_bench(const std::string& a_eeprom_path, std::ostream& a_out);
+
+/// \brief Тики и чтения страниц на смену ключа с упреждающим чтением страниц сектора и без него
+/// \details Используется ram_page_mem с очередью из 1 и 2 операций и разной скоростью передачи.
+/// Мапа ожидается циклом tick, поэтому тики переходов автомата тоже учитываются. Результат
+/// выводится в a_out в формате CSV
+void safe_map_pipeline_bench(std::ostream& a_out);
+
+/// \brief Поведение мапы при ошибке страничной памяти async_file_page_mem
+/// \details mount_unopenable - файл не открывается, ошибка возникает при монтировании.
+/// read_truncated - файл усекается после записи значений, и чтение при смене ключа завершается
+/// ошибкой EIO. В обоих случаях мапа переходит в ready со status irs_st_error, а следующий
+/// set_value возвращает false. Результат выводится в a_out в формате CSV
+void safe_map_io_error_bench(const std::string& a_eeprom_path, std::ostream& a_out);
+
+/// \brief Оценка срока службы eeprom до и после rebalance при неравномерной записи ключей
+/// \details Ключи записываются с распределением Ципфа. Два самых горячих ключа добавлены в один
+/// сектор (clustered) или ранги ключей распределены по позициям случайно (random). После первой
+/// нагрузки rebalance вызывается, пока находит обмен, затем нагрузка повторяется. Срок службы -
+/// кол-во записей значений до исчерпания ресурса самой изношенной страницы. Результат выводится
+/// в a_out в формате CSV
+void safe_map_wear_balance_bench(std::ostream& a_out);
+
+/// \brief Добавление ключей и монтирование большой мапы с пакетными операциями страничной памяти и
+/// с постраничными
+/// \details Строки io=page и io=burst содержат средние на операцию тики, чтения и записи страниц и
+/// время выполнения. Образ создается во временном файле рядом с a_eeprom_path
+void safe_map_burst_bench(
+  const std::string& a_eeprom_path,
+  const page_mem_timing_t& a_timing,
+  std::ostream& a_out
+);
+
+/// \brief Разметка всех секторов данных с config.lazy_format и без него
+/// \details Операции: разметка на стертой eeprom (provision_erased), повторная разметка после
+/// reset (provision_reset) и после нового монтирования (provision_remount). Значения в строках
+/// CSV средние на один сектор
+void safe_map_lazy_format_bench(
+  const std::string& a_eeprom_path,
+  const page_mem_timing_t& a_timing,
+  std::ostream& a_out
+);
+
+/// \brief Ожидание завершения операций циклом tick и вызовом run_until_ready
+/// \details На одну операцию выводятся вызовы мапы, переходы автомата, вызовы tick страничной
+/// памяти и время. Результат выводится в a_out в формате CSV
+void safe_map_run_loop_bench(std::ostream& a_out);
+
+/// \brief Чтение всех значений мапы вызовами get_key и get_value и одним вызовом for_each_value
+/// \details Строки CSV содержат тики, чтения и записи страниц и время чтения всех значений. Образ
+/// создается во временном файле рядом с a_eeprom_path
+void safe_map_export_bench(
+  const std::string& a_eeprom_path,
+  const page_mem_timing_t& a_timing,
+  std::ostream& a_out
+);
+
+/// \brief Профиль состояний автомата мапы и гистограммы времени операций на смешанной нагрузке
+/// \details Выводит в a_out таблицу и JSON safe_map_profiler_t. Профиль собирается, только если
+/// eeprom_bench собран с макросом EEPROM_SAFE_MAP_PROFILE (опция CMake EEPROM_SAFE_MAP_PROFILE).
+/// Образ создается во временном файле рядом с a_eeprom_path
+void safe_map_profile_bench(
+  const std::string& a_eeprom_path,
+  const page_mem_timing_t& a_timing,
+  std::ostream& a_out
+);
+
+#endif // SAFE_MAP_BENCH_H
@@ -2,28 +2,48 @@
 
 #include <array>
 #include <eeprom_safe_map.h>
+#include <iostream>
+#include <page_mem_stats.h>
 #include <raw_file_page_mem.h>
+#include <write_behind_safe_map.h>
 
 using map_key_t = std::array<uint8_t, 8>;
 
-void wait_safe_map(eeprom_safe_map_t<map_key_t, uint32_t>& safe_map)
+/// \return Кол-во тиков страничной памяти, потребовавшихся для завершения операции
+uint32_t wait_safe_map(eeprom_safe_map_t<map_key_t, uint32_t>& safe_map)
 {
-  while (!safe_map.ready()) {
-    safe_map.tick();
-  }
+  return safe_map.run_until_ready().page_mem_ticks;
+}
+
+/// \brief Ожидает завершения операции и выводит ее задержку и кол-во обращений к страницам
+void print_latency(
+  const char* ap_op,
+  eeprom_safe_map_t<map_key_t, uint32_t>& a_safe_map,
+  const page_mem_timing_t& a_timing
+)
+{
+  const uint32_t ticks = wait_safe_map(a_safe_map);
+  const auto page_stats = a_safe_map.get_op_page_stats();
+  std::cout << ap_op << ": " << ticks << " ticks, "
+            << static_cast<double>(ticks) * a_timing.tick_duration_us << " us, "
+            << page_stats.page_reads << " page reads, " << page_stats.page_writes
+            << " page writes" << std::endl;
 }
 
 void safe_map_demo(
   const std::string& eeprom_path,
   uint32_t page_size_bytes,
   uint32_t pages_count,
-  uint32_t sector_size_pages
+  uint32_t sector_size_pages,
+  const page_mem_timing_t& timing
 )
 {
   map_key_t start_key = {1, 2, 3, 4, 5, 6, 7, 8};
-  raw_file_page_mem page_mem(eeprom_path, pages_count, page_size_bytes);
+  raw_file_page_mem page_mem(eeprom_path, pages_count, page_size_bytes, 0, timing);
+  // Счетчики обращений к страницам показывают, как записи распределяются по страницам секторов
+  page_mem_stats_t page_mem_stats(&page_mem);
   eeprom_safe_map_t<map_key_t, uint32_t> m_eeprom_safe_map(
-    &page_mem,
+    &page_mem_stats,
     0,
     pages_count,
     sector_size_pages,
@@ -41,7 +61,7 @@ void safe_map_demo(
   // В последний байт каждой страницы будет записываться индекс
   for (size_t i = 0; i < sector_size_pages; i++) {
     m_eeprom_safe_map.set_value(start_key, i + 1);
-    wait_safe_map(m_eeprom_safe_map);
+    print_latency("set_value", m_eeprom_safe_map, timing);
   }
 
   // Делаем так, чтобы в каждом секторе был один ключ для демонстрации записи во вторую ячейку
@@ -50,7 +70,7 @@ void safe_map_demo(
     map_key_t key;
     key.fill(i);
     m_eeprom_safe_map.set_value(key, 0x10101010 + i);
-    wait_safe_map(m_eeprom_safe_map);
+    print_latency("set_value (new key)", m_eeprom_safe_map, timing);
   }
 
   // Этот ключ будет записываться во вторую ячейку первого сектора.
@@ -59,6 +79,45 @@ void safe_map_demo(
   key.fill(9);
   for (size_t i = 0; i < sector_size_pages + 1; i++) {
     m_eeprom_safe_map.set_value(key, 0x20202020 + i);
-    wait_safe_map(m_eeprom_safe_map);
+    print_latency("set_value", m_eeprom_safe_map, timing);
+  }
+
+  // Чтение с переключением ключа требует поиска актуального значения в секторе
+  uint32_t value = 0;
+  m_eeprom_safe_map.get_value(start_key, value);
+  print_latency("get_value (key switch)", m_eeprom_safe_map, timing);
+  m_eeprom_safe_map.get_value(key, value);
+  print_latency("get_value (key switch)", m_eeprom_safe_map, timing);
+
+  // Пакетная запись: значения ключей, чья следующая запись попадает в одну страницу сектора,
+  // записываются одной записью страницы
+  std::array<std::pair<map_key_t, uint32_t>, 2> values = {
+    std::make_pair(start_key, 0x30303030), std::make_pair(key, 0x40404040)
+  };
+  m_eeprom_safe_map.set_values(values.begin(), values.end());
+  print_latency("set_values", m_eeprom_safe_map, timing);
+  std::cout << "set_values saved page writes: " << m_eeprom_safe_map.get_batch_saved_page_writes()
+            << std::endl;
+
+  // Отложенная запись: частые обновления счетчика поглощаются в ОЗУ, в eeprom попадает только
+  // последнее значение
+  write_behind_safe_map_t<eeprom_safe_map_t<map_key_t, uint32_t>> write_behind(
+    m_eeprom_safe_map, std::chrono::milliseconds(100)
+  );
+  for (uint32_t i = 0; i < 1000; i++) {
+    write_behind.set_value(key, i);
+    write_behind.tick();
+  }
+  write_behind.flush();
+  while (!write_behind.idle() && !write_behind.failed()) {
+    write_behind.tick();
   }
+  auto stats = write_behind.stats();
+  std::cout << "write-behind: " << stats.set_count << " updates, " << stats.absorbed_count
+            << " absorbed, " << stats.skipped_equal_count << " skipped equal, "
+            << stats.issued_count << " written, " << stats.failed_count << " failed"
+            << std::endl;
+
+  std::cout << "page wear:" << std::endl;
+  page_mem_stats.dump_csv(std::cout);
 }
@@ -4,11 +4,14 @@
 #include <cstdint>
 #include <string>
 
+#include "page_mem_timing.h"
+
 void safe_map_demo(
   const std::string& eeprom_path,
   uint32_t page_size_bytes,
   uint32_t pages_count,
-  uint32_t sector_size_pages
+  uint32_t sector_size_pages,
+  const page_mem_timing_t& timing = page_mem_timing_t::legacy()
 );
 
 #endif //SAFE_MAP_DEMO_H
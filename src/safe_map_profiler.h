@@ -0,0 +1,352 @@
+#ifndef SAFE_MAP_PROFILER_H
+#define SAFE_MAP_PROFILER_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// \brief Профиль автомата eeprom_safe_map_t
+/// \details Собирается мапой, только если при компиляции определен макрос EEPROM_SAFE_MAP_PROFILE,
+/// иначе мапа не содержит ни профиля, ни вызовов его функций. Для каждого состояния status_t и
+/// подсостояния add_status_t хранится кол-во переходов автомата, вызовов tick страничной памяти и
+/// время выполнения tick и run_for в этом состоянии, включая время самих измерений. Время ожидания
+/// страничной памяти приходится на состояние wait_page_mem. Для операций get, set, replace, add
+/// (set_value нового ключа) и batch (set_values) хранится гистограмма времени от вызова до
+/// перехода мапы в состояние ready. Монтирование и запись терминатора в reset выполняются без
+/// автомата и не учитываются
+class safe_map_profiler_t
+{
+public:
+  typedef std::chrono::steady_clock clock_type;
+
+  enum class op_t {
+    get,
+    set,
+    replace,
+    add,
+    batch,
+    rebalance,
+    none
+  };
+  static constexpr uint32_t ops_count = static_cast<uint32_t>(op_t::none);
+  /// \brief Кол-во корзин гистограммы. Корзина 0 содержит операции быстрее 1 мкс, корзина i -
+  /// операции от 2^(i-1) до 2^i мкс, последняя - все более долгие
+  static constexpr uint32_t histogram_size = 24;
+
+  struct state_stats_t
+  {
+    const char* name;
+    uint64_t steps;
+    uint64_t page_mem_ticks;
+    uint64_t ns;
+  };
+
+  struct op_stats_t
+  {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t steps;
+    uint64_t page_mem_ticks;
+    std::array<uint64_t, histogram_size> histogram;
+  };
+
+  /// \param a_status_names, a_add_status_names Имена состояний в порядке значений перечислений
+  safe_map_profiler_t(
+    const std::vector<const char*>& a_status_names,
+    const std::vector<const char*>& a_add_status_names
+  );
+
+  /// \brief Учет a_ns наносекунд, проведенных в состоянии a_status
+  void add_state(uint32_t a_status, uint32_t a_steps, uint32_t a_page_mem_ticks, uint64_t a_ns);
+  /// \brief Учет времени подсостояния добавления ключа, дополнительно к состоянию add_key
+  void add_add_state(
+    uint32_t a_add_status,
+    uint32_t a_steps,
+    uint32_t a_page_mem_ticks,
+    uint64_t a_ns
+  );
+  /// \brief Начало операции. Незавершенная операция отбрасывается
+  void begin_op(op_t a_op);
+  /// \brief Завершение текущей операции, если она есть
+  void end_op();
+  /// \brief Обнуляет все счетчики
+  void clear();
+
+  [[nodiscard]] const std::vector<state_stats_t>& states() const;
+  [[nodiscard]] const std::vector<state_stats_t>& add_states() const;
+  [[nodiscard]] const op_stats_t& op_stats(op_t a_op) const;
+  [[nodiscard]] static const char* op_name(op_t a_op);
+  /// \brief Верхняя граница в мкс корзины гистограммы, в которую попадает доля a_quantile
+  /// операций a_op. 0, если операций не было
+  [[nodiscard]] uint64_t quantile_us(op_t a_op, double a_quantile) const;
+
+  /// \brief Таблица состояний и операций для чтения человеком
+  void print_table(std::ostream& a_out) const;
+  void print_json(std::ostream& a_out) const;
+
+private:
+  std::vector<state_stats_t> m_states;
+  std::vector<state_stats_t> m_add_states;
+  std::array<op_stats_t, ops_count> m_ops;
+  op_t m_op;
+  clock_type::time_point m_op_start;
+  uint64_t m_op_steps;
+  uint64_t m_op_page_mem_ticks;
+
+  static uint32_t histogram_bucket(uint64_t a_ns);
+  static void print_state_rows(
+    std::ostream& a_out,
+    const std::vector<state_stats_t>& a_states,
+    const char* ap_prefix,
+    uint64_t a_total_ns
+  );
+  static void print_json_states(std::ostream& a_out, const std::vector<state_stats_t>& a_states);
+};
+
+inline safe_map_profiler_t::safe_map_profiler_t(
+  const std::vector<const char*>& a_status_names,
+  const std::vector<const char*>& a_add_status_names
+) :
+  m_states(),
+  m_add_states(),
+  m_ops(),
+  m_op(op_t::none),
+  m_op_start(),
+  m_op_steps(0),
+  m_op_page_mem_ticks(0)
+{
+  for (const char* p_name : a_status_names) {
+    m_states.push_back({p_name, 0, 0, 0});
+  }
+  for (const char* p_name : a_add_status_names) {
+    m_add_states.push_back({p_name, 0, 0, 0});
+  }
+}
+
+inline void safe_map_profiler_t::add_state(
+  uint32_t a_status, uint32_t a_steps, uint32_t a_page_mem_ticks, uint64_t a_ns
+)
+{
+  state_stats_t& state = m_states[a_status];
+  state.steps += a_steps;
+  state.page_mem_ticks += a_page_mem_ticks;
+  state.ns += a_ns;
+  if (m_op != op_t::none) {
+    m_op_steps += a_steps;
+    m_op_page_mem_ticks += a_page_mem_ticks;
+  }
+}
+
+inline void safe_map_profiler_t::add_add_state(
+  uint32_t a_add_status,
+  uint32_t a_steps,
+  uint32_t a_page_mem_ticks,
+  uint64_t a_ns
+)
+{
+  state_stats_t& state = m_add_states[a_add_status];
+  state.steps += a_steps;
+  state.page_mem_ticks += a_page_mem_ticks;
+  state.ns += a_ns;
+}
+
+inline void safe_map_profiler_t::begin_op(op_t a_op)
+{
+  m_op = a_op;
+  m_op_start = clock_type::now();
+  m_op_steps = 0;
+  m_op_page_mem_ticks = 0;
+}
+
+inline void safe_map_profiler_t::end_op()
+{
+  if (m_op == op_t::none) {
+    return;
+  }
+  const uint64_t ns = static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - m_op_start).count()
+  );
+  op_stats_t& op = m_ops[static_cast<uint32_t>(m_op)];
+  op.count++;
+  op.total_ns += ns;
+  op.max_ns = std::max(op.max_ns, ns);
+  op.steps += m_op_steps;
+  op.page_mem_ticks += m_op_page_mem_ticks;
+  op.histogram[histogram_bucket(ns)]++;
+  m_op = op_t::none;
+}
+
+inline void safe_map_profiler_t::clear()
+{
+  for (state_stats_t& state : m_states) {
+    state = {state.name, 0, 0, 0};
+  }
+  for (state_stats_t& state : m_add_states) {
+    state = {state.name, 0, 0, 0};
+  }
+  m_ops = {};
+  m_op = op_t::none;
+}
+
+inline const std::vector<safe_map_profiler_t::state_stats_t>& safe_map_profiler_t::states() const
+{
+  return m_states;
+}
+
+inline const std::vector<safe_map_profiler_t::state_stats_t>&
+safe_map_profiler_t::add_states() const
+{
+  return m_add_states;
+}
+
+inline const safe_map_profiler_t::op_stats_t& safe_map_profiler_t::op_stats(op_t a_op) const
+{
+  return m_ops[static_cast<uint32_t>(a_op)];
+}
+
+inline const char* safe_map_profiler_t::op_name(op_t a_op)
+{
+  switch (a_op) {
+    case op_t::get: {
+      return "get";
+    }
+    case op_t::set: {
+      return "set";
+    }
+    case op_t::replace: {
+      return "replace";
+    }
+    case op_t::add: {
+      return "add";
+    }
+    case op_t::batch: {
+      return "batch";
+    }
+    case op_t::rebalance: {
+      return "rebalance";
+    }
+    case op_t::none: {
+      return "none";
+    }
+  }
+  return "none";
+}
+
+inline uint64_t safe_map_profiler_t::quantile_us(op_t a_op, double a_quantile) const
+{
+  const op_stats_t& op = m_ops[static_cast<uint32_t>(a_op)];
+  uint64_t count = 0;
+  for (uint32_t bucket = 0; bucket < histogram_size; ++bucket) {
+    count += op.histogram[bucket];
+    if (count > 0 && static_cast<double>(count) >= a_quantile * static_cast<double>(op.count)) {
+      return uint64_t(1) << bucket;
+    }
+  }
+  return 0;
+}
+
+inline void safe_map_profiler_t::print_table(std::ostream& a_out) const
+{
+  uint64_t total_ns = 0;
+  for (const state_stats_t& state : m_states) {
+    total_ns += state.ns;
+  }
+  a_out << std::left << std::setw(34) << "state" << std::right << std::setw(12) << "steps"
+        << std::setw(16) << "page_mem_ticks" << std::setw(14) << "ns" << std::setw(8) << "share%"
+        << std::endl;
+  print_state_rows(a_out, m_states, "", total_ns);
+  print_state_rows(a_out, m_add_states, "add_key/", total_ns);
+
+  a_out << std::endl
+        << std::left << std::setw(10) << "op" << std::right << std::setw(10) << "count"
+        << std::setw(12) << "mean_ns" << std::setw(12) << "max_ns" << std::setw(10) << "p50_us"
+        << std::setw(10) << "p99_us" << std::setw(12) << "steps/op" << std::setw(14)
+        << "mem_ticks/op" << std::endl;
+  for (uint32_t i = 0; i < ops_count; ++i) {
+    const op_t op_type = static_cast<op_t>(i);
+    const op_stats_t& op = m_ops[i];
+    if (op.count == 0) {
+      continue;
+    }
+    a_out << std::left << std::setw(10) << op_name(op_type) << std::right << std::setw(10)
+          << op.count << std::setw(12) << op.total_ns / op.count << std::setw(12) << op.max_ns
+          << std::setw(10) << quantile_us(op_type, 0.5) << std::setw(10)
+          << quantile_us(op_type, 0.99) << std::setw(12) << std::fixed << std::setprecision(1)
+          << static_cast<double>(op.steps) / static_cast<double>(op.count) << std::setw(14)
+          << static_cast<double>(op.page_mem_ticks) / static_cast<double>(op.count)
+          << std::defaultfloat << std::endl;
+  }
+}
+
+inline void safe_map_profiler_t::print_json(std::ostream& a_out) const
+{
+  a_out << "{\"states\":";
+  print_json_states(a_out, m_states);
+  a_out << ",\"add_states\":";
+  print_json_states(a_out, m_add_states);
+  a_out << ",\"ops\":[";
+  for (uint32_t i = 0; i < ops_count; ++i) {
+    const op_stats_t& op = m_ops[i];
+    a_out << (i == 0 ? "" : ",") << "{\"name\":\"" << op_name(static_cast<op_t>(i))
+          << "\",\"count\":" << op.count << ",\"total_ns\":" << op.total_ns
+          << ",\"max_ns\":" << op.max_ns << ",\"steps\":" << op.steps
+          << ",\"page_mem_ticks\":" << op.page_mem_ticks << ",\"histogram_log2_us\":[";
+    for (uint32_t bucket = 0; bucket < histogram_size; ++bucket) {
+      a_out << (bucket == 0 ? "" : ",") << op.histogram[bucket];
+    }
+    a_out << "]}";
+  }
+  a_out << "]}" << std::endl;
+}
+
+inline uint32_t safe_map_profiler_t::histogram_bucket(uint64_t a_ns)
+{
+  uint64_t us = a_ns / 1000;
+  uint32_t bucket = 0;
+  while (us > 0 && bucket + 1 < histogram_size) {
+    us >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+inline void safe_map_profiler_t::print_state_rows(
+  std::ostream& a_out,
+  const std::vector<state_stats_t>& a_states,
+  const char* ap_prefix,
+  uint64_t a_total_ns
+)
+{
+  for (const state_stats_t& state : a_states) {
+    if (state.steps == 0 && state.page_mem_ticks == 0) {
+      continue;
+    }
+    const double share =
+      a_total_ns == 0 ? 0. : 100. * static_cast<double>(state.ns) / static_cast<double>(a_total_ns);
+    a_out << std::left << std::setw(34) << std::string(ap_prefix) + state.name << std::right
+          << std::setw(12) << state.steps << std::setw(16) << state.page_mem_ticks << std::setw(14)
+          << state.ns << std::setw(8) << std::fixed << std::setprecision(1) << share
+          << std::defaultfloat << std::endl;
+  }
+}
+
+inline void safe_map_profiler_t::print_json_states(
+  std::ostream& a_out, const std::vector<state_stats_t>& a_states
+)
+{
+  a_out << "[";
+  for (size_t i = 0; i < a_states.size(); ++i) {
+    const state_stats_t& state = a_states[i];
+    a_out << (i == 0 ? "" : ",") << "{\"name\":\"" << state.name << "\",\"steps\":" << state.steps
+          << ",\"page_mem_ticks\":" << state.page_mem_ticks << ",\"ns\":" << state.ns << "}";
+  }
+  a_out << "]";
+}
+
+#endif // SAFE_MAP_PROFILER_H
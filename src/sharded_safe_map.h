@@ -0,0 +1,422 @@
+#ifndef SHARDED_SAFE_MAP_H
+#define SHARDED_SAFE_MAP_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "key_index.h"
+#include "raw_file_page_mem.h"
+
+/// \brief Мапа, распределяющая ключи по нескольким eeprom_safe_map_t на независимых страничных
+/// памятях
+/// \details Каждый шард - отдельная мапа со своей страничной памятью, например eeprom на своей
+/// шине. Шард ключа выбирается по старшим битам хэша Hash, чтобы не совпадать с младшими битами,
+/// по которым ищет hash_key_index_t внутри шарда. Пакетные вызовы set_values и get_values
+/// раскладывают ключи по шардам, выполняют части во всех шардах одновременно и возвращаются, когда
+/// все шарды закончили. В режиме interleaved шарды обслуживаются по очереди в вызывающем потоке
+/// вызовами run_for с бюджетом в один тик памяти, поэтому ожидание одной памяти перекрывается
+/// работой остальных. В режиме threads у каждого шарда свой поток. Функции вызываются из одного
+/// потока. Каждый шард хранит свой ключ по умолчанию
+/// \param Map Тип мапы, например eeprom_safe_map_t<K, V>
+/// \param PageMem Тип страничной памяти, которой владеют шарды
+template<
+  class Map,
+  class PageMem = irs::page_mem_t,
+  class Hash = key_hash_t<typename Map::key_type>>
+class sharded_safe_map_t
+{
+public:
+  typedef typename Map::key_type key_type;
+  typedef typename Map::value_type value_type;
+
+  enum class mode_t {
+    interleaved,
+    threads
+  };
+
+  struct result_t
+  {
+    /// \brief Ключ найден
+    bool success;
+    value_type value;
+  };
+
+  /// \param ap_pages Страничные памяти шардов, по одной на шард
+  /// \param a_map_args Аргументы конструктора мапы после указателя на страничную память, одинаковые
+  /// для всех шардов
+  template<class... Args>
+  sharded_safe_map_t(
+    std::vector<std::unique_ptr<PageMem>> ap_pages,
+    mode_t a_mode,
+    const Args&... a_map_args
+  );
+  ~sharded_safe_map_t();
+  sharded_safe_map_t(const sharded_safe_map_t&) = delete;
+  sharded_safe_map_t& operator=(const sharded_safe_map_t&) = delete;
+
+  /// \brief Установить значения нескольких ключей
+  /// \details Ключи каждого шарда записываются одним вызовом Map::set_values
+  /// \return false, если хотя бы в одном шарде не хватает места для новых ключей. Тогда ничего не
+  /// записывается
+  template<class InputIt>
+  bool set_values(InputIt a_first, InputIt a_last);
+  /// \brief Прочитать значения нескольких ключей
+  /// \return Результаты в порядке a_keys
+  std::vector<result_t> get_values(const std::vector<key_type>& a_keys);
+  bool set_value(const key_type& a_key, const value_type& a_value);
+  bool get_value(const key_type& a_key, value_type& a_value);
+  /// \brief Вызывает reset всех шардов и ждет его завершения
+  void reset();
+
+  [[nodiscard]] size_t get_shards_count() const;
+  [[nodiscard]] size_t get_shard_index(const key_type& a_key) const;
+  [[nodiscard]] Map& get_shard(size_t a_index);
+  [[nodiscard]] uint32_t get_keys_count() const;
+  [[nodiscard]] uint32_t get_max_keys_count() const;
+  /// \brief Наибольшее по шардам кол-во тиков страничной памяти за последний вызов
+  /// \details Если памяти работают параллельно, то это время вызова в тиках
+  [[nodiscard]] uint32_t get_last_max_page_mem_ticks() const;
+  /// \brief Сумма тиков страничной памяти всех шардов за последний вызов
+  [[nodiscard]] uint32_t get_last_total_page_mem_ticks() const;
+
+private:
+  struct shard_t
+  {
+    std::unique_ptr<PageMem> p_page;
+    Map map;
+    // Работа текущего вызова: пакет записи и позиции читаемых ключей в a_keys
+    std::vector<std::pair<key_type, value_type>> set_items;
+    bool set_started;
+    std::vector<size_t> get_positions;
+    size_t get_position;
+    uint32_t page_mem_ticks;
+    std::thread worker;
+
+    template<class... Args>
+    explicit shard_t(std::unique_ptr<PageMem> ap_page, const Args&... a_map_args) :
+      p_page(std::move(ap_page)),
+      map(p_page.get(), a_map_args...),
+      set_items(),
+      set_started(false),
+      get_positions(),
+      get_position(0),
+      page_mem_ticks(0),
+      worker()
+    {
+    }
+  };
+
+  static constexpr uint32_t worker_yield_page_mem_ticks = 64;
+
+  const mode_t m_mode;
+  Hash m_hash;
+  std::vector<std::unique_ptr<shard_t>> m_shards;
+  const std::vector<key_type>* mp_get_keys;
+  std::vector<result_t>* mp_results;
+  uint32_t m_last_max_page_mem_ticks;
+  uint32_t m_last_total_page_mem_ticks;
+
+  std::mutex m_mutex;
+  std::condition_variable m_job_cv;
+  std::condition_variable m_done_cv;
+  uint64_t m_generation;
+  size_t m_busy_shards_count;
+  bool m_stop;
+
+  /// \brief Выполняет работу всех шардов и ждет ее завершения
+  void run();
+  /// \brief Начинает следующую операцию шарда, если он свободен
+  /// \return true, если вся работа шарда выполнена
+  bool advance(shard_t& a_shard);
+  void worker(shard_t& a_shard);
+};
+
+template<class Map, class PageMem, class Hash>
+template<class... Args>
+sharded_safe_map_t<Map, PageMem, Hash>::sharded_safe_map_t(
+  std::vector<std::unique_ptr<PageMem>> ap_pages,
+  mode_t a_mode,
+  const Args&... a_map_args
+) :
+  m_mode(a_mode),
+  m_hash(),
+  m_shards(),
+  mp_get_keys(nullptr),
+  mp_results(nullptr),
+  m_last_max_page_mem_ticks(0),
+  m_last_total_page_mem_ticks(0),
+  m_mutex(),
+  m_job_cv(),
+  m_done_cv(),
+  m_generation(0),
+  m_busy_shards_count(0),
+  m_stop(false)
+{
+  for (std::unique_ptr<PageMem>& p_page : ap_pages) {
+    m_shards.emplace_back(new shard_t(std::move(p_page), a_map_args...));
+  }
+  if (m_mode == mode_t::threads) {
+    for (std::unique_ptr<shard_t>& p_shard : m_shards) {
+      shard_t& shard = *p_shard;
+      shard.worker = std::thread([this, &shard] {
+        worker(shard);
+      });
+    }
+  }
+  // Завершение операций, начатых конструкторами мап
+  run();
+}
+
+template<class Map, class PageMem, class Hash>
+sharded_safe_map_t<Map, PageMem, Hash>::~sharded_safe_map_t()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_job_cv.notify_all();
+  for (std::unique_ptr<shard_t>& p_shard : m_shards) {
+    if (p_shard->worker.joinable()) {
+      p_shard->worker.join();
+    }
+  }
+}
+
+template<class Map, class PageMem, class Hash>
+template<class InputIt>
+bool sharded_safe_map_t<Map, PageMem, Hash>::set_values(InputIt a_first, InputIt a_last)
+{
+  for (InputIt it = a_first; it != a_last; ++it) {
+    m_shards[get_shard_index(it->first)]->set_items.emplace_back(it->first, it->second);
+  }
+  bool fits = true;
+  for (std::unique_ptr<shard_t>& p_shard : m_shards) {
+    shard_t& shard = *p_shard;
+    std::vector<key_type> new_keys;
+    for (const std::pair<key_type, value_type>& item : shard.set_items) {
+      if (!shard.map.has_key(item.first) &&
+          std::find(new_keys.begin(), new_keys.end(), item.first) == new_keys.end()) {
+        new_keys.push_back(item.first);
+      }
+    }
+    if (shard.map.get_keys_count() + new_keys.size() > shard.map.get_max_keys_count()) {
+      fits = false;
+    }
+  }
+  if (!fits) {
+    for (std::unique_ptr<shard_t>& p_shard : m_shards) {
+      p_shard->set_items.clear();
+    }
+    return false;
+  }
+  run();
+  return true;
+}
+
+template<class Map, class PageMem, class Hash>
+std::vector<typename sharded_safe_map_t<Map, PageMem, Hash>::result_t>
+sharded_safe_map_t<Map, PageMem, Hash>::get_values(const std::vector<key_type>& a_keys)
+{
+  std::vector<result_t> results(a_keys.size(), result_t{false, value_type()});
+  for (size_t position = 0; position < a_keys.size(); ++position) {
+    m_shards[get_shard_index(a_keys[position])]->get_positions.push_back(position);
+  }
+  mp_get_keys = &a_keys;
+  mp_results = &results;
+  run();
+  mp_get_keys = nullptr;
+  mp_results = nullptr;
+  return results;
+}
+
+template<class Map, class PageMem, class Hash>
+bool sharded_safe_map_t<Map, PageMem, Hash>::set_value(
+  const key_type& a_key, const value_type& a_value
+)
+{
+  const std::pair<key_type, value_type> item(a_key, a_value);
+  return set_values(&item, &item + 1);
+}
+
+template<class Map, class PageMem, class Hash>
+bool sharded_safe_map_t<Map, PageMem, Hash>::get_value(const key_type& a_key, value_type& a_value)
+{
+  const result_t result = get_values({a_key}).front();
+  if (result.success) {
+    a_value = result.value;
+  }
+  return result.success;
+}
+
+template<class Map, class PageMem, class Hash>
+void sharded_safe_map_t<Map, PageMem, Hash>::reset()
+{
+  for (std::unique_ptr<shard_t>& p_shard : m_shards) {
+    p_shard->map.reset();
+  }
+  run();
+}
+
+template<class Map, class PageMem, class Hash>
+size_t sharded_safe_map_t<Map, PageMem, Hash>::get_shards_count() const
+{
+  return m_shards.size();
+}
+
+template<class Map, class PageMem, class Hash>
+size_t sharded_safe_map_t<Map, PageMem, Hash>::get_shard_index(const key_type& a_key) const
+{
+  // Умножение со сдвигом отображает хэш на номер шарда по его старшим битам
+  return static_cast<size_t>((static_cast<uint64_t>(m_hash(a_key)) * m_shards.size()) >> 32);
+}
+
+template<class Map, class PageMem, class Hash>
+Map& sharded_safe_map_t<Map, PageMem, Hash>::get_shard(size_t a_index)
+{
+  return m_shards[a_index]->map;
+}
+
+template<class Map, class PageMem, class Hash>
+uint32_t sharded_safe_map_t<Map, PageMem, Hash>::get_keys_count() const
+{
+  uint32_t keys_count = 0;
+  for (const std::unique_ptr<shard_t>& p_shard : m_shards) {
+    keys_count += p_shard->map.get_keys_count();
+  }
+  return keys_count;
+}
+
+template<class Map, class PageMem, class Hash>
+uint32_t sharded_safe_map_t<Map, PageMem, Hash>::get_max_keys_count() const
+{
+  uint32_t max_keys_count = 0;
+  for (const std::unique_ptr<shard_t>& p_shard : m_shards) {
+    max_keys_count += p_shard->map.get_max_keys_count();
+  }
+  return max_keys_count;
+}
+
+template<class Map, class PageMem, class Hash>
+uint32_t sharded_safe_map_t<Map, PageMem, Hash>::get_last_max_page_mem_ticks() const
+{
+  return m_last_max_page_mem_ticks;
+}
+
+template<class Map, class PageMem, class Hash>
+uint32_t sharded_safe_map_t<Map, PageMem, Hash>::get_last_total_page_mem_ticks() const
+{
+  return m_last_total_page_mem_ticks;
+}
+
+template<class Map, class PageMem, class Hash>
+void sharded_safe_map_t<Map, PageMem, Hash>::run()
+{
+  for (std::unique_ptr<shard_t>& p_shard : m_shards) {
+    p_shard->page_mem_ticks = 0;
+  }
+  if (m_mode == mode_t::threads) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_busy_shards_count = m_shards.size();
+    m_generation++;
+    m_job_cv.notify_all();
+    m_done_cv.wait(lock, [this] {
+      return m_busy_shards_count == 0;
+    });
+  } else {
+    std::vector<bool> done(m_shards.size(), false);
+    size_t active_shards_count = m_shards.size();
+    while (active_shards_count > 0) {
+      for (size_t i = 0; i < m_shards.size(); ++i) {
+        if (done[i]) {
+          continue;
+        }
+        shard_t& shard = *m_shards[i];
+        if (advance(shard)) {
+          done[i] = true;
+          active_shards_count--;
+        } else {
+          shard.page_mem_ticks += shard.map.run_for(1).page_mem_ticks;
+        }
+      }
+    }
+  }
+
+  m_last_max_page_mem_ticks = 0;
+  m_last_total_page_mem_ticks = 0;
+  for (std::unique_ptr<shard_t>& p_shard : m_shards) {
+    shard_t& shard = *p_shard;
+    m_last_max_page_mem_ticks = std::max(m_last_max_page_mem_ticks, shard.page_mem_ticks);
+    m_last_total_page_mem_ticks += shard.page_mem_ticks;
+    shard.set_items.clear();
+    shard.set_started = false;
+    shard.get_positions.clear();
+    shard.get_position = 0;
+  }
+}
+
+template<class Map, class PageMem, class Hash>
+bool sharded_safe_map_t<Map, PageMem, Hash>::advance(shard_t& a_shard)
+{
+  if (!a_shard.map.ready()) {
+    return false;
+  }
+  if (!a_shard.set_started && !a_shard.set_items.empty()) {
+    a_shard.set_started = true;
+    a_shard.map.set_values(a_shard.set_items.begin(), a_shard.set_items.end());
+    if (!a_shard.map.ready()) {
+      return false;
+    }
+  }
+  // Чтения выполняются по одному. С зеркалом значений get_value завершается сразу
+  while (a_shard.get_position < a_shard.get_positions.size()) {
+    const size_t position = a_shard.get_positions[a_shard.get_position];
+    result_t& result = (*mp_results)[position];
+    result.success = a_shard.map.get_value((*mp_get_keys)[position], result.value);
+    a_shard.get_position++;
+    if (!a_shard.map.ready()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template<class Map, class PageMem, class Hash>
+void sharded_safe_map_t<Map, PageMem, Hash>::worker(shard_t& a_shard)
+{
+  // Потоки создаются до первого вызова run, когда номер задания еще 0
+  std::unique_lock<std::mutex> lock(m_mutex);
+  uint64_t generation = 0;
+  while (true) {
+    m_job_cv.wait(lock, [this, generation] {
+      return m_stop || m_generation != generation;
+    });
+    if (m_stop) {
+      break;
+    }
+    generation = m_generation;
+    lock.unlock();
+    while (!advance(a_shard)) {
+      // Если за worker_yield_page_mem_ticks тиков память шарда не завершила операцию, процессор
+      // отдается остальным шардам: иначе на машине с меньшим кол-вом ядер, чем шардов, поток ждет
+      // свою очередь, когда его память уже свободна
+      const typename Map::run_result_t result = a_shard.map.run_for(worker_yield_page_mem_ticks);
+      a_shard.page_mem_ticks += result.page_mem_ticks;
+      if (result.steps == 0) {
+        std::this_thread::yield();
+      }
+    }
+    lock.lock();
+    m_busy_shards_count--;
+    if (m_busy_shards_count == 0) {
+      m_done_cv.notify_one();
+    }
+  }
+}
+
+#endif // SHARDED_SAFE_MAP_H
@@ -0,0 +1,214 @@
+#include "sharded_safe_map_bench.h"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "async_file_page_mem.h"
+#include "eeprom_safe_map.h"
+#include "raw_file_page_mem.h"
+#include "sharded_safe_map.h"
+
+namespace {
+
+using bench_key_t = std::array<uint8_t, 4>;
+using bench_map_t = eeprom_safe_map_t<bench_key_t, uint32_t, hash_key_index_t<bench_key_t>>;
+using bench_sharded_map_t = sharded_safe_map_t<bench_map_t>;
+
+const bench_key_t default_key = {0, 0, 0, 0};
+const bench_key_t terminator_key = {0xff, 0xff, 0xff, 0xff};
+const uint32_t page_size_bytes = 32;
+const uint32_t pages_count = 512;
+const uint32_t sector_size_pages = 16;
+// Кол-во ключей помещается в один шард, чтобы нагрузка не зависела от кол-ва шардов
+const uint32_t keys_count = 150;
+const uint32_t batch_size = 32;
+const uint32_t batches_count = 40;
+// Память с реальными задержками занимает 5 мс на запись страницы, поэтому пакетов меньше
+const uint32_t delayed_batches_count = 8;
+
+/// \brief Страничная память шардов
+enum class memory_t {
+  /// \brief raw_file_page_mem: время eeprom моделируется тиками в вызывающем потоке
+  raw_file,
+  /// \brief async_file_page_mem, операция которой длится моделируемое время в реальном времени
+  async_file
+};
+
+bench_key_t bench_key(uint32_t a_number)
+{
+  return {static_cast<uint8_t>(a_number), static_cast<uint8_t>(a_number >> 8), 0, 1};
+}
+
+std::string shard_path(const std::string& a_bench_path, uint32_t a_shard)
+{
+  return a_bench_path + "." + std::to_string(a_shard);
+}
+
+/// \brief Выводит строку CSV для a_ops_count операций за a_seconds секунд
+/// \details Моделируемое время - тики самого загруженного шарда, умноженные на длительность tick
+/// профиля: памяти шардов работают параллельно. У async_file тики - это опросы памяти, а не время
+/// eeprom, поэтому моделируемых столбцов нет
+void print_row(
+  std::ostream& a_out,
+  const page_mem_timing_t& a_timing,
+  memory_t a_memory,
+  const char* ap_mode,
+  uint32_t a_shards_count,
+  const char* ap_op,
+  uint32_t a_ops_count,
+  double a_seconds,
+  uint64_t a_max_page_mem_ticks
+)
+{
+  const double modeled_seconds =
+    static_cast<double>(a_max_page_mem_ticks) * a_timing.tick_duration_us / 1e6;
+  a_out << (a_memory == memory_t::raw_file ? "raw_file" : "async_file") << "," << ap_mode << ","
+        << a_shards_count << "," << ap_op << "," << a_ops_count << ","
+        << static_cast<uint64_t>(a_ops_count / a_seconds) << ",";
+  if (a_memory == memory_t::raw_file) {
+    a_out << static_cast<uint64_t>(a_ops_count / modeled_seconds) << ","
+          << static_cast<double>(a_max_page_mem_ticks) / a_ops_count;
+  } else {
+    a_out << ",";
+  }
+  a_out << std::endl;
+}
+
+void bench_sharded(
+  const std::string& a_bench_path,
+  const page_mem_timing_t& a_timing,
+  memory_t a_memory,
+  bench_sharded_map_t::mode_t a_mode,
+  uint32_t a_shards_count,
+  uint32_t a_batches_count,
+  std::ostream& a_out
+)
+{
+  const char* p_mode = a_mode == bench_sharded_map_t::mode_t::threads ? "threads" : "interleaved";
+  std::vector<std::unique_ptr<irs::page_mem_t>> pages;
+  std::vector<async_file_page_mem*> async_pages;
+  for (uint32_t shard = 0; shard < a_shards_count; ++shard) {
+    const std::string path = shard_path(a_bench_path, shard);
+    std::remove(path.c_str());
+    if (a_memory == memory_t::raw_file) {
+      pages.emplace_back(new raw_file_page_mem(path, pages_count, page_size_bytes, 0, a_timing));
+    } else {
+      async_pages.push_back(new async_file_page_mem(path, pages_count, page_size_bytes));
+      pages.emplace_back(async_pages.back());
+    }
+  }
+  bench_sharded_map_t safe_map(
+    std::move(pages),
+    a_mode,
+    0u,
+    static_cast<size_t>(pages_count),
+    sector_size_pages,
+    default_key,
+    terminator_key
+  );
+  safe_map.reset();
+  std::vector<std::pair<bench_key_t, uint32_t>> items;
+  for (uint32_t i = 1; i <= keys_count; ++i) {
+    items.emplace_back(bench_key(i), i);
+  }
+  safe_map.set_values(items.begin(), items.end());
+  // Образы async_file заполняются без задержек, задержки включаются только на время измерений
+  for (async_file_page_mem* p_page : async_pages) {
+    p_page->set_timing(a_timing);
+  }
+
+  std::mt19937 random(12345);
+  uint64_t max_page_mem_ticks = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t batch = 0; batch < a_batches_count; ++batch) {
+    items.clear();
+    for (uint32_t i = 0; i < batch_size; ++i) {
+      items.emplace_back(bench_key(1 + random() % keys_count), batch);
+    }
+    safe_map.set_values(items.begin(), items.end());
+    max_page_mem_ticks += safe_map.get_last_max_page_mem_ticks();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  print_row(
+    a_out,
+    a_timing,
+    a_memory,
+    p_mode,
+    a_shards_count,
+    "set_values",
+    a_batches_count * batch_size,
+    elapsed.count(),
+    max_page_mem_ticks
+  );
+
+  std::vector<bench_key_t> keys;
+  max_page_mem_ticks = 0;
+  start = std::chrono::steady_clock::now();
+  for (uint32_t batch = 0; batch < a_batches_count; ++batch) {
+    keys.clear();
+    for (uint32_t i = 0; i < batch_size; ++i) {
+      keys.push_back(bench_key(1 + random() % keys_count));
+    }
+    safe_map.get_values(keys);
+    max_page_mem_ticks += safe_map.get_last_max_page_mem_ticks();
+  }
+  elapsed = std::chrono::steady_clock::now() - start;
+  print_row(
+    a_out,
+    a_timing,
+    a_memory,
+    p_mode,
+    a_shards_count,
+    "get_values",
+    a_batches_count * batch_size,
+    elapsed.count(),
+    max_page_mem_ticks
+  );
+}
+
+} // namespace
+
+void sharded_safe_map_bench(
+  const std::string& a_eeprom_path,
+  const page_mem_timing_t& a_timing,
+  std::ostream& a_out
+)
+{
+  const std::string bench_path = a_eeprom_path + ".bench_sharded";
+  const uint32_t max_shards_count = 4;
+  a_out << "memory,mode,shards,op,ops,wall_ops_per_s,modeled_ops_per_s,"
+        << "max_shard_page_mem_ticks_per_op" << std::endl;
+  for (bench_sharded_map_t::mode_t mode :
+       {bench_sharded_map_t::mode_t::interleaved, bench_sharded_map_t::mode_t::threads}) {
+    for (uint32_t shards_count = 1; shards_count <= max_shards_count; shards_count *= 2) {
+      bench_sharded(
+        bench_path, a_timing, memory_t::raw_file, mode, shards_count, batches_count, a_out
+      );
+    }
+  }
+  // Без задержек в профиле памяти async_file нечего перекрывать
+  const page_mem_timing_t delayed_timing =
+    a_timing.full_page_per_tick ? page_mem_timing_t::at25xxx() : a_timing;
+  for (bench_sharded_map_t::mode_t mode :
+       {bench_sharded_map_t::mode_t::interleaved, bench_sharded_map_t::mode_t::threads}) {
+    for (uint32_t shards_count = 1; shards_count <= max_shards_count; shards_count *= 2) {
+      bench_sharded(
+        bench_path,
+        delayed_timing,
+        memory_t::async_file,
+        mode,
+        shards_count,
+        delayed_batches_count,
+        a_out
+      );
+    }
+  }
+  for (uint32_t shard = 0; shard < max_shards_count; ++shard) {
+    std::remove(shard_path(bench_path, shard).c_str());
+  }
+}
@@ -0,0 +1,23 @@
+#ifndef SHARDED_SAFE_MAP_BENCH_H
+#define SHARDED_SAFE_MAP_BENCH_H
+
+#include <ostream>
+#include <string>
+
+#include "page_mem_timing.h"
+
+/// \brief Пакетные set_values и get_values sharded_safe_map_t на 1, 2 и 4 шардах
+/// \details Каждый шард работает со своим образом рядом с a_eeprom_path. Для режимов interleaved
+/// и threads выводит в a_out строки CSV с операциями в секунду по часам компьютера. Для
+/// raw_file_page_mem выводятся также операции в секунду по моделируемому времени профиля a_timing и
+/// тики страничной памяти на операцию самого загруженного шарда: время по часам здесь - затраты
+/// эмулятора. Для async_file_page_mem операции памяти длятся моделируемое время профиля a_timing
+/// (25xx, если a_timing - fast) в реальном времени, поэтому время по часам показывает, насколько
+/// перекрывается ожидание памятей разных шардов
+void sharded_safe_map_bench(
+  const std::string& a_eeprom_path,
+  const page_mem_timing_t& a_timing,
+  std::ostream& a_out
+);
+
+#endif // SHARDED_SAFE_MAP_BENCH_H
@@ -0,0 +1,362 @@
+#ifndef THREADED_SAFE_MAP_H
+#define THREADED_SAFE_MAP_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "mpsc_queue.h"
+#include "raw_file_page_mem.h"
+
+/// \brief Потокобезопасная обертка над eeprom_safe_map_t
+/// \details Владеет мапой и страничной памятью. Мапа обслуживается отдельным потоком, который
+/// вызывает tick. Запросы от любого кол-ва потоков передаются через неблокирующую очередь
+/// mpsc_queue_t и выполняются по одному в порядке поступления. Результат возвращается через
+/// std::future или callback, который вызывается в потоке мапы. Запрос, поставленный после начала
+/// деструктора, не выполняется: он сразу завершается с success == false, callback тогда
+/// вызывается в потоке, который поставил запрос
+/// \param Map Тип мапы, например eeprom_safe_map_t<K, V>
+/// \param PageMem Тип страничной памяти, которой владеет обертка
+template<class Map, class PageMem = irs::page_mem_t>
+class threaded_safe_map_t
+{
+public:
+  typedef typename Map::key_type key_type;
+  typedef typename Map::value_type value_type;
+
+  struct result_t
+  {
+    /// \brief Результат операции мапы: ключ найден для get_value, хватило места для set_value.
+    /// Для replace_key всегда true
+    bool success;
+    value_type value;
+  };
+  typedef std::function<void(const result_t&)> callback_t;
+
+  struct stats_t
+  {
+    /// \brief Кол-во запросов в очереди, еще не взятых потоком мапы
+    uint32_t queue_depth;
+    /// \brief Наибольшее кол-во запросов в очереди сразу после постановки запроса
+    uint32_t max_queue_depth;
+    /// \brief Среднее кол-во запросов в очереди сразу после постановки запроса, включая его
+    double mean_queue_depth;
+    uint64_t completed_count;
+    /// \brief Время от постановки запроса в очередь до его завершения
+    uint64_t mean_latency_ns;
+    uint64_t max_latency_ns;
+  };
+
+  /// \param ap_page Страничная память, с которой работает мапа
+  /// \param a_map_args Аргументы конструктора мапы после указателя на страничную память
+  template<class... Args>
+  explicit threaded_safe_map_t(std::unique_ptr<PageMem> ap_page, Args&&... a_map_args);
+  /// \details Завершает все запросы, поставленные в очередь до вызова деструктора
+  ~threaded_safe_map_t();
+  threaded_safe_map_t(const threaded_safe_map_t&) = delete;
+  threaded_safe_map_t& operator=(const threaded_safe_map_t&) = delete;
+
+  std::future<result_t> get_value(const key_type& a_key);
+  std::future<result_t> set_value(const key_type& a_key, const value_type& a_value);
+  std::future<result_t> replace_key(
+    const key_type& a_old_key, const key_type& a_new_key, const value_type& a_value
+  );
+  void get_value(const key_type& a_key, callback_t a_callback);
+  void set_value(const key_type& a_key, const value_type& a_value, callback_t a_callback);
+  void replace_key(
+    const key_type& a_old_key,
+    const key_type& a_new_key,
+    const value_type& a_value,
+    callback_t a_callback
+  );
+  [[nodiscard]] stats_t stats() const;
+
+private:
+  enum class op_t {
+    get_value,
+    set_value,
+    replace_key
+  };
+  struct request_t
+  {
+    op_t op;
+    key_type key;
+    key_type new_key;
+    value_type value;
+    std::promise<result_t> promise;
+    callback_t callback;
+    std::chrono::steady_clock::time_point enqueue_time;
+  };
+
+  std::unique_ptr<PageMem> mp_page;
+  Map m_map;
+  mpsc_queue_t<std::unique_ptr<request_t>> m_queue;
+  std::atomic<uint32_t> m_queue_depth;
+  std::atomic<uint32_t> m_max_queue_depth;
+  std::atomic<uint64_t> m_enqueued_count;
+  std::atomic<uint64_t> m_total_queue_depth;
+  // Кол-во потоков внутри enqueue. Поток мапы завершается, когда после m_stop нет ни запросов в
+  // очереди, ни потоков, которые еще могут их поставить
+  std::atomic<uint32_t> m_enqueuing_count;
+  std::atomic<bool> m_stop;
+  std::atomic<bool> m_worker_sleeping;
+  std::mutex m_wake_mutex;
+  std::condition_variable m_wake_cv;
+  std::atomic<uint64_t> m_completed_count;
+  std::atomic<uint64_t> m_total_latency_ns;
+  std::atomic<uint64_t> m_max_latency_ns;
+  std::thread m_worker;
+
+  std::future<result_t> enqueue_future(std::unique_ptr<request_t> ap_request);
+  void enqueue(std::unique_ptr<request_t> ap_request);
+  void worker();
+  void execute(request_t& a_request);
+  void wait_map();
+};
+
+template<class Map, class PageMem>
+template<class... Args>
+threaded_safe_map_t<Map, PageMem>::threaded_safe_map_t(
+  std::unique_ptr<PageMem> ap_page, Args&&... a_map_args
+) :
+  mp_page(std::move(ap_page)),
+  m_map(mp_page.get(), std::forward<Args>(a_map_args)...),
+  m_queue(),
+  m_queue_depth(0),
+  m_max_queue_depth(0),
+  m_enqueued_count(0),
+  m_total_queue_depth(0),
+  m_enqueuing_count(0),
+  m_stop(false),
+  m_worker_sleeping(false),
+  m_wake_mutex(),
+  m_wake_cv(),
+  m_completed_count(0),
+  m_total_latency_ns(0),
+  m_max_latency_ns(0),
+  m_worker()
+{
+  // Завершение операции, начатой конструктором мапы (поиск значения ключа по умолчанию)
+  wait_map();
+  m_worker = std::thread(&threaded_safe_map_t::worker, this);
+}
+
+template<class Map, class PageMem>
+threaded_safe_map_t<Map, PageMem>::~threaded_safe_map_t()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_wake_mutex);
+    m_stop = true;
+  }
+  m_wake_cv.notify_one();
+  m_worker.join();
+}
+
+template<class Map, class PageMem>
+std::future<typename threaded_safe_map_t<Map, PageMem>::result_t>
+threaded_safe_map_t<Map, PageMem>::get_value(const key_type& a_key)
+{
+  return enqueue_future(std::unique_ptr<request_t>(
+    new request_t{op_t::get_value, a_key, a_key, value_type(), {}, nullptr, {}}
+  ));
+}
+
+template<class Map, class PageMem>
+std::future<typename threaded_safe_map_t<Map, PageMem>::result_t>
+threaded_safe_map_t<Map, PageMem>::set_value(const key_type& a_key, const value_type& a_value)
+{
+  return enqueue_future(std::unique_ptr<request_t>(
+    new request_t{op_t::set_value, a_key, a_key, a_value, {}, nullptr, {}}
+  ));
+}
+
+template<class Map, class PageMem>
+std::future<typename threaded_safe_map_t<Map, PageMem>::result_t>
+threaded_safe_map_t<Map, PageMem>::replace_key(
+  const key_type& a_old_key, const key_type& a_new_key, const value_type& a_value
+)
+{
+  return enqueue_future(std::unique_ptr<request_t>(
+    new request_t{op_t::replace_key, a_old_key, a_new_key, a_value, {}, nullptr, {}}
+  ));
+}
+
+template<class Map, class PageMem>
+void threaded_safe_map_t<Map, PageMem>::get_value(const key_type& a_key, callback_t a_callback)
+{
+  enqueue(std::unique_ptr<request_t>(
+    new request_t{op_t::get_value, a_key, a_key, value_type(), {}, std::move(a_callback), {}}
+  ));
+}
+
+template<class Map, class PageMem>
+void threaded_safe_map_t<Map, PageMem>::set_value(
+  const key_type& a_key, const value_type& a_value, callback_t a_callback
+)
+{
+  enqueue(std::unique_ptr<request_t>(
+    new request_t{op_t::set_value, a_key, a_key, a_value, {}, std::move(a_callback), {}}
+  ));
+}
+
+template<class Map, class PageMem>
+void threaded_safe_map_t<Map, PageMem>::replace_key(
+  const key_type& a_old_key,
+  const key_type& a_new_key,
+  const value_type& a_value,
+  callback_t a_callback
+)
+{
+  enqueue(std::unique_ptr<request_t>(
+    new request_t{op_t::replace_key, a_old_key, a_new_key, a_value, {}, std::move(a_callback), {}}
+  ));
+}
+
+template<class Map, class PageMem>
+typename threaded_safe_map_t<Map, PageMem>::stats_t
+threaded_safe_map_t<Map, PageMem>::stats() const
+{
+  stats_t stats{};
+  stats.queue_depth = m_queue_depth.load();
+  stats.max_queue_depth = m_max_queue_depth.load();
+  const uint64_t enqueued_count = m_enqueued_count.load();
+  stats.mean_queue_depth = enqueued_count == 0 ? 0.0
+                                                : static_cast<double>(m_total_queue_depth.load()) /
+                                                    static_cast<double>(enqueued_count);
+  stats.completed_count = m_completed_count.load();
+  stats.mean_latency_ns =
+    stats.completed_count == 0 ? 0 : m_total_latency_ns.load() / stats.completed_count;
+  stats.max_latency_ns = m_max_latency_ns.load();
+  return stats;
+}
+
+template<class Map, class PageMem>
+std::future<typename threaded_safe_map_t<Map, PageMem>::result_t>
+threaded_safe_map_t<Map, PageMem>::enqueue_future(std::unique_ptr<request_t> ap_request)
+{
+  std::future<result_t> result = ap_request->promise.get_future();
+  enqueue(std::move(ap_request));
+  return result;
+}
+
+template<class Map, class PageMem>
+void threaded_safe_map_t<Map, PageMem>::enqueue(std::unique_ptr<request_t> ap_request)
+{
+  ap_request->enqueue_time = std::chrono::steady_clock::now();
+  // Поток, увидевший m_stop == false, уже учтен в m_enqueuing_count, и поток мапы дождется его
+  // запроса
+  m_enqueuing_count.fetch_add(1);
+  if (m_stop.load()) {
+    m_enqueuing_count.fetch_sub(1);
+    result_t result{false, ap_request->value};
+    if (ap_request->callback) {
+      ap_request->callback(result);
+    } else {
+      ap_request->promise.set_value(result);
+    }
+    return;
+  }
+  m_queue.push(std::move(ap_request));
+  // Счетчик увеличивается после push, но pop может не найти элемент, пока другой производитель
+  // не записал указатель на свой узел. Поток мапы будится, только если он уснул
+  const uint32_t queue_depth = m_queue_depth.fetch_add(1) + 1;
+  m_enqueued_count.fetch_add(1);
+  m_total_queue_depth.fetch_add(queue_depth);
+  uint32_t max_queue_depth = m_max_queue_depth.load();
+  while (queue_depth > max_queue_depth &&
+         !m_max_queue_depth.compare_exchange_weak(max_queue_depth, queue_depth)) {
+  }
+  if (m_worker_sleeping.load()) {
+    std::lock_guard<std::mutex> lock(m_wake_mutex);
+    m_wake_cv.notify_one();
+  }
+  // Последнее обращение к членам объекта: после него деструктор может завершиться
+  m_enqueuing_count.fetch_sub(1);
+}
+
+template<class Map, class PageMem>
+void threaded_safe_map_t<Map, PageMem>::worker()
+{
+  while (true) {
+    std::unique_ptr<request_t> p_request;
+    if (m_queue_depth.load() > 0) {
+      if (m_queue.pop(p_request)) {
+        m_queue_depth.fetch_sub(1);
+        execute(*p_request);
+      } else {
+        // Производитель между exchange и записью указателя next: элемент появится сразу после нее
+        std::this_thread::yield();
+      }
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_wake_mutex);
+    if (m_stop) {
+      // Запросы, поставленные до m_stop, выполняются до конца
+      if (m_enqueuing_count.load() == 0 && m_queue_depth.load() == 0) {
+        break;
+      }
+      lock.unlock();
+      std::this_thread::yield();
+      continue;
+    }
+    m_worker_sleeping = true;
+    m_wake_cv.wait(lock, [this] {
+      return m_queue_depth.load() > 0 || m_stop;
+    });
+    m_worker_sleeping = false;
+  }
+}
+
+template<class Map, class PageMem>
+void threaded_safe_map_t<Map, PageMem>::execute(request_t& a_request)
+{
+  result_t result{true, a_request.value};
+  switch (a_request.op) {
+    case op_t::get_value: {
+      result.success = m_map.get_value(a_request.key, result.value);
+    } break;
+    case op_t::set_value: {
+      result.success = m_map.set_value(a_request.key, a_request.value);
+    } break;
+    case op_t::replace_key: {
+      m_map.replace_key(a_request.key, a_request.new_key, a_request.value);
+    } break;
+  }
+  wait_map();
+
+  const uint64_t latency_ns = static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - a_request.enqueue_time
+    )
+      .count()
+  );
+  m_total_latency_ns.fetch_add(latency_ns);
+  uint64_t max_latency_ns = m_max_latency_ns.load();
+  while (latency_ns > max_latency_ns &&
+         !m_max_latency_ns.compare_exchange_weak(max_latency_ns, latency_ns)) {
+  }
+  m_completed_count.fetch_add(1);
+
+  if (a_request.callback) {
+    a_request.callback(result);
+  } else {
+    a_request.promise.set_value(result);
+  }
+}
+
+template<class Map, class PageMem>
+void threaded_safe_map_t<Map, PageMem>::wait_map()
+{
+  while (!m_map.ready()) {
+    m_map.tick();
+  }
+}
+
+#endif // THREADED_SAFE_MAP_H
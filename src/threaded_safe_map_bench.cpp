@@ -0,0 +1,200 @@
+#include "threaded_safe_map_bench.h"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "eeprom_safe_map.h"
+#include "mmap_file_page_mem.h"
+#include "threaded_safe_map.h"
+
+namespace {
+
+using bench_key_t = std::array<uint8_t, 8>;
+using bench_map_t = eeprom_safe_map_t<bench_key_t, uint32_t, hash_key_index_t<bench_key_t>>;
+
+const bench_key_t default_key = {0, 0, 0, 0, 0, 0, 0, 0};
+const bench_key_t terminator_key = {0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f};
+// Каждый поток работает со своими ключами
+const uint32_t keys_per_thread = 4;
+// Кол-во незавершенных запросов одного потока: 1 - поток ждет каждый запрос, иначе очередь
+// заполняется запросами всех потоков
+const uint32_t windows[] = {1, 32};
+
+bench_key_t thread_key(uint32_t a_thread, uint32_t a_op)
+{
+  bench_key_t key = default_key;
+  key[0] = static_cast<uint8_t>(a_thread + 1);
+  key[1] = static_cast<uint8_t>(a_op % keys_per_thread);
+  return key;
+}
+
+void format_eeprom(
+  const std::string& a_path, uint32_t a_page_size, uint32_t a_pages_count, uint32_t a_sector_size
+)
+{
+  mmap_file_page_mem page_mem(a_path, a_pages_count, a_page_size);
+  bench_map_t safe_map(&page_mem, 0, a_pages_count, a_sector_size, default_key, terminator_key);
+  safe_map.reset();
+  while (!safe_map.ready()) {
+    safe_map.tick();
+  }
+}
+
+double run_threaded(
+  const std::string& a_path,
+  uint32_t a_page_size,
+  uint32_t a_pages_count,
+  uint32_t a_sector_size,
+  uint32_t a_threads_count,
+  uint32_t a_window,
+  uint32_t a_ops_per_thread
+)
+{
+  typedef threaded_safe_map_t<bench_map_t> threaded_map_t;
+  threaded_map_t safe_map(
+    std::make_unique<mmap_file_page_mem>(a_path, a_pages_count, a_page_size),
+    0,
+    a_pages_count,
+    a_sector_size,
+    default_key,
+    terminator_key
+  );
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> producers;
+  for (uint32_t thread = 0; thread < a_threads_count; ++thread) {
+    producers.emplace_back([&safe_map, thread, a_window, a_ops_per_thread] {
+      std::deque<std::future<threaded_map_t::result_t>> pending;
+      for (uint32_t op = 0; op < a_ops_per_thread; ++op) {
+        // Запросы выполняются в порядке постановки, поэтому после ожидания середины окна первая
+        // его половина тоже завершена. Окно пополняется половинами, а не по одному запросу, иначе
+        // каждое завершение будит поток-производитель и потоки переключаются на каждом запросе
+        if (pending.size() == a_window) {
+          const size_t completed_count = (a_window + 1) / 2;
+          pending[completed_count - 1].get();
+          for (size_t i = 0; i < completed_count; ++i) {
+            pending.pop_front();
+          }
+        }
+        if (op % 2 == 0) {
+          pending.push_back(safe_map.set_value(thread_key(thread, op), op));
+        } else {
+          pending.push_back(safe_map.get_value(thread_key(thread, op - 1)));
+        }
+      }
+      for (auto& result : pending) {
+        result.get();
+      }
+    });
+  }
+  for (std::thread& producer : producers) {
+    producer.join();
+  }
+  const double seconds =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  auto stats = safe_map.stats();
+  std::cout << std::setw(10) << "threaded" << std::setw(9) << a_threads_count << std::setw(8)
+            << a_window << std::setw(12)
+            << static_cast<uint64_t>(a_threads_count * a_ops_per_thread / seconds)
+            << std::setw(14) << stats.mean_latency_ns / 1000 << std::setw(14)
+            << stats.max_latency_ns / 1000 << std::setw(12) << std::fixed << std::setprecision(1)
+            << stats.mean_queue_depth << std::setw(11) << stats.max_queue_depth << std::endl;
+  return seconds;
+}
+
+double run_mutex(
+  const std::string& a_path,
+  uint32_t a_page_size,
+  uint32_t a_pages_count,
+  uint32_t a_sector_size,
+  uint32_t a_threads_count,
+  uint32_t a_ops_per_thread
+)
+{
+  mmap_file_page_mem page_mem(a_path, a_pages_count, a_page_size);
+  bench_map_t safe_map(&page_mem, 0, a_pages_count, a_sector_size, default_key, terminator_key);
+  std::mutex map_mutex;
+  auto wait_safe_map = [&safe_map] {
+    while (!safe_map.ready()) {
+      safe_map.tick();
+    }
+  };
+  wait_safe_map();
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> producers;
+  for (uint32_t thread = 0; thread < a_threads_count; ++thread) {
+    producers.emplace_back([&, thread] {
+      uint32_t value = 0;
+      for (uint32_t op = 0; op < a_ops_per_thread; ++op) {
+        std::lock_guard<std::mutex> lock(map_mutex);
+        if (op % 2 == 0) {
+          safe_map.set_value(thread_key(thread, op), op);
+        } else {
+          safe_map.get_value(thread_key(thread, op - 1), value);
+        }
+        wait_safe_map();
+      }
+    });
+  }
+  for (std::thread& producer : producers) {
+    producer.join();
+  }
+  const double seconds =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << std::setw(10) << "mutex" << std::setw(9) << a_threads_count << std::setw(8) << "-"
+            << std::setw(12) << static_cast<uint64_t>(a_threads_count * a_ops_per_thread / seconds)
+            << std::endl;
+  return seconds;
+}
+
+} // namespace
+
+void threaded_safe_map_bench(
+  const std::string& a_eeprom_path,
+  uint32_t a_page_size_bytes,
+  uint32_t a_pages_count,
+  uint32_t a_sector_size_pages,
+  uint32_t a_ops_per_thread
+)
+{
+  const std::string bench_path = a_eeprom_path + ".bench_threaded";
+  const uint32_t max_threads_count = std::max(2u, std::thread::hardware_concurrency());
+
+  std::cout << std::setw(10) << "mode" << std::setw(9) << "threads" << std::setw(8) << "window"
+            << std::setw(12) << "ops/s" << std::setw(14) << "mean lat us" << std::setw(14)
+            << "max lat us" << std::setw(12) << "mean depth" << std::setw(11) << "max depth"
+            << std::endl;
+  for (uint32_t threads_count = 1; threads_count <= max_threads_count; threads_count *= 2) {
+    for (uint32_t window : windows) {
+      std::remove(bench_path.c_str());
+      format_eeprom(bench_path, a_page_size_bytes, a_pages_count, a_sector_size_pages);
+      run_threaded(
+        bench_path,
+        a_page_size_bytes,
+        a_pages_count,
+        a_sector_size_pages,
+        threads_count,
+        window,
+        a_ops_per_thread
+      );
+    }
+    std::remove(bench_path.c_str());
+    format_eeprom(bench_path, a_page_size_bytes, a_pages_count, a_sector_size_pages);
+    run_mutex(
+      bench_path,
+      a_page_size_bytes,
+      a_pages_count,
+      a_sector_size_pages,
+      threads_count,
+      a_ops_per_thread
+    );
+  }
+  std::remove(bench_path.c_str());
+}
@@ -0,0 +1,20 @@
+#ifndef THREADED_SAFE_MAP_BENCH_H
+#define THREADED_SAFE_MAP_BENCH_H
+
+#include <cstdint>
+#include <string>
+
+/// \brief Нагрузочный тест threaded_safe_map_t с несколькими потоками-производителями
+/// \details Каждый поток держит не больше окна незавершенных запросов: с окном 1 поток ждет
+/// каждый запрос, с большим окном очередь заполняется запросами всех потоков. Выводит глубину
+/// очереди при постановке запроса. Для сравнения та же нагрузка выполняется с общим мьютексом, под
+/// которым каждый поток сам вызывает tick мапы до завершения операции
+void threaded_safe_map_bench(
+  const std::string& a_eeprom_path,
+  uint32_t a_page_size_bytes,
+  uint32_t a_pages_count,
+  uint32_t a_sector_size_pages,
+  uint32_t a_ops_per_thread
+);
+
+#endif // THREADED_SAFE_MAP_BENCH_H
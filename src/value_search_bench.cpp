@@ -0,0 +1,127 @@
+#include "value_search_bench.h"
+
+#include <array>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+
+#include "eeprom_safe_map.h"
+#include "page_mem_stats.h"
+#include "raw_file_page_mem.h"
+
+namespace {
+
+using bench_key_t = std::array<uint8_t, 8>;
+using bench_map_t = eeprom_safe_map_t<bench_key_t, uint32_t>;
+using wide_bench_map_t = wide_index_safe_map_t<bench_key_t, uint32_t>;
+
+template<class Map>
+void wait_safe_map(Map& a_safe_map)
+{
+  while (!a_safe_map.ready()) {
+    a_safe_map.tick();
+  }
+}
+
+/// \return Среднее кол-во чтений страниц на одну смену ключа
+template<class Map>
+double reads_per_key_switch(
+  const std::string& a_eeprom_path,
+  uint32_t a_page_size_bytes,
+  uint32_t a_sector_size_pages,
+  uint32_t a_writes_count,
+  value_search_t a_value_search
+)
+{
+  // Места хватает ровно на два сектора: ключ a и ключ b лежат в разных секторах
+  const uint32_t pages_count = 2 * a_sector_size_pages + 4;
+  const bench_key_t key_a = {1, 1, 1, 1, 1, 1, 1, 1};
+  const bench_key_t key_b = {2, 2, 2, 2, 2, 2, 2, 2};
+  const uint32_t switches_count = 16;
+
+  raw_file_page_mem file_page_mem(
+    a_eeprom_path, pages_count, a_page_size_bytes, 0, page_mem_timing_t::fast()
+  );
+  page_mem_stats_t page_mem(&file_page_mem);
+  eeprom_safe_map_config_t config;
+  config.value_search = a_value_search;
+  Map safe_map(
+    &page_mem,
+    0,
+    pages_count,
+    a_sector_size_pages,
+    key_a,
+    {0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f},
+    config
+  );
+  safe_map.reset();
+  wait_safe_map(safe_map);
+  for (uint32_t i = 0; i < a_writes_count; ++i) {
+    safe_map.set_value(key_a, i);
+    wait_safe_map(safe_map);
+  }
+  safe_map.set_value(key_b, 0);
+  wait_safe_map(safe_map);
+
+  uint32_t value = 0;
+  const uint64_t reads_before = page_mem.total_reads();
+  for (uint32_t i = 0; i < switches_count; ++i) {
+    safe_map.get_value(i % 2 == 0 ? key_a : key_b, value);
+    wait_safe_map(safe_map);
+  }
+  return static_cast<double>(page_mem.total_reads() - reads_before) / switches_count;
+}
+
+/// \brief Печатает таблицу чтений на смену ключа для мапы Map
+template<class Map>
+void print_reads_table(
+  const std::string& a_bench_path,
+  uint32_t a_page_size_bytes,
+  const uint32_t* ap_sector_sizes,
+  size_t a_sector_sizes_count
+)
+{
+  std::cout << std::setw(8) << "sector" << std::setw(10) << "writes" << std::setw(10) << "linear"
+            << std::setw(10) << "binary" << std::endl;
+  for (size_t i = 0; i < a_sector_sizes_count; ++i) {
+    const uint32_t sector_size_pages = ap_sector_sizes[i];
+    // Заполнение половины сектора, полный сектор и сектор после перехода через начало
+    const uint32_t writes_counts[] = {
+      sector_size_pages / 2, sector_size_pages, sector_size_pages * 3 / 2
+    };
+    for (uint32_t writes_count : writes_counts) {
+      std::remove(a_bench_path.c_str());
+      double linear = reads_per_key_switch<Map>(
+        a_bench_path, a_page_size_bytes, sector_size_pages, writes_count, value_search_t::linear
+      );
+      std::remove(a_bench_path.c_str());
+      double binary = reads_per_key_switch<Map>(
+        a_bench_path, a_page_size_bytes, sector_size_pages, writes_count, value_search_t::binary
+      );
+      std::cout << std::setw(8) << sector_size_pages << std::setw(10) << writes_count
+                << std::setw(10) << linear << std::setw(10) << binary << std::endl;
+    }
+  }
+  std::remove(a_bench_path.c_str());
+}
+
+} // namespace
+
+void value_search_bench(const std::string& a_eeprom_path, uint32_t a_page_size_bytes)
+{
+  const std::string bench_path = a_eeprom_path + ".bench_search";
+  const uint32_t sector_sizes[] = {4, 8, 16, 32, 64, 128, 254};
+  // Секторы больше 254 страниц доступны только с 2-байтовым индексом значения
+  const uint32_t wide_sector_sizes[] = {64, 254, 1024, 4096};
+
+  std::cout << "page reads per key switch, page_size=" << a_page_size_bytes << std::endl;
+  print_reads_table<bench_map_t>(
+    bench_path, a_page_size_bytes, sector_sizes, std::size(sector_sizes)
+  );
+  std::cout << "page reads per key switch, 2-byte value index, page_size=" << a_page_size_bytes
+            << std::endl;
+  print_reads_table<wide_bench_map_t>(
+    bench_path, a_page_size_bytes, wide_sector_sizes, std::size(wide_sector_sizes)
+  );
+}
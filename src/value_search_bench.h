@@ -0,0 +1,12 @@
+#ifndef VALUE_SEARCH_BENCH_H
+#define VALUE_SEARCH_BENCH_H
+
+#include <cstdint>
+#include <string>
+
+/// \brief Кол-во чтений страниц при смене ключа для линейного и двоичного поиска актуального
+/// значения при размерах сектора от 4 до 254 страниц, а также для мапы с 2-байтовым индексом
+/// значения при секторах до 4096 страниц
+void value_search_bench(const std::string& a_eeprom_path, uint32_t a_page_size_bytes);
+
+#endif // VALUE_SEARCH_BENCH_H
@@ -0,0 +1,285 @@
+#ifndef WRITE_BEHIND_SAFE_MAP_H
+#define WRITE_BEHIND_SAFE_MAP_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "raw_file_page_mem.h"
+
+/// \brief Отложенная запись значений в eeprom_safe_map_t
+/// \details Новые значения сохраняются в ОЗУ и записываются в мапу не позже заданного срока.
+/// Повторные обновления ключа до истечения срока поглощаются: в eeprom попадает только последнее
+/// значение. Значения, совпадающие с уже записанными в мапу (текущий ключ мапы или зеркало
+/// значений), не записываются. Для немедленной записи есть set_value_now, для принудительного
+/// сброса всех значений - flush
+/// \param Map Тип мапы, например eeprom_safe_map_t<K, V>
+template<class Map>
+class write_behind_safe_map_t
+{
+public:
+  typedef typename Map::key_type key_type;
+  typedef typename Map::value_type value_type;
+  typedef std::chrono::steady_clock clock_type;
+
+  struct stats_t
+  {
+    /// \brief Кол-во вызовов set_value
+    uint64_t set_count;
+    /// \brief Кол-во обновлений, перезаписанных в ОЗУ до записи в eeprom
+    uint64_t absorbed_count;
+    /// \brief Кол-во обновлений, не записанных из-за совпадения с записанным значением
+    uint64_t skipped_equal_count;
+    /// \brief Кол-во операций записи, принятых мапой
+    uint64_t issued_count;
+    /// \brief Кол-во записей, отклоненных мапой или завершенных ею с ошибкой страничной памяти
+    /// \details Значение такой записи остается отложенным в ОЗУ и передается снова на следующем
+    /// tick
+    uint64_t failed_count;
+  };
+
+  /// \param a_default_delay Срок записи значения для set_value без явного срока
+  explicit write_behind_safe_map_t(Map& a_map, clock_type::duration a_default_delay);
+  /// \details Сбрасывает все отложенные значения в мапу, вызывая tick до завершения записи или до
+  /// первой отклоненной записи
+  ~write_behind_safe_map_t();
+  write_behind_safe_map_t(const write_behind_safe_map_t&) = delete;
+  write_behind_safe_map_t& operator=(const write_behind_safe_map_t&) = delete;
+
+  /// \brief Откладывает запись значения не более чем на a_delay
+  /// \details Повторный вызов для ключа с отложенным значением заменяет значение, но не переносит
+  /// срок записи на более позднее время. Можно вызывать в любом состоянии
+  /// \return false, если ключ новый и для него не хватит места в мапе
+  bool set_value(const key_type& a_key, const value_type& a_value, clock_type::duration a_delay);
+  bool set_value(const key_type& a_key, const value_type& a_value);
+  /// \brief Немедленная запись в мапу с семантикой eeprom_safe_map_t::set_value
+  /// \details Если мапа приняла запись, то отложенное значение ключа отбрасывается, иначе
+  /// остается. Вызывать в состоянии ready
+  bool set_value_now(const key_type& a_key, const value_type& a_value);
+  /// \details Отложенное значение возвращается сразу, иначе чтение выполняет мапа и значение будет
+  /// записано в a_value после перехода в состояние ready. Вызывать в состоянии ready
+  bool get_value(const key_type& a_key, value_type& a_value);
+  /// \brief Делает срок записи всех отложенных значений истекшим
+  void flush();
+  void tick();
+  /// \brief Мапа свободна, можно вызывать get_value и set_value_now
+  bool ready();
+  /// \brief Мапа свободна и отложенных значений нет
+  bool idle();
+  /// \brief Последняя запись отложенного значения отклонена мапой или завершилась ошибкой
+  /// \details Сбрасывается следующей принятой записью. Циклы ожидания idle нужно прерывать по этому
+  /// признаку, иначе при ошибке мапы они не завершатся
+  [[nodiscard]] bool failed() const;
+  [[nodiscard]] size_t dirty_count() const;
+  [[nodiscard]] stats_t stats() const;
+
+private:
+  struct dirty_entry_t
+  {
+    key_type key;
+    value_type value;
+    clock_type::time_point deadline;
+  };
+
+  Map& m_map;
+  clock_type::duration m_default_delay;
+  std::vector<dirty_entry_t> m_dirty;
+  stats_t m_stats;
+  bool m_failed;
+  // Запись, переданная в мапу tick. Она остается здесь до перехода мапы в ready, чтобы вернуть
+  // значение в отложенные, если запись завершилась ошибкой
+  bool m_issued;
+  dirty_entry_t m_issued_entry;
+
+  typename std::vector<dirty_entry_t>::iterator find_dirty(const key_type& a_key);
+  uint32_t new_dirty_keys_count() const;
+};
+
+template<class Map>
+write_behind_safe_map_t<Map>::write_behind_safe_map_t(
+  Map& a_map, clock_type::duration a_default_delay
+) :
+  m_map(a_map),
+  m_default_delay(a_default_delay),
+  m_dirty(),
+  m_stats{},
+  m_failed(false),
+  m_issued(false),
+  m_issued_entry()
+{
+}
+
+template<class Map>
+write_behind_safe_map_t<Map>::~write_behind_safe_map_t()
+{
+  flush();
+  while (!idle() && !m_failed) {
+    tick();
+  }
+}
+
+template<class Map>
+bool write_behind_safe_map_t<Map>::set_value(
+  const key_type& a_key, const value_type& a_value, clock_type::duration a_delay
+)
+{
+  auto entry = find_dirty(a_key);
+  if (entry != m_dirty.end()) {
+    m_stats.set_count++;
+    m_stats.absorbed_count++;
+    entry->value = a_value;
+    entry->deadline = std::min(entry->deadline, clock_type::now() + a_delay);
+    return true;
+  }
+  if (!m_map.has_key(a_key) &&
+      m_map.get_keys_count() + new_dirty_keys_count() + 1 > m_map.get_max_keys_count()) {
+    return false;
+  }
+  m_stats.set_count++;
+  m_dirty.push_back({a_key, a_value, clock_type::now() + a_delay});
+  return true;
+}
+
+template<class Map>
+bool write_behind_safe_map_t<Map>::set_value(const key_type& a_key, const value_type& a_value)
+{
+  return set_value(a_key, a_value, m_default_delay);
+}
+
+template<class Map>
+bool write_behind_safe_map_t<Map>::set_value_now(const key_type& a_key, const value_type& a_value)
+{
+  m_stats.set_count++;
+  if (!m_map.set_value(a_key, a_value)) {
+    m_stats.failed_count++;
+    return false;
+  }
+  m_stats.issued_count++;
+  auto entry = find_dirty(a_key);
+  if (entry != m_dirty.end()) {
+    m_stats.absorbed_count++;
+    m_dirty.erase(entry);
+  }
+  return true;
+}
+
+template<class Map>
+bool write_behind_safe_map_t<Map>::get_value(const key_type& a_key, value_type& a_value)
+{
+  auto entry = find_dirty(a_key);
+  if (entry != m_dirty.end()) {
+    a_value = entry->value;
+    return true;
+  }
+  return m_map.get_value(a_key, a_value);
+}
+
+template<class Map>
+void write_behind_safe_map_t<Map>::flush()
+{
+  const clock_type::time_point now = clock_type::now();
+  for (dirty_entry_t& entry : m_dirty) {
+    entry.deadline = std::min(entry.deadline, now);
+  }
+}
+
+template<class Map>
+void write_behind_safe_map_t<Map>::tick()
+{
+  m_map.tick();
+  if (!m_map.ready()) {
+    return;
+  }
+  if (m_issued) {
+    m_issued = false;
+    if (m_map.status() == irs_st_error) {
+      m_failed = true;
+      m_stats.failed_count++;
+      if (find_dirty(m_issued_entry.key) == m_dirty.end()) {
+        m_dirty.push_back(m_issued_entry);
+      }
+    }
+  }
+  if (m_dirty.empty()) {
+    return;
+  }
+  // За один tick в мапу передается не больше одной записи: значение с самым ранним сроком
+  auto entry = std::min_element(
+    m_dirty.begin(),
+    m_dirty.end(),
+    [](const dirty_entry_t& a_left, const dirty_entry_t& a_right) {
+      return a_left.deadline < a_right.deadline;
+    }
+  );
+  if (entry->deadline > clock_type::now()) {
+    return;
+  }
+  value_type stored_value;
+  if (m_map.get_cached_value(entry->key, stored_value) && stored_value == entry->value) {
+    m_stats.skipped_equal_count++;
+    m_dirty.erase(entry);
+    return;
+  }
+  // Значение остается отложенным, пока мапа не примет запись
+  m_failed = !m_map.set_value(entry->key, entry->value);
+  if (m_failed) {
+    m_stats.failed_count++;
+    return;
+  }
+  m_stats.issued_count++;
+  m_issued = true;
+  m_issued_entry = *entry;
+  m_dirty.erase(entry);
+}
+
+template<class Map>
+bool write_behind_safe_map_t<Map>::ready()
+{
+  return m_map.ready();
+}
+
+template<class Map>
+bool write_behind_safe_map_t<Map>::idle()
+{
+  return m_map.ready() && m_dirty.empty() && !m_issued;
+}
+
+template<class Map>
+bool write_behind_safe_map_t<Map>::failed() const
+{
+  return m_failed;
+}
+
+template<class Map>
+size_t write_behind_safe_map_t<Map>::dirty_count() const
+{
+  return m_dirty.size();
+}
+
+template<class Map>
+typename write_behind_safe_map_t<Map>::stats_t write_behind_safe_map_t<Map>::stats() const
+{
+  return m_stats;
+}
+
+template<class Map>
+typename std::vector<typename write_behind_safe_map_t<Map>::dirty_entry_t>::iterator
+write_behind_safe_map_t<Map>::find_dirty(const key_type& a_key)
+{
+  return std::find_if(m_dirty.begin(), m_dirty.end(), [&a_key](const dirty_entry_t& a_entry) {
+    return a_entry.key == a_key;
+  });
+}
+
+template<class Map>
+uint32_t write_behind_safe_map_t<Map>::new_dirty_keys_count() const
+{
+  return static_cast<uint32_t>(
+    std::count_if(m_dirty.begin(), m_dirty.end(), [this](const dirty_entry_t& a_entry) {
+      return !m_map.has_key(a_entry.key);
+    })
+  );
+}
+
+#endif // WRITE_BEHIND_SAFE_MAP_H